@@ -0,0 +1,152 @@
+#ifndef _BICYCLE_MODEL_H_
+#define _BICYCLE_MODEL_H_
+
+#include "Nmpc/parameter_settings.h"
+#include <Eigen/Dense>
+#include <cmath>
+
+/*! Kinematic bicycle model of the car, used by the NMPC backends and the Kalman filter
+ *  state = {x, y, psi}, input = {v, delta}
+ */
+typedef Eigen::Matrix<double, 3, 1> BicycleState;
+typedef Eigen::Matrix<double, 2, 1> BicycleInput;
+typedef Eigen::Matrix<double, 3, 3> BicycleStateJacobian;
+typedef Eigen::Matrix<double, 3, 2> BicycleInputJacobian;
+
+/*! time derivative of the state */
+inline void BicycleDerivative(const BicycleState& x, const BicycleInput& u, BicycleState& dx)
+{
+    const double beta = x(2) + (lf / l) * u(1);
+    dx(0) = u(0) * cos(beta);
+    dx(1) = u(0) * sin(beta);
+    dx(2) = (u(0) / (lf + lr)) * tan(u(1));
+}
+
+/*! time derivative of the state and its partial derivatives A = df/dx, B = df/du */
+inline void BicycleDerivative(const BicycleState& x, const BicycleInput& u, BicycleState& dx,
+                              BicycleStateJacobian& A, BicycleInputJacobian& B)
+{
+    const double beta = x(2) + (lf / l) * u(1);
+    const double cb = cos(beta);
+    const double sb = sin(beta);
+    const double td = tan(u(1));
+
+    dx(0) = u(0) * cb;
+    dx(1) = u(0) * sb;
+    dx(2) = (u(0) / (lf + lr)) * td;
+
+    A << 0, 0, -u(0) * sb,
+         0, 0,  u(0) * cb,
+         0, 0,  0;
+    B << cb,               -u(0) * sb * (lf / l),
+         sb,                u(0) * cb * (lf / l),
+         td / (lf + lr),    (u(0) / (lf + lr)) * (1.0 + td * td);
+}
+
+/*! One Runge-Kutta 4 step of length h together with the sensitivities of the result,
+ *  A = dx_next/dx and B = dx_next/du
+ */
+inline void BicycleIntegrate(const BicycleState& x, const BicycleInput& u, double h, BicycleState& x_next,
+                             BicycleStateJacobian& A, BicycleInputJacobian& B)
+{
+    BicycleState k1, k2, k3, k4;
+    BicycleStateJacobian A1, A2, A3, A4, dk1x, dk2x, dk3x, dk4x;
+    BicycleInputJacobian B1, B2, B3, B4, dk1u, dk2u, dk3u, dk4u;
+    const BicycleStateJacobian I = BicycleStateJacobian::Identity();
+
+    BicycleDerivative(x, u, k1, A1, B1);
+    dk1x = A1;
+    dk1u = B1;
+
+    BicycleDerivative(x + 0.5 * h * k1, u, k2, A2, B2);
+    dk2x.noalias() = A2 * (I + 0.5 * h * dk1x);
+    dk2u.noalias() = A2 * (0.5 * h * dk1u);
+    dk2u += B2;
+
+    BicycleDerivative(x + 0.5 * h * k2, u, k3, A3, B3);
+    dk3x.noalias() = A3 * (I + 0.5 * h * dk2x);
+    dk3u.noalias() = A3 * (0.5 * h * dk2u);
+    dk3u += B3;
+
+    BicycleDerivative(x + h * k3, u, k4, A4, B4);
+    dk4x.noalias() = A4 * (I + h * dk3x);
+    dk4u.noalias() = A4 * (h * dk3u);
+    dk4u += B4;
+
+    x_next = x + (h / 6.0) * (k1 + 2.0 * k2 + 2.0 * k3 + k4);
+    A = I + (h / 6.0) * (dk1x + 2.0 * dk2x + 2.0 * dk3x + dk4x);
+    B = (h / 6.0) * (dk1u + 2.0 * dk2u + 2.0 * dk3u + dk4u);
+}
+
+/*! The bicycle model for RungeKutta4() */
+struct BicycleModel
+{
+    typedef BicycleState State;
+    typedef BicycleInput Input;
+
+    static void Derivative(const State& x, const Input& u, State& dx)
+    {
+        BicycleDerivative(x, u, dx);
+    }
+};
+
+/*! One Runge-Kutta 4 step of length h of a model with fixed-size state and input.
+ *  Model provides the types State and Input and a static Derivative(x, u, dx), which is inlined.
+ */
+template <class Model>
+inline void RungeKutta4(const typename Model::State& x, const typename Model::Input& u, double h,
+                        typename Model::State& x_next)
+{
+    typename Model::State k1, k2, k3, k4;
+    Model::Derivative(x, u, k1);
+    Model::Derivative(x + 0.5 * h * k1, u, k2);
+    Model::Derivative(x + 0.5 * h * k2, u, k3);
+    Model::Derivative(x + h * k3, u, k4);
+    x_next = x + (h / 6.0) * (k1 + 2.0 * k2 + 2.0 * k3 + k4);
+}
+
+/*! steps Runge-Kutta 4 steps of length h */
+template <class Model>
+inline void RungeKutta4(const typename Model::State& x, const typename Model::Input& u, double h, int steps,
+                        typename Model::State& x_next)
+{
+    x_next = x;
+    for (int i = 0; i < steps; i++)
+        RungeKutta4<Model>(x_next, u, h, x_next);
+}
+
+/*! One Runge-Kutta 4 step of length h */
+inline void BicycleIntegrate(const BicycleState& x, const BicycleInput& u, double h, BicycleState& x_next)
+{
+    RungeKutta4<BicycleModel>(x, u, h, x_next);
+}
+
+/*! Exact solution for an input held constant over h: the car drives on a circular arc.
+ *  The yaw rate w is constant, so psi grows linearly and the position follows from
+ *  sin(a + w h) - sin(a) = 2 cos(a + w h / 2) sin(w h / 2); written with sin(z) / z it
+ *  holds for straight driving as well.
+ */
+inline void BicycleArc(const BicycleState& x, const BicycleInput& u, double h, BicycleState& x_next)
+{
+    const double w = (u(0) / (lf + lr)) * tan(u(1));
+    const double half = 0.5 * w * h;
+    const double sinc = (fabs(half) < 1e-4) ? 1.0 - half * half / 6.0 : sin(half) / half;
+    const double beta = x(2) + (lf / l) * u(1) + half;
+    const double s = u(0) * h * sinc;
+
+    x_next(0) = x(0) + s * cos(beta);
+    x_next(1) = x(1) + s * sin(beta);
+    x_next(2) = x(2) + w * h;
+}
+
+/*! BicycleArc together with A = dx_next/dx, the heading only turns the arc */
+inline void BicycleArc(const BicycleState& x, const BicycleInput& u, double h, BicycleState& x_next,
+                       BicycleStateJacobian& A)
+{
+    BicycleArc(x, u, h, x_next);
+    A << 1, 0, -(x_next(1) - x(1)),
+         0, 1,   x_next(0) - x(0),
+         0, 0,   1;
+}
+
+#endif // _BICYCLE_MODEL_H_
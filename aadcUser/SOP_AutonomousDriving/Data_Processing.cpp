@@ -1,51 +1,63 @@
 #include "SOP_AutonomousDriving.h"
+#include "Lane_Reference.h"
+#include "NMPC_Speculation.h"
+#include "Polynomial_Fit.h"
 
 
 
-tResult SOP_AutonomousDriving::CalculateUltrasonicWorldCoordinate(tFloat32 *ult_value)
+// position in cm and beam direction in degree of the sensors in ULTRASONIC order, as in
+// CalculateUltrasonicWorldCoordinate(): a reading d is at (x + d * sin(direction), y + d * cos(direction))
+static const float ultrasonic_mount[ULTRASONIC_MAX_RETURNS][3] =
+{
+    { 26, -10, 150}, { 28,  -5, 120}, { 29,   0,  90}, { 28,   5,  60}, { 26,  10,  30},
+    { 15, -15, 180}, { 15,  15,   0},
+    {-30, -10, 210}, {-30,   0, 270}, {-30,  10, 330}
+};
+
+tResult SOP_AutonomousDriving::CalculateUltrasonicWorldCoordinate(const tFloat32 *ult_value, tFloat32 world_coord[][2])
 {
     float radian = 0;
 
 
     radian = 150 * DEGREES_TO_RADIAN;
-    ult_world_coord[F_LEFT][X] = (ult_value[0] * sin(radian)) + 26; //X is
-    ult_world_coord[F_LEFT][Y] = (ult_value[0] * cos(radian)) - 10; //Y is ->
+    world_coord[F_LEFT][X] = (ult_value[0] * sin(radian)) + 26; //X is
+    world_coord[F_LEFT][Y] = (ult_value[0] * cos(radian)) - 10; //Y is ->
 
     radian = 120 * DEGREES_TO_RADIAN;
-    ult_world_coord[F_CENTER_LEFT][X] = (ult_value[2] * sin(radian)) + 28; //X is
-    ult_world_coord[F_CENTER_LEFT][Y] = (ult_value[2] * cos(radian)) - 5; //Y is ->
+    world_coord[F_CENTER_LEFT][X] = (ult_value[2] * sin(radian)) + 28; //X is
+    world_coord[F_CENTER_LEFT][Y] = (ult_value[2] * cos(radian)) - 5; //Y is ->
 
-    ult_world_coord[F_CENTER][X] = ult_value[4] + 29 ; //X is
-    ult_world_coord[F_CENTER][Y] = 0; //Y is ->
+    world_coord[F_CENTER][X] = ult_value[4] + 29 ; //X is
+    world_coord[F_CENTER][Y] = 0; //Y is ->
 
     radian =60 * DEGREES_TO_RADIAN;
-    ult_world_coord[F_CENTER_RIGHT][X] = (ult_value[6] * sin(radian)) + 28; //X is
-    ult_world_coord[F_CENTER_RIGHT][Y] = (ult_value[6] * cos(radian)) + 5; //Y is ->
+    world_coord[F_CENTER_RIGHT][X] = (ult_value[6] * sin(radian)) + 28; //X is
+    world_coord[F_CENTER_RIGHT][Y] = (ult_value[6] * cos(radian)) + 5; //Y is ->
 
     radian = 30 * DEGREES_TO_RADIAN;
-    ult_world_coord[F_RIGHT][X] = (ult_value[8] * sin(radian)) + 26; //X is
-    ult_world_coord[F_RIGHT][Y] = (ult_value[8] * cos(radian)) + 10; //Y is ->
+    world_coord[F_RIGHT][X] = (ult_value[8] * sin(radian)) + 26; //X is
+    world_coord[F_RIGHT][Y] = (ult_value[8] * cos(radian)) + 10; //Y is ->
 
 
 
-    ult_world_coord[S_LEFT][X] = 15; //X is
-    ult_world_coord[S_LEFT][Y] = -ult_value[10] - 15; //Y is ->
+    world_coord[S_LEFT][X] = 15; //X is
+    world_coord[S_LEFT][Y] = -ult_value[10] - 15; //Y is ->
 
-    ult_world_coord[S_RIGHT][X] = 15; //X is
-    ult_world_coord[S_RIGHT][Y] = ult_value[12] + 15; //Y is ->
+    world_coord[S_RIGHT][X] = 15; //X is
+    world_coord[S_RIGHT][Y] = ult_value[12] + 15; //Y is ->
 
 
 
     radian = 210 * DEGREES_TO_RADIAN;
-    ult_world_coord[R_LEFT][X] = (ult_value[14] * sin(radian)) - 30; //X is
-    ult_world_coord[R_LEFT][Y] = (ult_value[14] * cos(radian)) - 10; //Y is ->
+    world_coord[R_LEFT][X] = (ult_value[14] * sin(radian)) - 30; //X is
+    world_coord[R_LEFT][Y] = (ult_value[14] * cos(radian)) - 10; //Y is ->
 
-    ult_world_coord[R_CENTER][X] = -ult_value[16] - 30; //X is
-    ult_world_coord[R_CENTER][Y] = 0; //Y is ->
+    world_coord[R_CENTER][X] = -ult_value[16] - 30; //X is
+    world_coord[R_CENTER][Y] = 0; //Y is ->
 
     radian = 330 * DEGREES_TO_RADIAN;
-    ult_world_coord[R_RIGHT][X] = (ult_value[18] * sin(radian)) - 30; //X is
-    ult_world_coord[R_RIGHT][Y] = (ult_value[18] * cos(radian)) + 10; //Y is ->
+    world_coord[R_RIGHT][X] = (ult_value[18] * sin(radian)) - 30; //X is
+    world_coord[R_RIGHT][Y] = (ult_value[18] * cos(radian)) + 10; //Y is ->
 
 
 //    LOG_INFO(adtf_util::cString::Format("Front L to R: x:%.0f , y:%.0f; x:%.0f , y:%.0f; x:%.0f , y:%.0f; x:%.0f , y:%.0f; x:%.0f , y:%.0f;", ult_world_coord[F_LEFT][X],         ult_world_coord[F_LEFT][Y],
@@ -64,59 +76,125 @@ tResult SOP_AutonomousDriving::CalculateUltrasonicWorldCoordinate(tFloat32 *ult_
     RETURN_NOERROR;
 }
 
-tResult SOP_AutonomousDriving::CalculateTrackingPoint(void)
+/* Runs the tracker on every ultrasonic sample in the thread of the pin and publishes the tracks,
+ * so their closing speed follows the sensor rate and not the rate of the state control.
+ */
+tResult SOP_AutonomousDriving::TrackUltrasonicObstacles(const ULTRASONIC_INPUT& sample, tTimeStamp time)
 {
-#define BREAK_ERROR 0.3
-    //Draw Tracking Point
-    int index = 0;
+    tFloat32 world_coord[ULTRASONIC_MAX_RETURNS][2];
+    bool valid[ULTRASONIC_MAX_RETURNS];
 
-    float distance = 0;
-    float lane_ref_distance = 0;
-    float error = 0;
-    char loop_flag = 1;
+    CalculateUltrasonicWorldCoordinate(sample.value, world_coord);
+    for(int index = 0; index < ULTRASONIC_MAX_RETURNS; index++)
+        valid[index] = sample.value[2 * index] > 0 && sample.value[2 * index] < ultrasonic_max_range;
 
+    ultrasonic_tracker.Update(world_coord, valid, ULTRASONIC_MAX_RETURNS, time / 1000000.0);
+    ultrasonic_track_sample.Write(ultrasonic_tracker.GetTracks(), time);
 
-    if(reference_value[0] == LTRACE || reference_value[0] == SL_TRACE)
-    {
-        lane_ref_distance =  ((0.5 * 100) * DT);   // m/s -> cm/s * DT
+    RETURN_NOERROR;
+}
 
-#if(CAMERA_DISTANCE == 0)
-        ref_lane_coord_in_image.X[0] = 1;
-#else
-        ref_lane_coord_in_image.X[0] = CAMERA_DISTANCE;
-#endif
-        ref_lane_coord_in_image.Y[0] = (reference_value[1] * (ref_lane_coord_in_image.X[index] * ref_lane_coord_in_image.X[index])) + (ref_lane_coord_in_image.X[index] * reference_value[2]) + reference_value[3];
-        index = 1;
-        ref_lane_coord_in_image.X[index] = ref_lane_coord_in_image.X[0];
+/* Nearest confirmed track of the front sensors in the path of the car (the corridor of
+ * ObstacleDetection()), NULL if there is none closer than max_distance cm.
+ */
+const ULTRASONIC_TRACK* SOP_AutonomousDriving::FrontTrack(float max_distance) const
+{
+    const ULTRASONIC_TRACK *front = NULL;
+    const ULTRASONIC_TRACK_LIST& tracks = vehicle_state.tracks;
 
-        while(loop_flag == 1)
-        {
-            ref_lane_coord_in_image.Y[index] = (reference_value[1] * (ref_lane_coord_in_image.X[index] * ref_lane_coord_in_image.X[index])) + (ref_lane_coord_in_image.X[index] * reference_value[2]) + reference_value[3];
+    for(int index = 0; index < tracks.count; index++)
+    {
+        const ULTRASONIC_TRACK& track = tracks.track[index];
+        if(!track.confirmed || track.sensor > F_RIGHT || track.x >= max_distance)
+            continue;
+
+        float car_collision_y_range = (car_curve_a * (track.x * track.x)) + (track.x * car_curve_b);
+        if(fabs(track.y - car_collision_y_range) >= (35/2))
+            continue;
+        if(front == NULL || track.x < front->x)
+            front = &track;
+    }
+    return front;
+}
 
+/* Moves the occupancy grid by the distance driven since the sample before along the heading of the
+ * position and adds the ray of every sensor. A sensor without an echo clears its beam up to the
+ * maximum range. Runs in the thread of the ultrasonic pin.
+ */
+tResult SOP_AutonomousDriving::UpdateOccupancyGrid(const ULTRASONIC_INPUT& sample)
+{
+    CAR_POSITION_STRUCT position;
+    tFloat32 distance = 0;
+    tFloat32 speed = 0;
+    tFloat32 heading = 0;
+    if(position_sample.Read(&position) != 0)
+        heading = position.HeadingAngle;
+    distance_sample.Read(&distance);
+    wheel_speed_sample.Read(&speed);
+
+    if(odometry_started == tTrue)
+    {
+        // distance_overall counts backwards driving up as well
+        double delta = (distance - odometry_distance) * 100;
+        if(speed < 0)
+            delta = -delta;
+        odometry_x += delta * cos(heading);
+        odometry_y += delta * sin(heading);
+    }
+    odometry_started = tTrue;
+    odometry_distance = distance;
 
-            distance = GetDistanceBetweenCoordinates(ref_lane_coord_in_image.X[index], ref_lane_coord_in_image.Y[index] , ref_lane_coord_in_image.X[index - 1], ref_lane_coord_in_image.Y[index - 1]);
+    __synchronized_obj(m_critSecUltrasonicData);
+    occupancy_grid.SetPose(odometry_x, odometry_y, heading);
+    for(int index = 0; index < ULTRASONIC_MAX_RETURNS; index++)
+    {
+        float value = sample.value[2 * index];
+        if(value <= 0)
+            continue;
+
+        tBool hit = value < ultrasonic_max_range;
+        if(hit == tFalse)
+            value = static_cast<float>(ultrasonic_max_range);
+        float radian = ultrasonic_mount[index][2] * DEGREES_TO_RADIAN;
+        occupancy_grid.AddRay(ultrasonic_mount[index][X], ultrasonic_mount[index][Y],
+                              ultrasonic_mount[index][X] + value * sin(radian), ultrasonic_mount[index][Y] + value * cos(radian), hit == tTrue);
+    }
 
-            ref_lane_coord_in_image.X[index] += 0.3;
+    RETURN_NOERROR;
+}
 
-            error = distance -  lane_ref_distance;
+/* Free distance in cm along the beam of a sensor, from the occupancy grid or the last reading */
+tFloat32 SOP_AutonomousDriving::UltrasonicFreeDistance(int sensor)
+{
+    if(occupancy_grid_enabled == tFalse)
+        return ultrasonic_value[2 * sensor];
 
-            if(error > BREAK_ERROR)
-            {
-                index++;
-                if(index > N+1)
-                    loop_flag = 0;
-                else
-                    ref_lane_coord_in_image.X[index] = ref_lane_coord_in_image.X[index - 1];
-            }
+    __synchronized_obj(m_critSecUltrasonicData);
+    return occupancy_grid.FreeDistance(ultrasonic_mount[sensor][X], ultrasonic_mount[sensor][Y],
+                                       ultrasonic_mount[sensor][2] * DEGREES_TO_RADIAN, static_cast<float>(ultrasonic_max_range));
+}
 
-        }
+/* Whether the grid has an occupied cell in the box of the car frame in cm */
+tBool SOP_AutonomousDriving::IsSideOccupied(float x_min, float x_max, float y_min, float y_max)
+{
+    __synchronized_obj(m_critSecUltrasonicData);
+    return occupancy_grid.IsOccupied(x_min, x_max, y_min, y_max) ? tTrue : tFalse;
+}
 
-        for(index = 0; index <= N; index++)
-        {
-            ref_lane_world_coord.X[index] = ref_lane_coord_in_image.X[index] * 0.01;  //cm to meter
-            ref_lane_world_coord.Y[index] = -ref_lane_coord_in_image.Y[index] * 0.01;
-        }
+tResult SOP_AutonomousDriving::CalculateTrackingPoint(void)
+{
+    //Draw Tracking Point
+    if(reference_value[0] == LTRACE || reference_value[0] == SL_TRACE)
+    {
+        ref_lane_coefficients[0] = reference_value[1];
+        ref_lane_coefficients[1] = reference_value[2];
+        ref_lane_coefficients[2] = reference_value[3];
 
+#if(CAMERA_DISTANCE == 0)
+        SampleLaneReference(ref_lane_coefficients, 1, &ref_lane_coord_in_image, &ref_lane_world_coord);
+#else
+        SampleLaneReference(ref_lane_coefficients, CAMERA_DISTANCE, &ref_lane_coord_in_image, &ref_lane_world_coord);
+#endif
     }
 
     RETURN_NOERROR;
@@ -135,671 +213,551 @@ Global coordinates are used here. The origin point comes from estimated position
 Reference trajectories are calculated using Bezier curve with four points （https://en.wikipedia.org/wiki/B%C3%A9zier_curve）:
 B(t) = P1*(1-t)^3 + P2*(1-t)^2*t + P3*(1-t)*t^2 + P4*t^3， where 0<=t<=1
 The steps to construct reference trajectories are stated as follows:
-Step 1: In the first round (i.e., (turn_around_reference_counter == 0) ), defined the entire reference trajectories depending on difference cases
-Step 2: In each round (roundIdx), give N points to ref_lane_world_coord.X & ref_lane_world_coord.Y
+Step 1: In the first round (i.e., (turn_around_reference_counter == 0) ), place the entire reference trajectory of the maneuver library (built in Start()) at the car
+Step 2: In each round (roundIdx), give the points of the window to ref_lane_world_coord.X & ref_lane_world_coord.Y (WriteManeuverWindow)
 */
 tResult SOP_AutonomousDriving::CalculateTurnAroundReferencePoint(char status_flag, int roundIdx)
 {
-    int index = 0;
-    double tt = 0;
-    int indexout = 0;
-    float temp_x = 0;
-    float temp_y = 0;
-
-
     switch (status_flag)
     {
 
     case AVOIDANCE:
 
-#ifdef AUTO_A
-        if (avoidance.comeback_flag == 0)
-        {
-            pt1[X] = 0   ; pt1[Y]=0;
-            pt2[X] = 0.5 ; pt2[Y]=0;
-            pt3[X] = 0.5; pt3[Y]=0.46;
-            pt4[X] = 1.0; pt4[Y]=0.46;
-        }
-        else if (avoidance.comeback_flag == 2)
-        {
-            pt1[X] = 0   ; pt1[Y]=0;
-            pt2[X] = 0.75 ; pt2[Y]=0;
-            pt3[X] = 0.75; pt3[Y]=-0.44;
-            pt4[X] = 1.5; pt4[Y]=-0.44;
-        }
-#else
-        if (avoidance.comeback_flag == 0)
-        {
-            pt1[X] = 0   ; pt1[Y]=0;
-            pt2[X] = 0.5 ; pt2[Y]=0;
-            pt3[X] = 0.5; pt3[Y]=0.46;
-            pt4[X] = 1.0; pt4[Y]=0.46;
-        }
-        else if (avoidance.comeback_flag == 2)
-        {
-            pt1[X] = 0   ; pt1[Y]=0;
-            pt2[X] = 0.25 ; pt2[Y]=0;
-            pt3[X] = 0.75; pt3[Y]=-0.42;
-            pt4[X] = 1; pt4[Y]=-0.42;
-        }
-#endif
-
-
-
         // bezier curve Calculate
         if(turn_around_reference_counter == 0) //turn_around_reference_counter: round counter
         {
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
-
-            for(index = 0; index < 2*N; index++)
-            {
-                tt = (index+1)/(double)(2*N);
-
-                avoidance_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];
-                avoidance_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];
-
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate 1 %d  X=%f  Y=%f  ",index, avoidance_ref_coord.X[index], avoidance_ref_coord.Y[index]));
-#endif
-
-            }
-            for(index = 2*N; index < 3*N; index++)
-            {
-                avoidance_ref_coord.X[index] = avoidance_ref_coord.X[index-1]+0.5;
-                avoidance_ref_coord.Y[index] = pt4[Y];
-            }
-
-            // rotate and shift the reference trajectory to new coordinates
-            for(index = 0; index < 3*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * avoidance_ref_coord.X[index]) - (sin(temp_HeadingAngle) * avoidance_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * avoidance_ref_coord.X[index]) + (cos(temp_HeadingAngle) * avoidance_ref_coord.Y[index]) + car_est_position.Y_Position;
-                avoidance_ref_coord.X[index] = temp_x;
-                avoidance_ref_coord.Y[index] = temp_y;
-
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, avoidance_ref_coord.X[index], avoidance_ref_coord.Y[index]));
-#endif
-
-            }
-
+            temp_HeadingAngle = RoadQuadrantHeading(car_est_position.HeadingAngle);
+            PlaceLibraryReference((avoidance.comeback_flag == 2) ? MANEUVER_REFERENCE_AVOIDANCE_BACK : MANEUVER_REFERENCE_AVOIDANCE_OUT,
+                                  &avoidance_ref_coord, 0);
         }
 
         // write reference point
-        for(index = 0; index < N; index++)
-        {
-
-            indexout = roundIdx+index ;
-
-            ref_lane_world_coord.X[index] = avoidance_ref_coord.X[indexout];
-            ref_lane_world_coord.Y[index] = avoidance_ref_coord.Y[indexout];
-
-
-        }
+        WriteManeuverWindow(&avoidance_ref_coord, maneuver_library[(avoidance.comeback_flag == 2) ? MANEUVER_REFERENCE_AVOIDANCE_BACK : MANEUVER_REFERENCE_AVOIDANCE_OUT].size, roundIdx);
 
         break;
-        /* Turn left includes
-     * 3*N points with Bezier curve
-     * 1*N points with prolonged straight line
-    */
+        /* Turn left, turn right and straight, see ManeuverLocalReference() */
     case TURN_LEFT:
 
-#ifdef AUTO_A
-        pt1[X] = 0   ; pt1[Y]=0;
-        pt2[X] = 0.8 ; pt2[Y]=0;
-        pt3[X] = 1.20; pt3[Y]=0.3;
-        pt4[X] = 1.20; pt4[Y]=1.1;
-#else
-        pt1[X] = 0   ; pt1[Y]=0;
-        pt2[X] = 0.95 ; pt2[Y]=0;
-        pt3[X] = 1.20; pt3[Y]=0.3;
-        pt4[X] = 1.20; pt4[Y]=1.1;
-#endif
-
         // bezier curve Calculate
         if(turn_around_reference_counter == 0) //turn_around_reference_counter: round counter
-        {
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
-
-            for(index = 0; index < 3*N; index++)
-            {
-                tt = (index+1)/(double)(3*N);
-
-                turn_left_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];
-                turn_left_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];
-
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate 1 %d  X=%f  Y=%f ",index, turn_left_ref_coord.X[index], turn_left_ref_coord.Y[index]));
-#endif
-
-            }
-            for(index = 3*N; index < 4*N; index++)
-            {
-                turn_left_ref_coord.X[index] = pt4[X];
-                turn_left_ref_coord.Y[index] = turn_left_ref_coord.Y[index-1] + 0.01;
-                //LOG_INFO(adtf_util::cString::Format("Index %d Coordinate  X= %f  Y= %f  ",index, turn_left_ref_coord.X[index], turn_left_ref_coord.Y[index]));
-            }
-
-            for(index = 0; index < 4*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * turn_left_ref_coord.X[index]) - (sin(temp_HeadingAngle) * turn_left_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * turn_left_ref_coord.X[index]) + (cos(temp_HeadingAngle) * turn_left_ref_coord.Y[index]) + car_est_position.Y_Position;
-                turn_left_ref_coord.X[index] = temp_x;
-                turn_left_ref_coord.Y[index] = temp_y;
-
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate 2 %d  X=%f  Y=%f ",index, turn_left_ref_coord.X[index], turn_left_ref_coord.Y[index]));
-#endif
-
-            }
-
-        }
+            PlaceManeuverReference(TURN_LEFT, &turn_left_ref_coord);
 
         // write reference point
-        for(index = 0; index < N; index++)
-        {
-
-            indexout = roundIdx+index ;
-
-            ref_lane_world_coord.X[index] = turn_left_ref_coord.X[indexout];
-            ref_lane_world_coord.Y[index] = turn_left_ref_coord.Y[indexout];
-
-
-        }
+        WriteManeuverWindow(&turn_left_ref_coord, maneuver_library[MANEUVER_REFERENCE_TURN_LEFT].size, roundIdx);
         //            for(int i =0; i< N; i++)
         //                LOG_INFO(adtf_util::cString::Format("Ref %d X Y: %g   %g",i, ref_lane_world_coord.X[i], ref_lane_world_coord.Y[i]));
         //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
         break;
 
-        /* Turn right includes
-         * N points with Bezier curve
-         * N points with prolonged straight line
-        */
     case TURN_RIGHT:
 
-
-#ifdef AUTO_A
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0.4; pt2[Y]=0;
-        pt3[X] = 0.64; pt3[Y]=-0.3;
-        pt4[X] = 0.64; pt4[Y]=-0.8;
-#else
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0.5; pt2[Y]=0;
-        pt3[X] = 0.65; pt3[Y]=-0.3;
-        pt4[X] = 0.65; pt4[Y]=-0.8;
-#endif
-
         // bezier curve Calculate
         if(turn_around_reference_counter == 0)
-        {
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
-
-            for(index = 0; index < 2*N; index++)
-            {
-                tt = (index+1)/(double)(2*N);
-                turn_right_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];
-                turn_right_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];
-
-
-            }
-            for(index = 2*N; index < 3*N; index++)
-            {
-                //turn_right_ref_coord.X[index] = 0.80+car_est_position.X_Position;
-                turn_right_ref_coord.X[index] = pt4[X];
-                turn_right_ref_coord.Y[index] = turn_right_ref_coord.Y[index-1] - 0.01;
-
-            };
-
-            // rotate and shift the reference trajectory to new coordinates
-            for(index = 0; index < 3*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * turn_right_ref_coord.X[index]) - (sin(temp_HeadingAngle) * turn_right_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * turn_right_ref_coord.X[index]) + (cos(temp_HeadingAngle) * turn_right_ref_coord.Y[index]) + car_est_position.Y_Position;
-                turn_right_ref_coord.X[index] = temp_x;
-                turn_right_ref_coord.Y[index] = temp_y;
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, turn_right_ref_coord.X[index], turn_right_ref_coord.Y[index]));
-#endif
-            }
-        }
+            PlaceManeuverReference(TURN_RIGHT, &turn_right_ref_coord);
 
         // write reference point
-        for(index = 0; index < N; index++)
-        {
-            indexout = roundIdx+index ;
-
-            ref_lane_world_coord.X[index] = turn_right_ref_coord.X[indexout];  //cm to meter
-            ref_lane_world_coord.Y[index] = turn_right_ref_coord.Y[indexout];
-        }
+        WriteManeuverWindow(&turn_right_ref_coord, maneuver_library[MANEUVER_REFERENCE_TURN_RIGHT].size, roundIdx);
         break;
 
     case STRAIGHT:
 
-#ifdef AUTO_A
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0.3; pt2[Y]=0;
-        pt3[X] = 0.65; pt3[Y]=0;
-        pt4[X] = 2; pt4[Y]=0;
-#else
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0.3; pt2[Y]=0;
-        pt3[X] = 0.65; pt3[Y]=0;
-        pt4[X] = 2; pt4[Y]=0;
-#endif
-
         // bezier curve Calculate
         if(turn_around_reference_counter == 0)
-        {
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
-
-                        LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-                        LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-            for(index = 0; index < 5*N; index++)
-            {
-                tt = (index+1)/(double)(5*N);
-                straight_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];
-                straight_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];
-
-
-            }
-
-
-            // rotate and shift the reference trajectory to new coordinates
-            for(index = 0; index < 5*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * straight_ref_coord.X[index]) - (sin(temp_HeadingAngle) * straight_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * straight_ref_coord.X[index]) + (cos(temp_HeadingAngle) * straight_ref_coord.Y[index]) + car_est_position.Y_Position;
-                straight_ref_coord.X[index] = temp_x;
-                straight_ref_coord.Y[index] = temp_y;
-//#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, straight_ref_coord.X[index], straight_ref_coord.Y[index]));
-//#endif
-            }
-        }
+            PlaceManeuverReference(STRAIGHT, &straight_ref_coord);
 
         // write reference point
-        for(index = 0; index < N; index++)
-        {
-            indexout = roundIdx+index ;
-
-            ref_lane_world_coord.X[index] = straight_ref_coord.X[indexout];  //cm to meter
-            ref_lane_world_coord.Y[index] = straight_ref_coord.Y[indexout];
-        }
+        WriteManeuverWindow(&straight_ref_coord, maneuver_library[MANEUVER_REFERENCE_STRAIGHT].size, roundIdx);
         break;
 
-        /* Pullout left includes
-         * 3*N points with Bezier curve
-         * 2*N points with prolonged straight line
-        */
+        /* Pullout left, see ManeuverLibraryReference() */
     case PULL_OUT_LEFT:
 
-#ifdef AUTO_A
-        pt1[X] = 0   ; pt1[Y]=0;
-        pt2[X] = 0.7 ; pt2[Y]=0;
-        pt3[X] = 1.12; pt3[Y]=0.42;
-        pt4[X] = 1.12; pt4[Y]=0.96;
-#else
-        pt1[X] = 0   ; pt1[Y]=0;
-        pt2[X] = 0.7 ; pt2[Y]=0;
-        pt3[X] = 1.12; pt3[Y]=0.42;
-        pt4[X] = 1.12; pt4[Y]=0.96;
-#endif
-
         // bezier curve Calculate
         if(turn_around_reference_counter == 0)
         {
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
-
-
-            for(index = 0; index < 3*N; index++)
-            {
-                tt = (index+1)/(double)(3*N);
-                pullout_left_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];
-                pullout_left_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];
-
+            temp_HeadingAngle = RoadQuadrantHeading(car_est_position.HeadingAngle);
+            PlaceLibraryReference(MANEUVER_REFERENCE_PULL_OUT_LEFT, &pullout_left_ref_coord, 0);
+        }
 
-            }
-            for(index = 3*N; index < 4*N; index++)
-            {
-                pullout_left_ref_coord.X[index] = pt4[X];
-                pullout_left_ref_coord.Y[index] = pullout_left_ref_coord.Y[index-1] + 0.02;
-            }
+        // write reference point
+        WriteManeuverWindow(&pullout_left_ref_coord, maneuver_library[MANEUVER_REFERENCE_PULL_OUT_LEFT].size, roundIdx);
+        //            for(int i =0; i< N; i++)
+        //                LOG_INFO(adtf_util::cString::Format("Ref %d X Y: %g   %g",i, turn_left_ref_coord.X[i], turn_left_ref_coord.Y[i]));
+        //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
+        break;
 
-            // rotate and shift the reference trajectory to new coordinates
-            for(index = 0; index < 4*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * pullout_left_ref_coord.X[index]) - (sin(temp_HeadingAngle) * pullout_left_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * pullout_left_ref_coord.X[index]) + (cos(temp_HeadingAngle) * pullout_left_ref_coord.Y[index]) + car_est_position.Y_Position;
-                pullout_left_ref_coord.X[index] = temp_x;
-                pullout_left_ref_coord.Y[index] = temp_y;
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, pullout_left_ref_coord.X[index], pullout_left_ref_coord.Y[index]));
-#endif
-            }
+        /* Pullout right, see ManeuverLibraryReference() */
+    case PULL_OUT_RIGHT:
 
+        // bezier curve Calculate
+        if(turn_around_reference_counter == 0)
+        {
+            temp_HeadingAngle = RoadQuadrantHeading(car_est_position.HeadingAngle);
+            PlaceLibraryReference(MANEUVER_REFERENCE_PULL_OUT_RIGHT, &pullout_right_ref_coord, 0);
         }
 
         // write reference point
-        for(index = 0; index < N; index++)
-        {
+        WriteManeuverWindow(&pullout_right_ref_coord, maneuver_library[MANEUVER_REFERENCE_PULL_OUT_RIGHT].size, roundIdx);
+        break;
 
-            indexout = roundIdx+index ;
+        /* Parking, see ManeuverLibraryReference():
+         * the forward part is placed in the first round, the backward part in round 2*N
+         * at the position the car has reached, with the road heading of the first round
+        */
+    case PARKING:
 
-            ref_lane_world_coord.X[index] = pullout_left_ref_coord.X[indexout];
-            ref_lane_world_coord.Y[index] = pullout_left_ref_coord.Y[indexout];
+        // bezier curve Calculate
+        if(turn_around_reference_counter == 0)
+        {
+            temp_HeadingAngle = RoadQuadrantHeading(car_est_position.HeadingAngle);
+            PlaceLibraryReference(MANEUVER_REFERENCE_PARKING_FORWARD, &parking_ref_coord, 0);
+        }
 
+        //Update the backward curve with current position
+        if(turn_around_reference_counter == 2*N)
+            PlaceLibraryReference(MANEUVER_REFERENCE_PARKING_BACKWARD, &parking_ref_coord, 2*N);
 
-        }
+        // write reference point, the backward part is there from round 2*N on
+        WriteManeuverWindow(&parking_ref_coord, (turn_around_reference_counter >= 2*N) ?
+                            2*N + maneuver_library[MANEUVER_REFERENCE_PARKING_BACKWARD].size :
+                            maneuver_library[MANEUVER_REFERENCE_PARKING_FORWARD].size, roundIdx);
         //            for(int i =0; i< N; i++)
         //                LOG_INFO(adtf_util::cString::Format("Ref %d X Y: %g   %g",i, turn_left_ref_coord.X[i], turn_left_ref_coord.Y[i]));
         //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
         break;
 
-        /* Pullout right includes
-         * N points with Bezier curve
-         * N points with prolonged straight line
-        */
-    case PULL_OUT_RIGHT:
+    default:
+        break;
+    }
+    RETURN_NOERROR;
+}
 
-#ifdef AUTO_A
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0.5; pt2[Y]=0;
-        pt3[X] = 0.75; pt3[Y]=-0.5;
-        pt4[X] = 0.75; pt4[Y]=-0.8;
-#else
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0.5; pt2[Y]=0;
-        pt3[X] = 0.75; pt3[Y]=-0.5;
-        pt4[X] = 0.75; pt4[Y]=-0.8;
-#endif
+/* Writes the window of reference starting at point first into ref_lane_world_coord: all NMPC_MAX_HORIZON+1
+ * points a solve may read, whatever its horizon. Past the size points of the maneuver the last one is repeated.
+*/
+void SOP_AutonomousDriving::WriteManeuverWindow(const TURN_AROUND_REFERENCE_COORDINATE *reference, int size, int first)
+{
+    for(int index = 0; index <= NMPC_MAX_HORIZON; index++)
+    {
+        int indexout = (first + index < size) ? first + index : size - 1;
 
-        // bezier curve Calculate
-        if(turn_around_reference_counter == 0)
-        {
+        ref_lane_world_coord.X[index] = reference->X[indexout];
+        ref_lane_world_coord.Y[index] = reference->Y[indexout];
+    }
+}
 
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
+/* Reference trajectories of TURN_LEFT, TURN_RIGHT and STRAIGHT, see ManeuverLibraryReference().
+ * Returns the number of points, 0 for other maneuvers.
+*/
+int SOP_AutonomousDriving::ManeuverLocalReference(int maneuver, TURN_AROUND_REFERENCE_COORDINATE *reference)
+{
+    switch (maneuver)
+    {
+    case TURN_LEFT:
+        return ManeuverLibraryReference(MANEUVER_REFERENCE_TURN_LEFT, reference);
+    case TURN_RIGHT:
+        return ManeuverLibraryReference(MANEUVER_REFERENCE_TURN_RIGHT, reference);
+    case STRAIGHT:
+        return ManeuverLibraryReference(MANEUVER_REFERENCE_STRAIGHT, reference);
+    default:
+        return 0;
+    }
+}
 
+/* Reference trajectories of the maneuvers in the frame of the car at the start of the maneuver,
+ * already turned to the road (x along the road, y to the left):
+ * Turn left includes 3*N points with Bezier curve and 1*N points with prolonged straight line
+ * Turn right includes 2*N points with Bezier curve and 1*N points with prolonged straight line
+ * Straight includes 5*N points with Bezier curve
+ * Pullout left and right include 3*N points with Bezier curve and 1*N points with prolonged straight line
+ * Avoidance includes 2*N points with Bezier curve and 1*N points with prolonged straight line
+ * Parking forward includes N points with Bezier curve and N points with the connecting point
+ * Parking backward includes 3*N points with Bezier curve (continued past its end point) and N points
+ * with the terminate point, in the frame of the car at the connecting point
+ * Returns the number of points.
+*/
+int SOP_AutonomousDriving::ManeuverLibraryReference(int entry, TURN_AROUND_REFERENCE_COORDINATE *reference)
+{
+    int index = 0;
+    int bezier_points = 0;
+    int bezier_divisor = 0;
+    int size = 0;
+    float step_x = 0;
+    float step_y = 0;
+    double tt = 0;
+    double pt[4][2];
 
-            for(index = 0; index < 3*N; index++)
-            {
-                tt = (index+1)/(double)(3*N);
-                pullout_right_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];
-                pullout_right_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];
-            }
-            for(index = 3*N; index < 4*N; index++)
-            {
-                pullout_right_ref_coord.X[index] = pt4[X];
-                pullout_right_ref_coord.Y[index] = pullout_right_ref_coord.Y[index-1] - 0.01;
-            }
+    switch (entry)
+    {
+    case MANEUVER_REFERENCE_TURN_LEFT:
+#ifdef AUTO_A
+        pt[0][X] = 0   ; pt[0][Y]=0;
+        pt[1][X] = 0.8 ; pt[1][Y]=0;
+        pt[2][X] = 1.20; pt[2][Y]=0.3;
+        pt[3][X] = 1.20; pt[3][Y]=1.1;
+#else
+        pt[0][X] = 0   ; pt[0][Y]=0;
+        pt[1][X] = 0.95 ; pt[1][Y]=0;
+        pt[2][X] = 1.20; pt[2][Y]=0.3;
+        pt[3][X] = 1.20; pt[3][Y]=1.1;
+#endif
+        bezier_points = 3*N;
+        size = 4*N;
+        step_y = 0.01;
+        break;
 
-            // rotate and shift the reference trajectory to new coordinates
-            for(index = 0; index < 4*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * pullout_right_ref_coord.X[index]) - (sin(temp_HeadingAngle) * pullout_right_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * pullout_right_ref_coord.X[index]) + (cos(temp_HeadingAngle) * pullout_right_ref_coord.Y[index]) + car_est_position.Y_Position;
-                pullout_right_ref_coord.X[index] = temp_x;
-                pullout_right_ref_coord.Y[index] = temp_y;
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, pullout_right_ref_coord.X[index], pullout_right_ref_coord.Y[index]));
+    case MANEUVER_REFERENCE_TURN_RIGHT:
+#ifdef AUTO_A
+        pt[0][X] = 0  ; pt[0][Y]=0;
+        pt[1][X] = 0.4; pt[1][Y]=0;
+        pt[2][X] = 0.64; pt[2][Y]=-0.3;
+        pt[3][X] = 0.64; pt[3][Y]=-0.8;
+#else
+        pt[0][X] = 0  ; pt[0][Y]=0;
+        pt[1][X] = 0.5; pt[1][Y]=0;
+        pt[2][X] = 0.65; pt[2][Y]=-0.3;
+        pt[3][X] = 0.65; pt[3][Y]=-0.8;
 #endif
-            }
+        bezier_points = 2*N;
+        size = 3*N;
+        step_y = -0.01;
+        break;
 
-        }
+    case MANEUVER_REFERENCE_STRAIGHT:
+        pt[0][X] = 0  ; pt[0][Y]=0;
+        pt[1][X] = 0.3; pt[1][Y]=0;
+        pt[2][X] = 0.65; pt[2][Y]=0;
+        pt[3][X] = 2; pt[3][Y]=0;
+        bezier_points = 5*N;
+        size = 5*N;
+        break;
 
-        // write reference point
-        for(index = 0; index < N; index++)
-        {
-            indexout = roundIdx+index ;
+    case MANEUVER_REFERENCE_PULL_OUT_LEFT:
+        pt[0][X] = 0   ; pt[0][Y]=0;
+        pt[1][X] = 0.7 ; pt[1][Y]=0;
+        pt[2][X] = 1.12; pt[2][Y]=0.42;
+        pt[3][X] = 1.12; pt[3][Y]=0.96;
+        bezier_points = 3*N;
+        size = 4*N;
+        step_y = 0.02;
+        break;
 
-            ref_lane_world_coord.X[index] = pullout_right_ref_coord.X[indexout];  //cm to meter
-            ref_lane_world_coord.Y[index] = pullout_right_ref_coord.Y[indexout];
-        }
+    case MANEUVER_REFERENCE_PULL_OUT_RIGHT:
+        pt[0][X] = 0  ; pt[0][Y]=0;
+        pt[1][X] = 0.5; pt[1][Y]=0;
+        pt[2][X] = 0.75; pt[2][Y]=-0.5;
+        pt[3][X] = 0.75; pt[3][Y]=-0.8;
+        bezier_points = 3*N;
+        size = 4*N;
+        step_y = -0.01;
         break;
 
-        /* Parking includes
-         * 4*N points with Bezier curve (forward part)
-         * N points with connecting point
-         * 4*N points with Bezier curve (backward part)
-         * N points with terminate point
-        */
-    case PARKING:
+    case MANEUVER_REFERENCE_AVOIDANCE_OUT:
+        pt[0][X] = 0   ; pt[0][Y]=0;
+        pt[1][X] = 0.5 ; pt[1][Y]=0;
+        pt[2][X] = 0.5; pt[2][Y]=0.46;
+        pt[3][X] = 1.0; pt[3][Y]=0.46;
+        bezier_points = 2*N;
+        size = 3*N;
+        step_x = 0.5;
+        break;
 
+    case MANEUVER_REFERENCE_AVOIDANCE_BACK:
 #ifdef AUTO_A
-        pt1[X] = 0  ; pt1[Y]=0;
-        pt2[X] = 0; pt2[Y]=0;
-        pt3[X] = 0.1; pt3[Y]=0;
-        pt4[X] = 0.5; pt4[Y]=0.36;
-
-        pt5[X] = 0    ; pt5[Y]=0   ;
-        pt6[X] = -0.60; pt6[Y]=0;
-        pt7[X] = -0.68; pt7[Y]=-0.30;
-        pt8[X] = -0.68; pt8[Y]=-1.50;
+        pt[0][X] = 0   ; pt[0][Y]=0;
+        pt[1][X] = 0.75 ; pt[1][Y]=0;
+        pt[2][X] = 0.75; pt[2][Y]=-0.44;
+        pt[3][X] = 1.5; pt[3][Y]=-0.44;
 #else
+        pt[0][X] = 0   ; pt[0][Y]=0;
+        pt[1][X] = 0.25 ; pt[1][Y]=0;
+        pt[2][X] = 0.75; pt[2][Y]=-0.42;
+        pt[3][X] = 1; pt[3][Y]=-0.42;
+#endif
+        bezier_points = 2*N;
+        size = 3*N;
+        step_x = 0.5;
+        break;
 
-                    pt1[0] = 0; pt1[1]=0;
-                    pt2[0] = 0.2; pt2[1]=0;
-                    pt3[0] = 0.4; pt3[1]=0.15;
-                    pt4[0] = 0.4; pt4[1]=0.33;
+    case MANEUVER_REFERENCE_PARKING_FORWARD:
+#ifdef AUTO_A
+        pt[0][X] = 0  ; pt[0][Y]=0;
+        pt[1][X] = 0; pt[1][Y]=0;
+        pt[2][X] = 0.1; pt[2][Y]=0;
+        pt[3][X] = 0.5; pt[3][Y]=0.36;
+#else
+        pt[0][X] = 0; pt[0][Y]=0;
+        pt[1][X] = 0.2; pt[1][Y]=0;
+        pt[2][X] = 0.4; pt[2][Y]=0.15;
+        pt[3][X] = 0.4; pt[3][Y]=0.33;
+#endif
+        bezier_points = N;
+        size = 2*N;
+        break;
 
-                    pt5[0] = 0; pt5[1]=0;
-                    pt6[0] = -0.15; pt6[1]=0;
-                    pt7[0] = -0.26; pt7[1]=-0.4;
-                    pt8[0] = -0.30; pt8[1]=-1.2;
+    case MANEUVER_REFERENCE_PARKING_BACKWARD:
+#ifdef AUTO_A
+        pt[0][X] = 0    ; pt[0][Y]=0   ;
+        pt[1][X] = -0.60; pt[1][Y]=0;
+        pt[2][X] = -0.68; pt[2][Y]=-0.30;
+        pt[3][X] = -0.68; pt[3][Y]=-1.50;
+#else
+        pt[0][X] = 0; pt[0][Y]=0;
+        pt[1][X] = -0.15; pt[1][Y]=0;
+        pt[2][X] = -0.26; pt[2][Y]=-0.4;
+        pt[3][X] = -0.30; pt[3][Y]=-1.2;
 #endif
+        bezier_points = 3*N;
+        bezier_divisor = 2*N;
+        size = 4*N;
+        break;
 
-        // bezier curve Calculate
-        if(turn_around_reference_counter == 0)
-        {
-            temp_HeadingAngle = car_est_position.HeadingAngle;
-            if (car_est_position.HeadingAngle >= -PI/4 && car_est_position.HeadingAngle <= PI/4 )
-                temp_HeadingAngle = 0;
-            else if (car_est_position.HeadingAngle >= PI/4 && car_est_position.HeadingAngle <= 3*PI/4 )
-                temp_HeadingAngle = PI/2;
-            else if (car_est_position.HeadingAngle >= -3*PI/4  && car_est_position.HeadingAngle <= -PI/4 )
-                temp_HeadingAngle = -PI/2;
-            else
-                temp_HeadingAngle = PI;
-
-            for(index = 0; index < N; index++)
-            {
-                tt = (index+1)/(double)(N);
-                parking_ref_coord.X[index] = pow((1-tt), 3)*pt1[X] + 3*pow((1-tt), 2)*tt*pt2[X] + 3*pow(tt, 2)*(1-tt)*pt3[X]+pow(tt, 3)*pt4[X];//car_est_position.X_Position;
-                parking_ref_coord.Y[index] = pow((1-tt), 3)*pt1[Y] + 3*pow((1-tt), 2)*tt*pt2[Y] + 3*pow(tt, 2)*(1-tt)*pt3[Y]+pow(tt, 3)*pt4[Y];//car_est_position.Y_Position;
-            }
+    default:
+        return 0;
+    }
 
-            for(index = N; index < 2*N; index++)
-            {
-                parking_ref_coord.X[index] = pt4[X];//pt4[X];//+car_est_position.X_Position;
-                parking_ref_coord.Y[index] = pt4[Y];//pt4[Y];//+car_est_position.Y_Position;
-                // LOG_INFO(adtf_util::cString::Format("ORiginal Coordinate 1 %d  X=%f  Y=%f  ",index, parking_ref_coord.X[index], parking_ref_coord.Y[index]));
+    if(bezier_divisor == 0)
+        bezier_divisor = bezier_points;
 
-            }
+    for(index = 0; index < bezier_points; index++)
+    {
+        tt = (index+1)/(double)(bezier_divisor);
+        reference->X[index] = pow((1-tt), 3)*pt[0][X] + 3*pow((1-tt), 2)*tt*pt[1][X] + 3*pow(tt, 2)*(1-tt)*pt[2][X]+pow(tt, 3)*pt[3][X];
+        reference->Y[index] = pow((1-tt), 3)*pt[0][Y] + 3*pow((1-tt), 2)*tt*pt[1][Y] + 3*pow(tt, 2)*(1-tt)*pt[2][Y]+pow(tt, 3)*pt[3][Y];
+    }
+    // prolonged from the end point of the curve
+    for(index = bezier_points; index < size; index++)
+    {
+        reference->X[index] = pt[3][X] + (index - bezier_points + 1) * step_x;
+        reference->Y[index] = pt[3][Y] + (index - bezier_points + 1) * step_y;
+    }
 
-            //            // rotate and shift the reference trajectory to new coordinates
-            //            for (index=0;index<4*N;index++)
-            //            {
-            //                //LOG_INFO(adtf_util::cString::Format("Ref %d X Y: %g   %g",index, parking_ref_coord.X[index]+car_est_position.X_Position, parking_ref_coord.Y[index]+car_est_position.Y_Position));
-            //            }
-            // rotate and shift the reference trajectory to new coordinates
-            for(index = 0; index < 2*N; index++)
-            {
-                //LOG_INFO(adtf_util::cString::Format("ORiginal Coordinate 2 %d  X=%f  Y=%f  ",index, parking_ref_coord.X[index], parking_ref_coord.Y[index]));
-                temp_x = (cos(temp_HeadingAngle) * parking_ref_coord.X[index]) - (sin(temp_HeadingAngle) * parking_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * parking_ref_coord.X[index]) + (cos(temp_HeadingAngle) * parking_ref_coord.Y[index]) + car_est_position.Y_Position;
-                parking_ref_coord.X[index] = temp_x;
-                parking_ref_coord.Y[index] = temp_y;
-#ifdef OUTPUT_BEZIER_CURVE_DEBUG
-                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, parking_ref_coord.X[index], parking_ref_coord.Y[index]));
-#endif
-            }
+    // arc length, the car starts at the origin
+    reference->S[0] = sqrt(reference->X[0]*reference->X[0] + reference->Y[0]*reference->Y[0]);
+    for(index = 1; index < size; index++)
+    {
+        float dx = reference->X[index] - reference->X[index-1];
+        float dy = reference->Y[index] - reference->Y[index-1];
+        reference->S[index] = reference->S[index-1] + sqrt(dx*dx + dy*dy);
+    }
 
+    return size;
+}
 
-        }
+/* Builds every entry of the maneuver library for the four road headings. Called once in Start(),
+ * the first round of a maneuver then only shifts an entry to the car (PlaceLibraryReference).
+*/
+void SOP_AutonomousDriving::BuildManeuverLibrary(void)
+{
+    TURN_AROUND_REFERENCE_COORDINATE local;
+    double temp_x = 0;
+    double temp_y = 0;
 
-        //Update the backward curve with current position
-        if(turn_around_reference_counter == 2*N)
+    for(int entry = 0; entry < MANEUVER_REFERENCE_COUNT; entry++)
+    {
+        maneuver_library[entry].size = ManeuverLibraryReference(entry, &local);
+        for(int quadrant = 0; quadrant < 4; quadrant++)
         {
-//            LOG_INFO(adtf_util::cString::Format("Temp heading %g  ",temp_HeadingAngle));
-
-            for(index = 2*N; index < 5*N; index++)
+            for(int index = 0; index < maneuver_library[entry].size; index++)
             {
-                tt = (index-2*N+1)/(double)(2*N);
-                parking_ref_coord.X[index] = pow((1-tt), 3)*pt5[X] + 3*pow((1-tt), 2)*tt*pt6[X] + 3*pow(tt, 2)*(1-tt)*pt7[X]+pow(tt, 3)*pt8[X];//+car_est_position.X_Position;
-                parking_ref_coord.Y[index] = pow((1-tt), 3)*pt5[Y] + 3*pow((1-tt), 2)*tt*pt6[Y] + 3*pow(tt, 2)*(1-tt)*pt7[Y]+pow(tt, 3)*pt8[Y];//+car_est_position.Y_Position;
+                RotateToQuadrant(quadrant, local.X[index], local.Y[index], &temp_x, &temp_y);
+                maneuver_library[entry].quadrant[quadrant].X[index] = temp_x;
+                maneuver_library[entry].quadrant[quadrant].Y[index] = temp_y;
+                maneuver_library[entry].quadrant[quadrant].S[index] = local.S[index];
             }
+        }
+    }
+}
 
-            for(index = 5*N; index < 6*N; index++)
-            {
-                parking_ref_coord.X[index] = pt8[X];//+car_est_position.X_Position;
-                parking_ref_coord.Y[index] = pt8[Y];//+car_est_position.Y_Position;
+/* Writes entry of the maneuver library turned to temp_HeadingAngle and shifted to car_est_position
+ * into reference from index first on. The arc length continues the one of the points before first,
+ * the first point starts the maneuver at distance_overall. Returns the number of points.
+*/
+int SOP_AutonomousDriving::PlaceLibraryReference(int entry, TURN_AROUND_REFERENCE_COORDINATE *reference, int first)
+{
+    const MANEUVER_LIBRARY_ENTRY *library = &maneuver_library[entry];
+    const TURN_AROUND_REFERENCE_COORDINATE *turned = &library->quadrant[RoadQuadrant(temp_HeadingAngle)];
+    float start = (first > 0) ? reference->S[first - 1] : 0;
 
-            }
-            for(index = 2*N; index < 6*N; index++)
-            {
-                temp_x = (cos(temp_HeadingAngle) * parking_ref_coord.X[index]) - (sin(temp_HeadingAngle) * parking_ref_coord.Y[index]) + car_est_position.X_Position;
-                temp_y = (sin(temp_HeadingAngle) * parking_ref_coord.X[index]) + (cos(temp_HeadingAngle) * parking_ref_coord.Y[index]) + car_est_position.Y_Position;
-                parking_ref_coord.X[index] = temp_x;
-                parking_ref_coord.Y[index] = temp_y;
-//                LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",index, parking_ref_coord.X[index], parking_ref_coord.Y[index]));
-            }
+    if(first == 0)
+        maneuver_start_distance = distance_overall;
 
-        }
+    for(int index = 0; index < library->size; index++)
+    {
+        reference->X[first + index] = turned->X[index] + car_est_position.X_Position;
+        reference->Y[first + index] = turned->Y[index] + car_est_position.Y_Position;
+        reference->S[first + index] = turned->S[index] + start;
+#ifdef OUTPUT_BEZIER_CURVE_DEBUG
+        LOG_INFO(adtf_util::cString::Format("Coordinate%d  X=%f  Y=%f  ",first + index, reference->X[first + index], reference->Y[first + index]));
+#endif
+    }
 
+    return library->size;
+}
 
+/* Number of points of reference the car has passed after travelled along it: binary search for the
+ * first point with a larger arc length
+*/
+int SOP_AutonomousDriving::ReferencePointsPassed(const TURN_AROUND_REFERENCE_COORDINATE *reference, int size, float travelled)
+{
+    int low = 0;
+    int high = size;
 
+    while(low < high)
+    {
+        int middle = (low + high) / 2;
+        if(reference->S[middle] <= travelled)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
 
-        // write reference point
-        for(index = 0; index < N; index++)
-        {
-            indexout = roundIdx+index ;
-            ref_lane_world_coord.X[index] = parking_ref_coord.X[indexout];
-            ref_lane_world_coord.Y[index] = parking_ref_coord.Y[indexout];
+/* First point of the next MPC window of a maneuver: the point the car has reached by distance_overall,
+ * so the window follows the car at any speed and sampling rate. Returns -1 as long as the car has
+ * not passed another point or the window has reached limit - 1.
+*/
+int SOP_AutonomousDriving::NextReferenceWindow(const TURN_AROUND_REFERENCE_COORDINATE *reference, int limit)
+{
+    if(turn_around_reference_counter >= limit)
+        return -1;
 
-        }
-        //            for(int i =0; i< N; i++)
-        //                LOG_INFO(adtf_util::cString::Format("Ref %d X Y: %g   %g",i, turn_left_ref_coord.X[i], turn_left_ref_coord.Y[i]));
-        //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-        break;
+    int passed = ReferencePointsPassed(reference, limit, distance_overall - maneuver_start_distance);
+    if(passed < turn_around_reference_counter)
+        return -1;
+
+    return (passed < limit) ? passed : limit - 1;
+}
 
+/* Road quadrant of the heading: 0, 1, 2 and 3 for the road headings 0, PI/2, PI and -PI/2 */
+int SOP_AutonomousDriving::RoadQuadrant(double heading)
+{
+    if (heading >= -PI/4 && heading <= PI/4 )
+        return 0;
+    else if (heading >= PI/4 && heading <= 3*PI/4 )
+        return 1;
+    else if (heading >= -3*PI/4  && heading <= -PI/4 )
+        return 3;
+    else
+        return 2;
+}
+
+/* Turns (x, y) by the road heading of quadrant, exact for the multiples of PI/2 */
+void SOP_AutonomousDriving::RotateToQuadrant(int quadrant, double x, double y, double *x_out, double *y_out)
+{
+    switch (quadrant)
+    {
+    case 1:
+        *x_out = -y;
+        *y_out = x;
+        break;
+    case 2:
+        *x_out = -x;
+        *y_out = -y;
+        break;
+    case 3:
+        *x_out = y;
+        *y_out = -x;
+        break;
     default:
+        *x_out = x;
+        *y_out = y;
         break;
     }
-    RETURN_NOERROR;
 }
 
-void SOP_AutonomousDriving::CalculateCoefficient(double *answer, double *x, double *y, int size_of_arrays, int degree_of_polynomial)
+/* Heading of the road the car is on: the heading of the car snapped to 0, PI/2, -PI/2 or PI */
+double SOP_AutonomousDriving::RoadQuadrantHeading(double heading)
 {
-    int i,j,k;
-    double X[2 * degree_of_polynomial + 1];                        //Array that will store the values of sigma(xi),sigma(xi^2),sigma(xi^3)....sigma(xi^2n)
-    double B[degree_of_polynomial + 1][degree_of_polynomial + 2];            //B is the Normal matrix(augmented) that will store the equations, 'a' is for value of the final coefficients
-    double Y[degree_of_polynomial + 1];                    //Array to store the values of sigma(yi),sigma(xi*yi),sigma(xi^2*yi)...sigma(xi^n*yi)
+    static const double road_heading[4] = {0, PI/2, PI, -PI/2};
+    return road_heading[RoadQuadrant(heading)];
+}
 
-    for (i = 0;i < 2 * degree_of_polynomial + 1; i++)
-    {
-        X[i]=0;
-        for (j = 0; j < size_of_arrays;j++)
-            X[i]=X[i]+pow(x[j],i);        //consecutive positions of the array will store N,sigma(xi),sigma(xi^2),sigma(xi^3)....sigma(xi^2n)
-    }
+/* Heading of the car relative to the road, in [-PI/4, PI/4] */
+double SOP_AutonomousDriving::RoadQuadrantOffset(double heading)
+{
+    double offset = heading - RoadQuadrantHeading(heading);
+    while (offset > PI)
+        offset -= 2*PI;
+    while (offset < -PI)
+        offset += 2*PI;
+    return offset;
+}
 
-    for (i = 0; i <= degree_of_polynomial;i++)
-        for (j = 0;j <= degree_of_polynomial;j++)
-            B[i][j]=X[i+j];            //Build the Normal matrix by storing the corresponding coefficients at the right positions except the last column of the matrix
+/* First round of TURN_LEFT, TURN_RIGHT and STRAIGHT: the reference of the maneuver library is placed
+ * at car_est_position. If the crossing approach has solved the maneuver in the background
+ * (NMPC_ManeuverSpeculation), its trajectory is moved the same way into nmpc_seed, the first solve
+ * of CalculateMPC starts from there.
+*/
+void SOP_AutonomousDriving::PlaceManeuverReference(int maneuver, TURN_AROUND_REFERENCE_COORDINATE *reference)
+{
+    int index = 0;
+    int quadrant = RoadQuadrant(car_est_position.HeadingAngle);
+    double temp_x = 0;
+    double temp_y = 0;
+    double heading_offset = RoadQuadrantOffset(car_est_position.HeadingAngle);
 
+    temp_HeadingAngle = RoadQuadrantHeading(car_est_position.HeadingAngle);
 
-    for (i = 0;i < degree_of_polynomial+1; i++)
+    switch (maneuver)
     {
-        Y[i]=0;
-        for (j = 0; j < size_of_arrays; j++)
-            Y[i]=Y[i]+pow(x[j],i)*y[j];        //consecutive positions will store sigma(yi),sigma(xi*yi),sigma(xi^2*yi)...sigma(xi^n*yi)
+    case TURN_LEFT:
+        PlaceLibraryReference(MANEUVER_REFERENCE_TURN_LEFT, reference, 0);
+        break;
+    case TURN_RIGHT:
+        PlaceLibraryReference(MANEUVER_REFERENCE_TURN_RIGHT, reference, 0);
+        break;
+    default:
+        PlaceLibraryReference(MANEUVER_REFERENCE_STRAIGHT, reference, 0);
+        break;
     }
-    for (i = 0 ;i <= degree_of_polynomial;i++)
-        B[i][degree_of_polynomial + 1]=Y[i];                //load the values of Y as the last column of B(Normal Matrix but augmented)
-    degree_of_polynomial = degree_of_polynomial + 1;                //n is made n+1 because the Gaussian Elimination part below was for n equations, but here n is the degree of polynomial and for n degree we get n+1 equations
 
+    nmpc_seed_valid = tFalse;
+    if(nmpc_speculation != NULL)
+    {
+        // the speculative reference is the same entry of the library
+        TURN_AROUND_REFERENCE_COORDINATE speculation_reference;
+        int speculation_size = 0;
+        nmpc_seed_valid = nmpc_speculation->Take(maneuver, heading_offset, &speculation_reference, &speculation_size, nmpc_seed);
+        nmpc_speculation->Cancel();
+    }
 
-    /*    cout<<"\nThe Normal(Augmented Matrix) is as follows:\n";
-    for (i = 0; i < degree_of_polynomial; i++)            //print the Normal-augmented matrix
+    if(nmpc_seed_valid == tTrue)
     {
-        for (j = 0;j <= degree_of_polynomial;j++)
-            cout<<B[i][j]<<setw(16);
-        cout<<"\n";
-    }*/
-
-
-    for (i = 0; i < degree_of_polynomial; i++)                    //From now Gaussian Elimination starts(can be ignored) to solve the set of linear equations (Pivotisation)
-        for (k = i + 1; k < degree_of_polynomial; k++)
-            if (B[i][i]<B[k][i])
-                for (j = 0;j <= degree_of_polynomial; j++)
-                {
-                    double temp = B[i][j];
-                    B[i][j]=B[k][j];
-                    B[k][j]=temp;
-                }
-
-    for (i = 0;i < degree_of_polynomial - 1; i++)            //loop to perform the gauss elimination
-        for (k = i + 1; k < degree_of_polynomial; k++)
+        // the heading of the car decides the branch of the angle, not the road quadrant
+        double psi_shift = car_est_position.HeadingAngle - heading_offset;
+        for(index = 0; index <= N; index++)
         {
-            double t=B[k][i]/B[i][i];
-            for (j = 0; j <= degree_of_polynomial; j++)
-                B[k][j]=B[k][j]-t*B[i][j];    //make the elements below the pivot elements equal to zero or elimnate the variables
+            double *stage = nmpc_seed + index*NXU;
+            RotateToQuadrant(quadrant, stage[0], stage[1], &temp_x, &temp_y);
+            stage[0] = temp_x + car_est_position.X_Position;
+            stage[1] = temp_y + car_est_position.Y_Position;
+            stage[2] += psi_shift;
         }
-    for (i = degree_of_polynomial - 1; i >= 0;i--)                //back-substitution
-    {                        //x is an array whose values correspond to the values of x,y,z..
-        answer[i] = B[i][degree_of_polynomial];                //make the variable to be calculated equal to the rhs of the last equation
-        for (j = 0; j < degree_of_polynomial; j++)
-            if (j != i)            //then subtract all the lhs values except the coefficient of the variable whose value                                   is being calculated
-                answer[i] = answer[i]-B[i][j] * answer[j];
-        answer[i] = answer[i] / B[i][i];            //now finally divide the rhs by the coefficient of the variable to be calculated
+        nmpc_seed[0] = car_est_position.X_Position;
+        nmpc_seed[1] = car_est_position.Y_Position;
+        nmpc_seed[2] = car_est_position.HeadingAngle;
+        nmpc_seed_flag = maneuver;
+        LOG_INFO(adtf_util::cString::Format("NMPC maneuver %d starts from the speculative solve", maneuver));
     }
+}
 
-
+/* Least squares polynomial through (x, y), answer[i] is the coefficient of x^i. Degrees 1 to 3, see
+ * PolynomialFit; several point sets at once with PolynomialFit<degree>::FitBatch.
+*/
+tBool SOP_AutonomousDriving::CalculateCoefficient(double *answer, double *x, double *y, int size_of_arrays, int degree_of_polynomial)
+{
+    switch (degree_of_polynomial)
+    {
+    case 1:
+        return PolynomialFit<1>::Fit(x, y, size_of_arrays, answer);
+    case 2:
+        return PolynomialFit<2>::Fit(x, y, size_of_arrays, answer);
+    case 3:
+        return PolynomialFit<3>::Fit(x, y, size_of_arrays, answer);
+    default:
+        LOG_ERROR(adtf_util::cString::Format("CalculateCoefficient: degree %d is not supported", degree_of_polynomial));
+        return tFalse;
+    }
 }
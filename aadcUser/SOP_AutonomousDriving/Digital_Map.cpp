@@ -0,0 +1,147 @@
+#include "Digital_Map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+DigitalMap::DigitalMap()
+    : m_fLeft(0),
+      m_fBom(0),
+      m_fCellSize(MAP_GRID_CELL),
+      m_nColumns(0),
+      m_nRows(0)
+{
+}
+
+void DigitalMap::Clear()
+{
+    m_zones.clear();
+    m_cellStart.clear();
+    m_cellZones.clear();
+    m_nColumns = 0;
+    m_nRows = 0;
+}
+
+int DigitalMap::AddZone(const MAP_ZONE& zone)
+{
+    m_zones.push_back(zone);
+    return static_cast<int>(m_zones.size()) - 1;
+}
+
+void DigitalMap::Build(float cell_size)
+{
+    m_cellStart.clear();
+    m_cellZones.clear();
+    m_nColumns = 0;
+    m_nRows = 0;
+    if (m_zones.empty() || !(cell_size > 0))
+        return;
+
+    float right = m_zones[0].right;
+    float top = m_zones[0].top;
+    m_fLeft = m_zones[0].left;
+    m_fBom = m_zones[0].bom;
+    for (size_t i = 1; i < m_zones.size(); i++)
+    {
+        m_fLeft = std::min(m_fLeft, m_zones[i].left);
+        m_fBom = std::min(m_fBom, m_zones[i].bom);
+        right = std::max(right, m_zones[i].right);
+        top = std::max(top, m_zones[i].top);
+    }
+
+    m_fCellSize = cell_size;
+    for (;;)
+    {
+        m_nColumns = static_cast<int>(floor((right - m_fLeft) / m_fCellSize)) + 1;
+        m_nRows = static_cast<int>(floor((top - m_fBom) / m_fCellSize)) + 1;
+        if (static_cast<long>(m_nColumns) * m_nRows <= MAP_GRID_MAX_CELLS)
+            break;
+        m_fCellSize *= 2;
+    }
+
+    // counting pass, then every zone is written to the cells it overlaps
+    const int cells = m_nColumns * m_nRows;
+    m_cellStart.assign(cells + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<int> fill;
+        if (pass == 1)
+        {
+            for (int c = 0; c < cells; c++)
+                m_cellStart[c + 1] += m_cellStart[c];
+            m_cellZones.resize(m_cellStart[cells]);
+            fill.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+        }
+
+        for (size_t i = 0; i < m_zones.size(); i++)
+        {
+            const MAP_ZONE& zone = m_zones[i];
+            int column_first = static_cast<int>(floor((zone.left - m_fLeft) / m_fCellSize));
+            int column_last = std::min(static_cast<int>(floor((zone.right - m_fLeft) / m_fCellSize)), m_nColumns - 1);
+            int row_first = static_cast<int>(floor((zone.bom - m_fBom) / m_fCellSize));
+            int row_last = std::min(static_cast<int>(floor((zone.top - m_fBom) / m_fCellSize)), m_nRows - 1);
+            for (int row = row_first; row <= row_last; row++)
+            {
+                for (int column = column_first; column <= column_last; column++)
+                {
+                    int c = row * m_nColumns + column;
+                    if (pass == 0)
+                        m_cellStart[c + 1]++;
+                    else
+                        m_cellZones[fill[c]++] = static_cast<int>(i);
+                }
+            }
+        }
+    }
+}
+
+int DigitalMap::Cell(float x, float y) const
+{
+    if (m_nColumns == 0 || !(x >= m_fLeft) || !(y >= m_fBom))
+        return -1;
+    int column = static_cast<int>((x - m_fLeft) / m_fCellSize);
+    int row = static_cast<int>((y - m_fBom) / m_fCellSize);
+    if (column >= m_nColumns || row >= m_nRows)
+        return -1;
+    return row * m_nColumns + column;
+}
+
+int DigitalMap::Query(float x, float y, unsigned int type_mask, const MAP_ZONE **zones, int max_zones) const
+{
+    int c = Cell(x, y);
+    if (c < 0 || max_zones <= 0)
+        return 0;
+
+    int found = 0;
+    for (int k = m_cellStart[c]; k < m_cellStart[c + 1]; k++)
+    {
+        const MAP_ZONE& zone = m_zones[m_cellZones[k]];
+        if ((type_mask & MAP_ZONE_MASK(zone.type)) == 0)
+            continue;
+        if (x < zone.right && x > zone.left && y < zone.top && y > zone.bom)
+        {
+            zones[found++] = &zone;
+            if (found == max_zones)
+                break;
+        }
+    }
+    return found;
+}
+
+const MAP_ZONE* DigitalMap::Find(int type, float x, float y) const
+{
+    const MAP_ZONE *zone = NULL;
+    Query(x, y, MAP_ZONE_MASK(type), &zone, 1);
+    return zone;
+}
+
+int DigitalMap::GetZoneCount(int type) const
+{
+    int count = 0;
+    for (size_t i = 0; i < m_zones.size(); i++)
+    {
+        if (m_zones[i].type == type)
+            count++;
+    }
+    return count;
+}
@@ -0,0 +1,68 @@
+#ifndef _DIGITAL_MAP_H_
+#define _DIGITAL_MAP_H_
+
+#include <vector>
+
+#define MAP_GRID_CELL       1.0f    // m, edge of a grid cell
+#define MAP_GRID_MAX_CELLS  65536   // larger maps get larger cells
+#define MAP_QUERY_MAX_ZONES 8       // zones of one point query the callers keep
+
+enum MAP_ZONE_TYPE {MAP_ZONE_T_CROSSING, MAP_ZONE_AVOIDANCE, MAP_ZONE_PEDESTRIAN, MAP_ZONE_CHILD, MAP_ZONE_STOP_LINE,
+                    MAP_ZONE_TYPE_COUNT};
+
+#define MAP_ZONE_MASK(type) (1u << (type))
+
+/*! Axis aligned zone of the track in m, a point is inside if it is strictly between the edges */
+typedef struct _MAP_ZONE
+{
+    int type;               // MAP_ZONE_TYPE
+    float left;
+    float right;
+    float top;
+    float bom;
+    float HeadingAngle;     // degree, direction of the road the zone belongs to
+} MAP_ZONE;
+
+/*! Zones of the digital map in a uniform grid.
+ *
+ *  Every cell lists the zones which overlap it, in the order they were added, so a point query
+ *  only tests the zones of one cell and its cost does not grow with the size of the track.
+ *  The zones are added once, Build() lays out the grid, the queries do not allocate.
+ */
+class DigitalMap
+{
+public:
+    DigitalMap();
+
+    void Clear();
+    /*! \return index of the zone, valid until Clear() */
+    int AddZone(const MAP_ZONE& zone);
+    /*! lays out the grid of the zones added so far, needed before the queries
+     *  \param cell_size  m, grown until the grid has at most MAP_GRID_MAX_CELLS */
+    void Build(float cell_size = MAP_GRID_CELL);
+
+    /*! zones of the types in type_mask (MAP_ZONE_MASK) which contain (x, y), in the order they were added
+     *  \return number of zones written to zones, the first max_zones of them */
+    int Query(float x, float y, unsigned int type_mask, const MAP_ZONE **zones, int max_zones) const;
+    /*! \return the first zone of the type which contains (x, y), NULL if there is none */
+    const MAP_ZONE* Find(int type, float x, float y) const;
+
+    int GetZoneCount() const { return static_cast<int>(m_zones.size()); }
+    int GetZoneCount(int type) const;
+    const MAP_ZONE& GetZone(int index) const { return m_zones[index]; }
+
+private:
+    /*! \return cell of (x, y), -1 outside the grid */
+    int Cell(float x, float y) const;
+
+    std::vector<MAP_ZONE> m_zones;
+    float m_fLeft;
+    float m_fBom;
+    float m_fCellSize;
+    int m_nColumns;
+    int m_nRows;
+    std::vector<int> m_cellStart;   // zones of cell c are m_cellZones[m_cellStart[c] .. m_cellStart[c+1]-1]
+    std::vector<int> m_cellZones;
+};
+
+#endif // _DIGITAL_MAP_H_
@@ -0,0 +1,86 @@
+#include "Lane_Reference.h"
+#include <cmath>
+
+#define BREAK_ERROR 0.3         // the points are this much farther apart than lane_ref_distance
+#define NEWTON_ITERATIONS 3     // the arc length of the next point is exact to far below 1e-3 cm after these
+
+/* Primitive of sqrt(1 + u^2) times 2 */
+static double LaneArcPrimitive(double u)
+{
+    double root = sqrt(1.0 + u * u);
+    return u * root + log(u + root);
+}
+
+/* Arc length of y = a*x^2 + b*x + c from x0 to x1 in closed form */
+static double LaneArcLength(double a, double b, double x0, double x1)
+{
+    if(fabs(a) < 1e-9)
+        return sqrt(1.0 + b * b) * (x1 - x0);
+    return (LaneArcPrimitive(2.0 * a * x1 + b) - LaneArcPrimitive(2.0 * a * x0 + b)) / (4.0 * a);
+}
+
+void SampleLaneReference(const float *coefficients, float start_x, COORDINATE_STRUCT *image_coord, COORDINATE_STRUCT *world_coord)
+{
+    const double lane_ref_distance = ((0.5 * 100) * DT);   // m/s -> cm/s * DT
+    const double spacing = lane_ref_distance + BREAK_ERROR;
+    const double a = coefficients[0];
+    const double b = coefficients[1];
+    const double c = coefficients[2];
+    double x = start_x;
+
+    // point k lies at the arc length k * spacing from the first one, found by Newton's method on
+    // the closed-form arc length; the step from the last point is the start value
+    for(int index = 0; index <= NMPC_MAX_HORIZON; index++)
+    {
+        if(index > 0)
+        {
+            double x_last = x;
+            double slope = 2.0 * a * x_last + b;
+            x = x_last + spacing / sqrt(1.0 + slope * slope);
+            for(int i = 0; i < NEWTON_ITERATIONS; i++)
+            {
+                slope = 2.0 * a * x + b;
+                x -= (LaneArcLength(a, b, x_last, x) - spacing) / sqrt(1.0 + slope * slope);
+            }
+        }
+
+        double y = (a * (x * x)) + (x * b) + c;
+        image_coord->X[index] = x;
+        image_coord->Y[index] = y;
+        world_coord->X[index] = x * 0.01;  //cm to meter
+        world_coord->Y[index] = -y * 0.01;
+    }
+}
+
+void LaneFollowWeights(double speed, double min_speed, double max_speed, double qy_high_speed, double qy_low_speed,
+                       NMPC_WEIGHTS *weights)
+{
+    weights->Qx = 20;     // Weighting matrix for X-coordinate
+    weights->QxN = 2;     // Weighting matrix for X-coordinate at final point
+    if (speed > (max_speed + min_speed) / 2)
+        weights->Qy = qy_high_speed;
+    else if (speed <= (max_speed + min_speed) / 2 && speed > 0.5)
+        weights->Qy = qy_low_speed;
+    else
+        weights->Qy = 8;
+    weights->QyN = 0;     // Weighting matrix for Y-coordinate at final point
+    weights->Qpsi = 2;    // Weighting factor for heading
+    weights->Rv = 1;      // Weighting matrix for velocity
+    weights->Rd = 2;      // Weighting matrix for steering angle
+    weights->CHGsa = 0.5;
+    weights->CHGss = 3.0;
+}
+
+void NMPCBounds(double speed, double *lower, double *upper)
+{
+    upper[0] = 1e19;      // x-coordinate
+    upper[1] = 1e19;      // y-coordinate
+    upper[2] = 2 * M_PI;  // psi
+    upper[3] = speed;     // velocity
+    upper[4] = 0.436;     // steering angle [rad]
+    lower[0] = -1e19;
+    lower[1] = -1e19;
+    lower[2] = -2 * M_PI;
+    lower[3] = speed;
+    lower[4] = -0.49;
+}
@@ -0,0 +1,32 @@
+#ifndef _LANE_REFERENCE_H_
+#define _LANE_REFERENCE_H_
+
+#include "NMPC_Solver.h"
+
+/* Lane following problem of the NMPC, shared by the filter and the offline tools */
+
+// defaults of the "Lane Following" properties of the filter
+#define LANE_FOLLOW_MIN_SPEED       0.5     // m/s
+#define LANE_FOLLOW_MAX_SPEED       0.8     // m/s
+#define LANE_FOLLOW_QY_HIGH_SPEED   4       // y weight above the middle of the speed range
+#define LANE_FOLLOW_QY_LOW_SPEED    8
+
+/*! Samples the lane polynomial y = a*x^2 + b*x + c of the image processing (image frame, cm)
+ *  into NMPC_MAX_HORIZON+1 reference points with a spacing of 0.5 m/s * DT along the lane
+ *  \param coefficients  {a, b, c}, reference_value[1..3] of the image processing
+ *  \param start_x       x of the first point in cm
+ *  \param image_coord   the points in the image frame in cm
+ *  \param world_coord   the points in the car frame in m, the reference of the NMPC
+ */
+void SampleLaneReference(const float *coefficients, float start_x, COORDINATE_STRUCT *image_coord, COORDINATE_STRUCT *world_coord);
+
+/*! Weighting factors of lane following at the given speed
+ *  \param qy_high_speed, qy_low_speed  y weight above and below the middle of the speed range
+ */
+void LaneFollowWeights(double speed, double min_speed, double max_speed, double qy_high_speed, double qy_low_speed,
+                       NMPC_WEIGHTS *weights);
+
+/*! bounds of {x, y, psi, v, delta} of all maneuvers, the speed is fixed to the reference speed */
+void NMPCBounds(double speed, double *lower, double *upper);
+
+#endif // _LANE_REFERENCE_H_
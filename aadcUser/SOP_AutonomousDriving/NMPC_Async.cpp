@@ -0,0 +1,74 @@
+#include "NMPC_Async.h"
+#include "NMPC_Benchmark.h"
+
+#define ASYNC_WAIT_TIMEOUT  100     // the worker looks for a termination request now and then
+
+NMPC_AsyncWorker::NMPC_AsyncWorker(SOP_AutonomousDriving *filter, NMPC_BenchmarkWorker *benchmark)
+    : m_pFilter(filter),
+      m_pBenchmark(benchmark),
+      m_bCreated(tFalse)
+{
+}
+
+NMPC_AsyncWorker::~NMPC_AsyncWorker()
+{
+    Destroy();
+}
+
+tResult NMPC_AsyncWorker::Create()
+{
+    if (m_bCreated)
+        RETURN_NOERROR;
+
+    RETURN_IF_FAILED(m_oProblemEvent.Create());
+    RETURN_IF_FAILED(m_oThread.Create(cKernelThread::TF_Suspended, static_cast<IKernelThreadFunc*>(this)));
+    RETURN_IF_FAILED(m_oThread.Run());
+    m_bCreated = tTrue;
+
+    RETURN_NOERROR;
+}
+
+tResult NMPC_AsyncWorker::Destroy()
+{
+    if (!m_bCreated)
+        RETURN_NOERROR;
+    m_bCreated = tFalse;
+
+    // the event wakes the worker, Terminate() waits until the current call of ThreadFunc returns
+    m_oProblemEvent.Set();
+    m_oThread.Terminate(tTrue);
+    m_oThread.Release();
+    m_oProblemEvent.Delete();
+
+    RETURN_NOERROR;
+}
+
+tVoid NMPC_AsyncWorker::EndPost()
+{
+    m_oProblems.EndWrite();
+    m_oProblemEvent.Set();
+}
+
+tResult NMPC_AsyncWorker::ThreadFunc(cKernelThread* /*pThread*/, tVoid* /*pvUserData*/, tSize /*szUserData*/)
+{
+    m_oProblemEvent.Wait(ASYNC_WAIT_TIMEOUT);
+    // a problem posted from here on sets the event again
+    m_oProblemEvent.Reset();
+
+    const NMPC_PROBLEM *problem = m_oProblems.BeginRead();
+    if (problem == NULL)
+        RETURN_NOERROR;
+
+    NMPC_RESULT *result = m_oResults.BeginWrite();
+    m_pFilter->SolveNMPCProblem(*problem, result);
+    double shift_steps = result->shift_steps;
+    m_oResults.EndWrite();
+
+    // the other backends get the identical problem in the benchmark thread
+    if (m_pBenchmark != NULL)
+        m_pBenchmark->Post(*problem, shift_steps);
+
+    m_oProblems.EndRead();
+
+    RETURN_NOERROR;
+}
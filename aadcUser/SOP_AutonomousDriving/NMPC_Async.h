@@ -0,0 +1,108 @@
+#ifndef _NMPC_ASYNC_H_
+#define _NMPC_ASYNC_H_
+
+#include "SOP_AutonomousDriving.h"
+
+/*! Hands the newest value of one thread to another thread.
+ *
+ *  There are two slots. The producer fills the slot the consumer is not reading, the consumer
+ *  reads the slot filled last; only the slot indices are exchanged under the lock, the values
+ *  are copied outside of it. A value which has not been read yet is replaced by a newer one.
+ *  One producer and one consumer.
+ */
+template <class T>
+class NMPC_DoubleBuffer
+{
+public:
+    NMPC_DoubleBuffer() : m_nReady(-1), m_nReading(-1), m_nWriting(0) {}
+
+    /*! \return the slot to fill, it is handed over by EndWrite() */
+    T* BeginWrite()
+    {
+        __synchronized_obj(m_oLock);
+        if (m_nReading >= 0)
+            m_nWriting = 1 - m_nReading;
+        else
+            m_nWriting = (m_nReady == 0) ? 1 : 0;
+        // the unread value is overwritten when the consumer holds the other slot
+        if (m_nReady == m_nWriting)
+            m_nReady = -1;
+        return &m_aSlot[m_nWriting];
+    }
+
+    tVoid EndWrite()
+    {
+        __synchronized_obj(m_oLock);
+        m_nReady = m_nWriting;
+    }
+
+    /*! \return the newest value, NULL if there is none since the last read. The slot is kept
+     *  until EndRead() */
+    const T* BeginRead()
+    {
+        __synchronized_obj(m_oLock);
+        if (m_nReady < 0)
+            return NULL;
+        m_nReading = m_nReady;
+        m_nReady = -1;
+        return &m_aSlot[m_nReading];
+    }
+
+    tVoid EndRead()
+    {
+        __synchronized_obj(m_oLock);
+        m_nReading = -1;
+    }
+
+private:
+    T m_aSlot[2];
+    cCriticalSection m_oLock;
+    int m_nReady;       // slot with an unread value, -1 if none
+    int m_nReading;     // slot held by the consumer, -1 if none
+    int m_nWriting;     // slot held by the producer
+};
+
+/*! Worker thread of the NMPC.
+ *
+ *  CalculateMPC builds the problem in Cycle() and posts it, the worker solves the newest posted
+ *  problem with SOP_AutonomousDriving::SolveNMPCProblem() and Cycle() publishes the newest
+ *  result (PollNMPCWorker). A problem posted while the worker is busy replaces the one waiting
+ *  before it, so the worker always continues with the newest state of the car.
+ *
+ *  While the worker exists it is the only user of the NMPC backends.
+ */
+class NMPC_AsyncWorker : public IKernelThreadFunc
+{
+public:
+    /*! \param benchmark  gets every solved problem as well, NULL for none */
+    NMPC_AsyncWorker(SOP_AutonomousDriving *filter, NMPC_BenchmarkWorker *benchmark);
+    virtual ~NMPC_AsyncWorker();
+
+    /*! starts the worker */
+    tResult Create();
+    /*! stops the worker, a running solve is finished first */
+    tResult Destroy();
+
+    /*! \return the problem to fill, it is handed to the worker by EndPost() */
+    NMPC_PROBLEM* BeginPost() { return m_oProblems.BeginWrite(); }
+    tVoid EndPost();
+
+    /*! \return the newest result, NULL if there is no new one. Kept until EndTake() */
+    const NMPC_RESULT* BeginTake() { return m_oResults.BeginRead(); }
+    tVoid EndTake() { m_oResults.EndRead(); }
+
+    tResult ThreadFunc(cKernelThread* pThread, tVoid* pvUserData, tSize szUserData);
+
+private:
+    SOP_AutonomousDriving *m_pFilter;
+    NMPC_BenchmarkWorker *m_pBenchmark;
+
+    cKernelThread m_oThread;
+    cKernelEvent m_oProblemEvent;
+    tBool m_bCreated;
+
+    NMPC_DoubleBuffer<NMPC_PROBLEM> m_oProblems;
+    NMPC_DoubleBuffer<NMPC_RESULT> m_oResults;
+};
+
+#endif // _NMPC_ASYNC_H_
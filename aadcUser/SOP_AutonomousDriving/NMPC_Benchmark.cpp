@@ -0,0 +1,134 @@
+#include "NMPC_Benchmark.h"
+#include "NMPC_RTI_Solver.h"
+#include "NMPC_Lookup_Table.h"
+
+#define BENCHMARK_WAIT_TIMEOUT  100     // the worker looks for a termination request now and then
+
+NMPC_BenchmarkWorker::NMPC_BenchmarkWorker(FILE *log)
+    : m_pLog(log),
+      m_bCreated(tFalse),
+      m_pTable(NULL),
+      m_pTableOnline(NULL)
+{
+    for (int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        m_pSolver[i] = NULL;
+        m_aTimeSum[i] = 0;
+        m_aSolveCounter[i] = 0;
+    }
+}
+
+NMPC_BenchmarkWorker::~NMPC_BenchmarkWorker()
+{
+    Destroy();
+}
+
+tResult NMPC_BenchmarkWorker::Create(const char *table_file, double start_x, double max_time_ms, int max_iterations)
+{
+    if (m_bCreated)
+        RETURN_NOERROR;
+
+    m_pSolver[NMPC_BACKEND_RTI] = new NMPC_RTISolver();
+    m_pTableOnline = new NMPC_RTISolver();
+    m_pTable = new NMPC_LookupTableSolver(m_pTableOnline, table_file, start_x);
+    m_pSolver[NMPC_BACKEND_TABLE] = m_pTable;
+    for (int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        if (m_pSolver[i] == NULL)
+            continue;
+        m_pSolver[i]->Setup();
+        m_pSolver[i]->SetLimits(max_time_ms, max_iterations);
+    }
+
+    RETURN_IF_FAILED(m_oProblemEvent.Create());
+    RETURN_IF_FAILED(m_oThread.Create(cKernelThread::TF_Suspended, static_cast<IKernelThreadFunc*>(this)));
+    RETURN_IF_FAILED(m_oThread.Run());
+    m_bCreated = tTrue;
+
+    RETURN_NOERROR;
+}
+
+tResult NMPC_BenchmarkWorker::Destroy()
+{
+    if (!m_bCreated)
+        RETURN_NOERROR;
+    m_bCreated = tFalse;
+
+    // the event wakes the worker, Terminate() waits until the current call of ThreadFunc returns
+    m_oProblemEvent.Set();
+    m_oThread.Terminate(tTrue);
+    m_oThread.Release();
+    m_oProblemEvent.Delete();
+
+    for (int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        if (m_pSolver[i] != NULL && m_aSolveCounter[i] > 0)
+            LOG_INFO(adtf_util::cString::Format("NMPC benchmark %s: %d solves, mean %g ms", m_pSolver[i]->GetName(), m_aSolveCounter[i],
+                                                m_aTimeSum[i] * 1000.0 / m_aSolveCounter[i]));
+        delete m_pSolver[i];
+        m_pSolver[i] = NULL;
+    }
+    delete m_pTableOnline;
+    m_pTableOnline = NULL;
+    m_pTable = NULL;
+
+    RETURN_NOERROR;
+}
+
+tVoid NMPC_BenchmarkWorker::Post(const NMPC_PROBLEM& problem, double shift_steps)
+{
+    if (!m_bCreated)
+        return;
+
+    BENCHMARK_PROBLEM *slot = m_oProblems.BeginWrite();
+    slot->problem = problem;
+    slot->shift_steps = shift_steps;
+    m_oProblems.EndWrite();
+    m_oProblemEvent.Set();
+}
+
+tResult NMPC_BenchmarkWorker::ThreadFunc(cKernelThread* /*pThread*/, tVoid* /*pvUserData*/, tSize /*szUserData*/)
+{
+    m_oProblemEvent.Wait(BENCHMARK_WAIT_TIMEOUT);
+    // a problem posted from here on sets the event again
+    m_oProblemEvent.Reset();
+
+    const BENCHMARK_PROBLEM *posted = m_oProblems.BeginRead();
+    if (posted == NULL)
+        RETURN_NOERROR;
+
+    // every backend keeps its own warm start data, so each of them sees the sequence of problems
+    // it would see when driving
+    const NMPC_PROBLEM& problem = posted->problem;
+    for (int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        NMPC_Solver *solver = m_pSolver[i];
+        if (solver == NULL || i == problem.backend)
+            continue;
+
+        timeval ts;
+        gettimeofday(&ts, 0);
+        long start_time = ts.tv_sec * 1000000 + ts.tv_usec;
+
+        SOP_AutonomousDriving::SetNMPCProblem(solver, m_pTable, problem);
+        bool solve_ok = solver->Solve(problem.car_state_flag, posted->shift_steps);
+
+        gettimeofday(&ts, 0);
+        double dt = ((ts.tv_sec * 1000000 + ts.tv_usec) - start_time) / 1000000.;
+
+        // a problem outside of the table was solved by the fallback
+        if (solver == m_pTable && !m_pTable->IsLookup())
+            continue;
+        m_aTimeSum[i] += dt;
+        m_aSolveCounter[i]++;
+
+        double speed, steering;
+        solver->GetInputs(&speed, &steering);
+        if (m_pLog) fprintf(m_pLog,"benchmark %s %f %d %d %f %f %d\n", solver->GetName(), dt, solver->GetIterations(), solve_ok ? 1 : 0,
+                            speed, steering, problem.car_state_flag);
+    }
+
+    m_oProblems.EndRead();
+
+    RETURN_NOERROR;
+}
@@ -0,0 +1,62 @@
+#ifndef _NMPC_BENCHMARK_H_
+#define _NMPC_BENCHMARK_H_
+
+#include "SOP_AutonomousDriving.h"
+#include "NMPC_Async.h"
+
+class NMPC_RTISolver;
+
+/*! Times the problems of the filter on the backends which do not drive.
+ *
+ *  The filter posts every problem it has solved, a worker thread solves the newest one on its own
+ *  instances of the real-time iteration and of the lookup table, so neither the control path nor
+ *  the warm start of the driving backends is touched. A problem posted while the worker is busy
+ *  replaces the one waiting before it.
+ *
+ *  The Ipopt NLP exists only once and belongs to the filter, Ipopt is timed while it drives. The
+ *  table falls back to an RTI instance of its own, only its lookups are timed.
+ */
+class NMPC_BenchmarkWorker : public IKernelThreadFunc
+{
+public:
+    /*! \param log  file of the solve times, NULL for none */
+    NMPC_BenchmarkWorker(FILE *log);
+    virtual ~NMPC_BenchmarkWorker();
+
+    /*! sets the backends up and starts the worker
+     *  \param table_file  table of Tools/NMPC_Table_Generator
+     *  \param start_x     first reference point of the filter */
+    tResult Create(const char *table_file, double start_x, double max_time_ms, int max_iterations);
+    /*! stops the worker, a running solve is finished first, and logs the mean solve times */
+    tResult Destroy();
+
+    /*! hands a solved problem to the worker
+     *  \param shift_steps  time since the problem before in multiples of DT */
+    tVoid Post(const NMPC_PROBLEM& problem, double shift_steps);
+
+    tResult ThreadFunc(cKernelThread* pThread, tVoid* pvUserData, tSize szUserData);
+
+private:
+    typedef struct _BENCHMARK_PROBLEM
+    {
+        NMPC_PROBLEM problem;
+        double shift_steps;
+    } BENCHMARK_PROBLEM;
+
+    FILE *m_pLog;
+
+    cKernelThread m_oThread;
+    cKernelEvent m_oProblemEvent;
+    tBool m_bCreated;
+
+    NMPC_DoubleBuffer<BENCHMARK_PROBLEM> m_oProblems;
+
+    // used by the worker only, indexed by NMPC_BACKEND, there is no Ipopt
+    NMPC_Solver *m_pSolver[NMPC_BACKEND_COUNT];
+    NMPC_LookupTableSolver *m_pTable;
+    NMPC_RTISolver *m_pTableOnline;
+    double m_aTimeSum[NMPC_BACKEND_COUNT];
+    int m_aSolveCounter[NMPC_BACKEND_COUNT];
+};
+
+#endif // _NMPC_BENCHMARK_H_
@@ -1,8 +1,14 @@
 #include "SOP_AutonomousDriving.h"
-#include "IpIpoptApplication.hpp"
 
-#include "Nmpc/audi_q2_nlp.h"
-#include "Nmpc/rungekutta.h"
+#include "NMPC_Ipopt_Solver.h"
+#include "Bicycle_Model.h"
+#include "NMPC_RTI_Solver.h"
+#include "NMPC_Lookup_Table.h"
+#include "NMPC_Speculation.h"
+#include "NMPC_Async.h"
+#include "NMPC_Benchmark.h"
+#include "Lane_Reference.h"
+#include "Polynomial_Fit.h"
 
 
 
@@ -16,17 +22,6 @@
 #define NEGATIVE_STEERING_ANGLE_TO_PERCENT    (100.0 / MAX_NEGATIVE_STEERING_ANGLE)
 
 
-double Qx = 20;     // Weighting matrix for X-coordinate
-double QxN = 2;  // Weighting matrix for X-coordinate at final point
-double Qy = 5; 	 // Weighting matrix for Y-coordinate
-double QyN = 5;//5; 	 // Weighting matrix for Y-coordinate at final point
-double Qpsi = 2; // Weighting factor for heading
-double Rv = 1; 	 // Weighting matrix for velocity
-double Rd = 1;//3; 	 // Weighting matrix for steering angle
-double CHGsa = 1;
-double CHGss = 1;
-double Qrd = 1.5;
-double vcc = 0.5;
 double shift_lane = 0.0;
 int shift_lane_counter = 0;
 
@@ -39,34 +34,16 @@ float v2=0.0;
 bool speedchange_finished = tFalse;
 float v1_ex=0.0;
 
-double XX[N*NXU + NX];
-double LAMBDA[(N+1)*NX + N +1];
-double ZL[N*NXU + NX];
-double ZU[N*NXU + NX];
-MatrixXd dxdu(N*NX,NXU);
-double Xini[NX];
-double OUTPUT[(N+1)*NX];
-double xlower[NXU];
-double xupper[NXU];
-MatrixXd M(3,4); // Collocation matrix, derivatives of the Lagrange polynomials at collocation points
 volatile double ipoptDt;
 int mpcIdx = 0;
 
-RungeKutta *rk4;
 float xsol[N];
 float ysol[N];
 float xsol_temp;
 float ysol_temp;
 
-float last_heading = 0;
-
-COORDINATE_STRUCT *soll;
-MPC_PARAMETER *MPC_parameter;
-
-SmartPtr<TNLP> mynlp;
-SmartPtr<IpoptApplication> app;
-ApplicationReturnStatus status;
 
+int ipoptIterations = 0;
 
 
 tFloat32 last_mpc_steering = 0;
@@ -78,32 +55,15 @@ float zdist = 0;
 int time_counter = 0;
 
 /* Data for Kalman filter*/
-Matrix3d P;
-double PP = 0.5; // The a posteriori error covariance matrix
-Vector3d sensors;
-Vector3d estimates;
-vector <double (*)(double*, double*, double)> funcs;
-double dotX1(double *sVars, double *uu, double h);
-double dotX2(double *sVars, double *uu, double h);
-double dotX3(double *sVars, double *uu, double h);
-Matrix3d F;
-Matrix3d H;
-Matrix3d Q;
-Matrix3d R;
-Matrix3d I;
+Matrix3d P;             // The a posteriori error covariance matrix
+Vector3d estimates;     // {x, y, psi}
 
 #ifdef AUTO_A
-double FF = 1;
-double HH = 1;
-double QQ = 10;
-double RR = 10;
-double II = 1.0;
+const Vector3d ekf_process_noise(0.01, 0.01, 0.025);            // The covariance of the process noise per second
+const Vector3d ekf_measurement_noise(0.0025, 0.0025, 0.0025);   // The covariance of the observation noise
 #else
-double FF = 1;
-double HH = 1;
-double QQ = 10; // The covariance matrix of the process noise
-double RR = 15;  // The covariance matrix of the observation noise
-double II = 1.0;
+const Vector3d ekf_process_noise(0.01, 0.01, 0.025);            // The covariance of the process noise per second
+const Vector3d ekf_measurement_noise(0.0025, 0.0025, 0.00375);  // The covariance of the observation noise
 #endif
 /* ********************* */
 
@@ -143,8 +103,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 
             if(reference_value[0] == LTRACE || reference_value[0] == SL_TRACE)
             {
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
                 //LOG_INFO(adtf_util::cString::Format("Curve cor = %g, SL_TRACE = %g ", ref_lane_world_coord.X, ref_lane_world_coord.Y));
                 CalculateMPC(input_car_state_flag, 1.0);
             }
@@ -171,8 +131,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
             CalculateTurnAroundReferencePoint(AVOIDANCE, turn_around_reference_counter);
-            memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-            memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+            memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+            memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
             rdist = distance_overall-last_distance_overall;
             dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
@@ -191,15 +151,16 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
         else
         {
 
-            if (fabs(distance_overall-last_distance_overall) > dist-0.01)
+            int window = NextReferenceWindow(&avoidance_ref_coord, 2*N);
+            if (window >= 0)
             {
 
-                CalculateTurnAroundReferencePoint(AVOIDANCE, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                CalculateTurnAroundReferencePoint(AVOIDANCE, window);
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
 #ifdef OUTPUT_REFERENCE_POINT_DEBUG
-                LOG_INFO(adtf_util::cString::Format("AVOIDANCE Ziel %d X Y: %g   %g",turn_around_reference_counter, soll->X[0], soll->Y[0]));
+                LOG_INFO(adtf_util::cString::Format("AVOIDANCE Ziel %d X Y: %g   %g",turn_around_reference_counter, mpc_reference.X[0], mpc_reference.Y[0]));
 #endif
                 rdist = distance_overall-last_distance_overall;
                 dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
@@ -211,8 +172,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 
                 last_distance_overall = distance_overall;
 
-                if(turn_around_reference_counter < 2*N)
-                    turn_around_reference_counter++;
+                turn_around_reference_counter = window + 1;
             }
         }
 
@@ -296,8 +256,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
             CalculateTurnAroundReferencePoint(TURN_LEFT, turn_around_reference_counter);
-            memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-            memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+            memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+            memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
             rdist = distance_overall-last_distance_overall;
             dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
@@ -316,13 +276,14 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
         else
         {
 
-            if (fabs(distance_overall-last_distance_overall) > dist-0.01)
+            int window = NextReferenceWindow(&turn_left_ref_coord, 3*N);
+            if (window >= 0)
             {
 
-                CalculateTurnAroundReferencePoint(TURN_LEFT, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
-                //  LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, soll->X[0], soll->Y[0]));
+                CalculateTurnAroundReferencePoint(TURN_LEFT, window);
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                //  LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, mpc_reference.X[0], mpc_reference.Y[0]));
                 rdist = distance_overall-last_distance_overall;
                 dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
 
@@ -332,8 +293,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 #endif
                 last_distance_overall = distance_overall;
 
-                if(turn_around_reference_counter < 3*N)
-                    turn_around_reference_counter++;
+                turn_around_reference_counter = window + 1;
             }
         }
 
@@ -386,8 +346,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
             CalculateTurnAroundReferencePoint(TURN_RIGHT, turn_around_reference_counter);
-            memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-            memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+            memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+            memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
 
             rdist = distance_overall-last_distance_overall;
@@ -397,7 +357,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             LOG_INFO(adtf_util::cString::Format("TURN_RIGHT Ziel%d distance %f currentDist %f lastDist %f reldist %f",turn_around_reference_counter,dist,distance_overall,last_distance_overall,rdist));
 #endif
             last_distance_overall = distance_overall;
-            //                LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, soll->X[0], soll->Y[0]));
+            //                LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, mpc_reference.X[0], mpc_reference.Y[0]));
             turn_around_reference_counter++;
 
             image_processing_function_switch &= ~LANE_DETECTION;
@@ -407,14 +367,15 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
         }
         else
         {
-            if (distance_overall-last_distance_overall > dist-0.005)
+            int window = NextReferenceWindow(&turn_right_ref_coord, 2*N);
+            if (window >= 0)
             {
 
-                CalculateTurnAroundReferencePoint(TURN_RIGHT, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
-                // LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, soll->X[0], soll->Y[0]));
-                //                    LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, soll->X[0], soll->Y[0]));
+                CalculateTurnAroundReferencePoint(TURN_RIGHT, window);
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                // LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, mpc_reference.X[0], mpc_reference.Y[0]));
+                //                    LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, mpc_reference.X[0], mpc_reference.Y[0]));
                 rdist = distance_overall-last_distance_overall;
                 dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
 
@@ -424,8 +385,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 #endif
                 last_distance_overall = distance_overall;
 
-                if(turn_around_reference_counter < 2*N)
-                    turn_around_reference_counter++;
+                turn_around_reference_counter = window + 1;
             }
         }
 
@@ -474,8 +434,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
             CalculateTurnAroundReferencePoint(STRAIGHT, turn_around_reference_counter);
-            memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-            memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+            memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+            memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
 
             rdist = distance_overall-last_distance_overall;
@@ -485,7 +445,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             LOG_INFO(adtf_util::cString::Format("STRAIGHT Ziel%d distance %f currentDist %f lastDist %f reldist %f",turn_around_reference_counter,dist,distance_overall,last_distance_overall,rdist));
 #endif
             last_distance_overall = distance_overall;
-            //                LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, soll->X[0], soll->Y[0]));
+            //                LOG_INFO(adtf_util::cString::Format("Ziel %d X Y: %g   %g",turn_around_reference_counter, mpc_reference.X[0], mpc_reference.Y[0]));
             turn_around_reference_counter++;
 
             image_processing_function_switch &= ~LANE_DETECTION;
@@ -495,12 +455,13 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
         }
         else
         {
-            if (distance_overall-last_distance_overall > dist-0.005)
+            int window = NextReferenceWindow(&straight_ref_coord, 4*N);
+            if (window >= 0)
             {
 
-                CalculateTurnAroundReferencePoint(STRAIGHT, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                CalculateTurnAroundReferencePoint(STRAIGHT, window);
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
                 rdist = distance_overall-last_distance_overall;
                 dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
 
@@ -509,8 +470,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 #endif
                 last_distance_overall = distance_overall;
 
-                if(turn_around_reference_counter < 4*N)
-                    turn_around_reference_counter++;
+                turn_around_reference_counter = window + 1;
             }
         }
 
@@ -581,8 +541,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
                 car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
                 CalculateTurnAroundReferencePoint(PULL_OUT_LEFT, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
                 rdist = distance_overall-last_distance_overall;
                 dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
@@ -602,12 +562,13 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             else
             {
 
-                if (distance_overall-last_distance_overall > dist-0.01)
+                int window = NextReferenceWindow(&pullout_left_ref_coord, 3*N);
+                if (window >= 0)
                 {
 
-                    CalculateTurnAroundReferencePoint(PULL_OUT_LEFT, turn_around_reference_counter);
-                    memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                    memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                    CalculateTurnAroundReferencePoint(PULL_OUT_LEFT, window);
+                    memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                    memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
                     rdist = distance_overall-last_distance_overall;
                     dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
@@ -617,8 +578,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 #endif
                     last_distance_overall = distance_overall;
 
-                    if(turn_around_reference_counter < 3*N)
-                        turn_around_reference_counter++;
+                    turn_around_reference_counter = window + 1;
                 }
             }
 
@@ -707,8 +667,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 
 
                 CalculateTurnAroundReferencePoint(PULL_OUT_RIGHT, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
 
                 rdist = distance_overall-last_distance_overall;
@@ -724,12 +684,13 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             }
             else
             {
-                if (distance_overall-last_distance_overall > dist-0.01)
+                int window = NextReferenceWindow(&pullout_right_ref_coord, 3*N);
+                if (window >= 0)
                 {
 
-                    CalculateTurnAroundReferencePoint(PULL_OUT_RIGHT, turn_around_reference_counter);
-                    memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                    memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                    CalculateTurnAroundReferencePoint(PULL_OUT_RIGHT, window);
+                    memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                    memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
 
                     rdist = distance_overall-last_distance_overall;
                     dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
@@ -740,8 +701,7 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 #endif
                     last_distance_overall = distance_overall;
 
-                    if(turn_around_reference_counter < 3*N)
-                        turn_around_reference_counter++;
+                    turn_around_reference_counter = window + 1;
                 }
             }
 
@@ -801,8 +761,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
             CalculateTurnAroundReferencePoint(PARKING, turn_around_reference_counter);
-            memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-            memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+            memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+            memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
             rdist = distance_overall-last_distance_overall;
             dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
 
@@ -825,8 +785,8 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
             {
 
                 CalculateTurnAroundReferencePoint(PARKING, turn_around_reference_counter);
-                memcpy(soll->X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
-                memcpy(soll->Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
+                memcpy(mpc_reference.X, ref_lane_world_coord.X, sizeof(ref_lane_world_coord.X));
+                memcpy(mpc_reference.Y, ref_lane_world_coord.Y, sizeof(ref_lane_world_coord.Y));
                 rdist = distance_overall-last_distance_overall;
                 dist = GetDistanceBetweenCoordinates(ref_lane_world_coord.X[1], ref_lane_world_coord.Y[1] , ref_lane_world_coord.X[0], ref_lane_world_coord.Y[0] );
 
@@ -983,334 +943,459 @@ tResult SOP_AutonomousDriving::AutoControl(int input_car_state_flag)
 tResult SOP_AutonomousDriving::CalculateMPC(int input_car_state_flag, float direction)
 {
     // __synchronized_obj(m_critSecOnPinEvent);
-    timeval ts;
-    long ipoptStartTime;
     
     // parameter settings
-    MPC_parameter->MPC_car_state_flag = current_car_state_flag;
+    mpc_car_state_flag = current_car_state_flag;
     //    if(current_car_state_flag == AVOIDANCE)
-    //        MPC_parameter->MPC_car_state_flag = LANE_FOLLOW;
-    if(MPC_parameter->MPC_car_state_flag == LANE_FOLLOW)
+    //        mpc_car_state_flag = LANE_FOLLOW;
+    if(mpc_car_state_flag == LANE_FOLLOW)
     {
-        if (lane_follow_speed > (lane_follow_maxSpeed+lane_follow_minSpeed)/2)
-            Qy = weightFact_LaneFollow_HY;//8/5; 	 // Weighting matrix for Y-coordinate
-        else if (lane_follow_speed <= (lane_follow_maxSpeed+lane_follow_minSpeed)/2 && lane_follow_speed > 0.5)
-            Qy = weightFact_LaneFollow_LY;
-        else
-            Qy = 8;
-        QyN = 0; 	 // Weighting matrix for Y-coordinate at final point
-        Qpsi = 2; // Weighting factor for heading
-
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 2;//2.5//2; 	 // Weighting matrix for steering angle
+        // shared with Tools/NMPC_Table_Generator, the lookup table is built with the same weights
+        LaneFollowWeights(lane_follow_speed, lane_follow_minSpeed, lane_follow_maxSpeed,
+                          weightFact_LaneFollow_HY, weightFact_LaneFollow_LY, &mpc_weights);
 
-        vcc = lane_follow_speed;
-
-        CHGsa = 0.5; //0.5
-        CHGss = 3.0;
-        initialize_bounds();
+        mpc_speed_reference = lane_follow_speed;
     }
-    else if(MPC_parameter->MPC_car_state_flag == AVOIDANCE)
+    else
     {
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
-        {
-            Qx = weightFact_Avoidance_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_Avoidance_Y; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
-        {
-            Qx = weightFact_Avoidance_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_Avoidance_X; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-
+        int axis = (temp_HeadingAngle == 0 || temp_HeadingAngle == PI) ? NMPC_PROFILE_AXIS_X : NMPC_PROFILE_AXIS_Y;
+        // the backward part of the parking follows the other axis
+        if(mpc_car_state_flag == PARKING && turn_around_reference_counter > 2*N)
+            axis = 1 - axis;
+        mpc_weights = nmpc_weight_profile[NMPCProfile(mpc_car_state_flag)][axis];
 
-        QxN = 2;  // Weighting matrix for X-coordinate at final point
-        QyN = 1;//5; 	 // Weighting matrix for Y-coordinate at final point
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        if(avoidance.comeback_flag == 2 )
+        if(mpc_car_state_flag == AVOIDANCE)
         {
-            if(lane_follow_speed > 0.8)
-                vcc = 0.8;
+            if(avoidance.comeback_flag == 2 )
+            {
+                if(lane_follow_speed > 0.8)
+                    mpc_speed_reference = 0.8;
+                else
+                    mpc_speed_reference = lane_follow_speed;
+            }
             else
-                vcc = lane_follow_speed;
+            {
+                mpc_speed_reference = avoidance_laneChange_speed;
+                lane_follow_speed = avoidance_laneChange_speed;
+            }
         }
+        else if(mpc_car_state_flag == PARKING)
+            mpc_speed_reference = 0.45 * direction;
         else
-        {
-            vcc = avoidance_laneChange_speed;
-            lane_follow_speed = avoidance_laneChange_speed;
-        }
-        CHGsa = 1.0;
+            mpc_speed_reference = no_lane_follow_speed * direction;
+    }
+
+    // the bounds depend on the reference speed only
+    if(mpc_speed_reference != mpc_bounds_speed)
         initialize_bounds();
+
+    
+    
+    //        for(int i =0; i< N; i++)
+    //            LOG_INFO(adtf_util::cString::Format("MPC Ziel %d Velocity %g X Y: %g   %g",i, mpc_speed_reference, mpc_reference.X[i], mpc_reference.Y[i]));
+    //        LOG_INFO(adtf_util::cString::Format("----------------------------------"));
+    
+    if(mpc_car_state_flag == LANE_FOLLOW)
+    {
+        mpc_initial_state[0] = 0; // X Messwerte
+        mpc_initial_state[1] = 0; // Y Messwerte
+        mpc_initial_state[2] = 0; // Psi Messwerte
     }
-    else if(MPC_parameter->MPC_car_state_flag == TURN_LEFT)
+    else
     {
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
-        {
-            Qx = weightFact_TurnLeft_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_TurnLeft_Y; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
-        {
-            Qx = weightFact_TurnLeft_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_TurnLeft_X; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
 
+        //car_cur_position.X_Position
 
-        QxN = 2;  // Weighting matrix for X-coordinate at final point
-        QyN = 1;//5; 	 // Weighting matrix for Y-coordinate at final point
-        //Qpsi = 2; // Weighting factor for heading
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = no_lane_follow_speed * direction;
-        CHGsa = 1.0;
-        initialize_bounds();
+        mpc_initial_state[0] =  estimates(0); // X Messwerte
+        mpc_initial_state[1] =  estimates(1); // Y Messwerte
+        mpc_initial_state[2] =  estimates(2); // Psi Messwerte
     }
-    else if(MPC_parameter->MPC_car_state_flag == TURN_RIGHT)
+
+    SetNMPCObstacles();
+
+#ifdef OUTPUT_EKF_DEBUG
+    //LOG_INFO(adtf_util::cString::Format("%g %g",estimates(2), car_cur_position.HeadingAngle));
+//    LOG_INFO(adtf_util::cString::Format("****SENSORS Heading %g ****", car_cur_position.HeadingAngle));
+#endif
+
+    int backend = (mpc_car_state_flag == LANE_FOLLOW) ? nmpc_backend_lane_follow : nmpc_backend_maneuver;
+    mpc_horizon = NMPCHorizon(backend, mpc_car_state_flag, mpc_speed_reference);
+
+    if(nmpc_async != NULL)
     {
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
-        {
-            Qx = weightFact_TurnRight_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_TurnRight_Y; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
-        {
-            Qx = weightFact_TurnRight_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_TurnRight_X; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        QyN = 1;//5; 	 // Weighting matrix for Y-coordinate at final point
-        //Qpsi = 2; // Weighting factor for heading
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = no_lane_follow_speed * direction;
-        CHGsa = 1.0;
-        initialize_bounds();
+        // the worker solves it, PollNMPCWorker() publishes the result in a later cycle
+        BuildNMPCProblem(backend, nmpc_async->BeginPost());
+        nmpc_async->EndPost();
+        RETURN_NOERROR;
     }
-    else if(MPC_parameter->MPC_car_state_flag == STRAIGHT)
+
+    NMPC_PROBLEM problem;
+    NMPC_RESULT result;
+    BuildNMPCProblem(backend, &problem);
+    SolveNMPCProblem(problem, &result);
+    PublishNMPCResult(result);
+
+    // the other backends get the identical problem in the benchmark thread
+    if(nmpc_benchmark != NULL)
+        nmpc_benchmark->Post(problem, result.shift_steps);
+
+    
+    //    curvefitting();
+
+    RETURN_NOERROR;
+}
+
+/* Copies the problem of CalculateMPC, a backend sees nothing but this copy */
+void SOP_AutonomousDriving::BuildNMPCProblem(int backend, NMPC_PROBLEM *problem)
+{
+    timeval ts;
+    gettimeofday(&ts, 0);
+
+    problem->backend = backend;
+    problem->car_state_flag = mpc_car_state_flag;
+    problem->start_time = ts.tv_sec * 1000000 + ts.tv_usec;
+    nmpc_last_problem_time = problem->start_time;
+    problem->reference = mpc_reference;
+    problem->speed_reference = mpc_speed_reference;
+    problem->horizon = mpc_horizon;
+    memcpy(problem->obstacles, mpc_obstacles, sizeof(problem->obstacles));
+    problem->obstacle_count = mpc_obstacle_count;
+    problem->weights = mpc_weights;
+    memcpy(problem->lower, mpc_lower, sizeof(problem->lower));
+    memcpy(problem->upper, mpc_upper, sizeof(problem->upper));
+    memcpy(problem->initial_state, mpc_initial_state, sizeof(problem->initial_state));
+    problem->speed = last_speed;
+    problem->steering = last_mpc_steering;
+    memcpy(problem->lane_coefficients, ref_lane_coefficients, sizeof(problem->lane_coefficients));
+
+    // first solve of a maneuver which has been solved during the crossing approach
+    problem->seed_valid = tFalse;
+    if(nmpc_seed_valid == tTrue)
     {
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
-        {
-            Qx = weightFact_Straight_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_Straight_Y; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
+        if(nmpc_seed_flag == mpc_car_state_flag)
         {
-            Qx = weightFact_Straight_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_Straight_X; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
+            memcpy(problem->seed, nmpc_seed, sizeof(problem->seed));
+            problem->seed_valid = tTrue;
         }
-        QyN = 1;//5; 	 // Weighting matrix for Y-coordinate at final point
-        //Qpsi = 2; // Weighting factor for heading
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = no_lane_follow_speed * direction;
-        CHGsa = 1.0;
-        initialize_bounds();
+        nmpc_seed_valid = tFalse;
     }
-    else if(MPC_parameter->MPC_car_state_flag == PULL_OUT_LEFT)
-    {
+}
 
+/* Solves a problem of BuildNMPCProblem, in Cycle() or in the worker thread (NMPC_AsyncWorker).
+ * Touches nothing but the backends and their statistics.
+ */
+void SOP_AutonomousDriving::SolveNMPCProblem(const NMPC_PROBLEM& problem, NMPC_RESULT *result)
+{
+    timeval ts;
+    NMPC_Solver *solver = nmpc_solver[problem.backend];
 
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
-        {
-            Qx = weightFact_PullOutLeft_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_PullOutLeft_Y; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
-        {
-            Qx = weightFact_PullOutLeft_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_PullOutLeft_X; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
+    gettimeofday(&ts, 0);
+    long ipoptStartTime = ts.tv_sec * 1000000 + ts.tv_usec;
 
-        //        Qx = weightFact_PullOutLeft_X;     // Weighting matrix for X-coordinate
-        //        // Weighting matrix for X-coordinate at final point
-        //        Qy = weightFact_PullOutLeft_Y; 	 // Weighting matrix for Y-coordinate
-
-        QxN = 2;
-        QyN = 5;//5; 	 // Weighting matrix for Y-coordinate at final point
-        Qpsi = 2; // Weighting factor for heading
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = no_lane_follow_speed * direction;
-        CHGsa = 1.0;
-        initialize_bounds();
-    }
-    else if(MPC_parameter->MPC_car_state_flag == PULL_OUT_RIGHT)
+    // the warm start is shifted by the time between two solved problems
+    double shift_steps = ((problem.start_time - last_mpc_start_time) / 1000000.) / DT;
+    last_mpc_start_time = problem.start_time;
+
+    SetNMPCProblem(solver, nmpc_table_solver, problem);
+    if(problem.seed_valid == tTrue)
+        solver->SetInitialGuess(problem.seed, problem.car_state_flag);
+    result->solve_ok = solver->Solve(problem.car_state_flag, shift_steps) ? tTrue : tFalse;
+    solver->GetSolution(result->solution);
+    result->iterations = solver->GetIterations();
+    result->warm_started = (problem.backend == NMPC_BACKEND_IPOPT && nmpc_ipopt_solver->IsWarmStarted()) ? tTrue : tFalse;
+
+    //LOG_INFO(adtf_util::cString::Format("****Current inputs: V=%g Theta=%g ****",result->solution[3], result->solution[4]));
+    gettimeofday(&ts, 0);
+    long ipoptTime = ts.tv_sec * 1000000 + ts.tv_usec;
+    result->solve_time = (ipoptTime - ipoptStartTime) / 1000000.;
+    //    std::cout << "Ipopt time measurement: " << result->solve_time << std::endl;
+    result->backend = problem.backend;
+    result->car_state_flag = problem.car_state_flag;
+    result->start_time = problem.start_time;
+    result->shift_steps = shift_steps;
+    result->reference = problem.reference;
+    memcpy(result->lower, problem.lower, sizeof(result->lower));
+    memcpy(result->upper, problem.upper, sizeof(result->upper));
+    memcpy(result->initial_state, problem.initial_state, sizeof(result->initial_state));
+
+    nmpc_backend_time_sum[problem.backend] += result->solve_time;
+    nmpc_backend_solve_counter[problem.backend]++;
+}
+
+/* Writes the solution of a problem to the car, or the fallback if it has not converged or came late */
+tResult SOP_AutonomousDriving::PublishNMPCResult(const NMPC_RESULT& result)
+{
+    timeval ts;
+
+    ipoptDt = result.solve_time;
+    ipoptIterations = result.iterations;
+    memcpy(mpc_solution, result.solution, sizeof(mpc_solution));
+
+    mpcIdx += 1;
+
+    // a solution which came after its wall clock budget is as unusable as one which did not converge
+    tBool on_time = (result.solve_ok == tTrue && ipoptDt * 1000.0 <= nmpc_solve_budget) ? tTrue : tFalse;
+    if(on_time == tFalse)
     {
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
-        {
-            Qx = weightFact_PullOutRight_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_PullOutRight_Y; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
+        nmpc_overrun_counter++;
+
+        // one warning per interval at most, it sums up the overruns since the one before
+        gettimeofday(&ts, 0);
+        long current_time = ts.tv_sec * 1000000 + ts.tv_usec;
+        if(current_time - nmpc_last_overrun_log_time >= NMPC_OVERRUN_LOG_INTERVAL)
         {
-            Qx = weightFact_PullOutRight_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_PullOutRight_X; 	 // Weighting matrix for Y-coordinate
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
+            LOG_WARNING(adtf_util::cString::Format("NMPC overruns: %d since the last warning, %d in total; last %s, converged %d, %d iterations, %g ms (budget %g ms)",
+                                                   nmpc_overrun_counter - nmpc_overrun_logged_counter, nmpc_overrun_counter,
+                                                   nmpc_solver[result.backend]->GetName(), result.solve_ok ? 1 : 0,
+                                                   ipoptIterations, ipoptDt * 1000.0, nmpc_solve_budget));
+            nmpc_overrun_logged_counter = nmpc_overrun_counter;
+            nmpc_last_overrun_log_time = current_time;
         }
-        //        Qx = weightFact_PullOutRight_X;     // Weighting matrix for X-coordinate
-        QxN = 5;  // Weighting matrix for X-coordinate at final point
-        /*        Qy = weightFact_PullOutRight_Y;*/ 	 // Weighting matrix for Y-coordinate
-        QyN = 5;//5; 	 // Weighting matrix for Y-coordinate at final point
-        Qpsi = 2; // Weighting factor for heading
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = no_lane_follow_speed * direction;
-        CHGsa = 1.0;
-        initialize_bounds();
     }
-    else if(MPC_parameter->MPC_car_state_flag == PARKING)
+
+    if(on_time == tTrue)
     {
-        if (temp_HeadingAngle == 0 || temp_HeadingAngle == PI)
+        for(int k = 0; k < N; k++)
         {
-            Qx = weightFact_Parking_X;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_Parking_Y; 	 // Weighting matrix for Y-coordinate
-            if (turn_around_reference_counter>2*N)
-            {
-                Qx = weightFact_Parking_Y;     // Weighting matrix for X-coordinate
-                // Weighting matrix for X-coordinate at final point
-                Qy = weightFact_Parking_X; 	 // Weighting matrix for Y-coordinate
-            }
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
-        }
-        else
-        {
-            Qx = weightFact_Parking_Y;     // Weighting matrix for X-coordinate
-            // Weighting matrix for X-coordinate at final point
-            Qy = weightFact_Parking_X; 	 // Weighting matrix for Y-coordinate
-            if (turn_around_reference_counter>2*N)
-            {
-                Qx = weightFact_Parking_X;     // Weighting matrix for X-coordinate
-                // Weighting matrix for X-coordinate at final point
-                Qy = weightFact_Parking_Y; 	 // Weighting matrix for Y-coordinate
-            }
-            //            LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-            //            LOG_INFO(adtf_util::cString::Format("Heading angle %g",temp_HeadingAngle));
+            mpc_input_sequence[k][0] = mpc_solution[k*NXU + 3];
+            mpc_input_sequence[k][1] = mpc_solution[k*NXU + 4];
         }
+        mpc_input_sequence_time = result.start_time;
+        mpc_input_sequence_flag = result.car_state_flag;
+        mpc_input_sequence_valid = tTrue;
 
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = 0.45 * direction;
-        CHGsa = 0.0;
-        initialize_bounds();
+        WriteSteeringAndSpeed(mpc_solution[3], mpc_solution[4]);
     }
     else
-
     {
-        Qx = 20;     // Weighting matrix for X-coordinate
-        QxN = 2;  // Weighting matrix     /* KALMAN FILTER */
-        Qy = 5; 	 // Weighting matrix for Y-coordinate
-        QyN = 5;//5; 	 // Weighting matrix for Y-coordinate at final point
-        Qpsi = 2; // Weighting factor for heading
-        Rv = 1; 	 // Weighting matrix for velocity
-        Rd = 1;//3; 	 // Weighting matrix for steering angle
-        vcc = no_lane_follow_speed * direction;
-        initialize_bounds();
-        //LOG_INFO(adtf_util::cString::Format("SONDERN MODE----------------------------------"));
-        //LOG_INFO(adtf_util::cString::Format("MPC_car_state_flag %d avoidance_flag %d", MPC_parameter->MPC_car_state_flag, avoidance_flag ));
-
+        gettimeofday(&ts, 0);
+        CalculateFallbackControl(result, ts.tv_sec * 1000000 + ts.tv_usec);
     }
+    FitNMPCPathCurve(result, on_time);
 
-    
-    
-    //        for(int i =0; i< N; i++)
-    //            LOG_INFO(adtf_util::cString::Format("MPC Ziel %d Velocity %g X Y: %g   %g",i, vcc, soll->X[i], soll->Y[i]));
-    //        LOG_INFO(adtf_util::cString::Format("----------------------------------"));
-    
+    // every solve, with the overruns and fallbacks so far
+    if (m_log) fprintf(m_log,"%f %d %d %f %f %d %d %d %d\n", ipoptDt, ipoptIterations, result.warm_started ? 1 : 0, car_speed, mpc_solution[4], current_car_state_flag,
+                       nmpc_overrun_counter, nmpc_fallback_replay_counter, nmpc_fallback_pursuit_counter);
+
+    RETURN_NOERROR;
+}
+
+/* Called every cycle, publishes the newest result of the worker thread */
+tResult SOP_AutonomousDriving::PollNMPCWorker(void)
+{
+    if(nmpc_async == NULL)
+        RETURN_NOERROR;
+
+    const NMPC_RESULT *result = nmpc_async->BeginTake();
+    if(result == NULL)
+        RETURN_NOERROR;
+
+    // the maneuver has changed while the problem was solved
+    if(result->car_state_flag == current_car_state_flag)
+        PublishNMPCResult(*result);
+    nmpc_async->EndTake();
+
+    RETURN_NOERROR;
+}
+
+/* Writes the predicted inputs of the last solve between two solves, every nmpc_replay_interval.
+ * The sequence is indexed by the time since its problem was built and interpolated linearly
+ * between the stages, so the MPC itself can run at a lower rate.
+ */
+tResult SOP_AutonomousDriving::ReplayNMPCInputs(void)
+{
+    if(nmpc_replay_interval <= 0 || mpc_input_sequence_valid == tFalse || mpc_input_sequence_flag != current_car_state_flag)
+        RETURN_NOERROR;
+
+    timeval ts;
     gettimeofday(&ts, 0);
-    ipoptStartTime = ts.tv_sec * 1000000 + ts.tv_usec;
-    
-    
-    if(MPC_parameter->MPC_car_state_flag == LANE_FOLLOW)
+    long current_time = ts.tv_sec * 1000000 + ts.tv_usec;
+
+    // only while CalculateMPC is called, a maneuver which has stopped the car is not driven on
+    if(current_time - nmpc_last_problem_time > 2 * MPC_sampling_rate * 1000)
+        RETURN_NOERROR;
+    if(current_time - nmpc_last_replay_time < nmpc_replay_interval * 1000)
+        RETURN_NOERROR;
+    nmpc_last_replay_time = current_time;
+
+    double stage = ((current_time - mpc_input_sequence_time) / 1000000.) / DT;
+    int k = (int)floor(stage);
+    if(k < 0)
+        RETURN_NOERROR;
+
+    if(k >= N - 1)
     {
-        Xini[0] = 0; // X Messwerte
-        Xini[1] = 0; // Y Messwerte
-        Xini[2] = 0; // Psi Messwerte
+        // the end of the horizon is held until the next solve
+        WriteSteeringAndSpeed(mpc_input_sequence[N-1][0], mpc_input_sequence[N-1][1]);
     }
     else
     {
+        double frac = stage - k;
+        WriteSteeringAndSpeed((1.0 - frac) * mpc_input_sequence[k][0] + frac * mpc_input_sequence[k+1][0],
+                              (1.0 - frac) * mpc_input_sequence[k][1] + frac * mpc_input_sequence[k+1][1]);
+    }
 
-        //car_cur_position.X_Position
+    RETURN_NOERROR;
+}
 
-        Xini[0] =  estimates(0); // X Messwerte
-        Xini[1] =  estimates(1); // Y Messwerte
-        Xini[2] =  estimates(2); // Psi Messwerte
+/* Inputs for a result whose solution can not be used, from the problem it was solved for: in the
+ * worker thread the problem of the cycle may be a newer one already.
+ */
+tResult SOP_AutonomousDriving::CalculateFallbackControl(const NMPC_RESULT& result, long current_time)
+{
+    // replay the last optimal input sequence as long as it reaches into the present
+    if(mpc_input_sequence_valid == tTrue && result.car_state_flag == mpc_input_sequence_flag)
+    {
+        int k = (int)(((current_time - mpc_input_sequence_time) / 1000000.) / DT + 0.5);
+        if(k < N)
+        {
+            nmpc_fallback_replay_counter++;
+            WriteSteeringAndSpeed(mpc_input_sequence[k][0], mpc_input_sequence[k][1]);
+            RETURN_NOERROR;
+        }
     }
+    mpc_input_sequence_valid = tFalse;
+
+    // pure pursuit on the reference, in the frame of the problem of the result
+    double speed = result.upper[3];
+    double heading = result.initial_state[2];
+    int target = N;
+    double look_ahead = 0;
+    for(int i = 1; i <= N; i++)
+    {
+        look_ahead = GetDistanceBetweenCoordinates(result.reference.X[i], result.reference.Y[i], result.initial_state[0], result.initial_state[1]);
+        if(look_ahead >= nmpc_pure_pursuit_look_ahead)
+        {
+            target = i;
+            break;
+        }
+    }
+    double dx = result.reference.X[target] - result.initial_state[0];
+    double dy = result.reference.Y[target] - result.initial_state[1];
+    double lx =  cos(heading) * dx + sin(heading) * dy;
+    double ly = -sin(heading) * dx + cos(heading) * dy;
 
-#ifdef OUTPUT_EKF_DEBUG
-    //LOG_INFO(adtf_util::cString::Format("%g %g",estimates(2), car_cur_position.HeadingAngle));
-//    LOG_INFO(adtf_util::cString::Format("****SENSORS Heading %g ****", car_cur_position.HeadingAngle));
-#endif
+    double steering = 0;
+    if(look_ahead > 0.01)
+    {
+        if(speed >= 0)
+            steering = atan(2.0 * l * sin(atan2(ly, lx)) / look_ahead);
+        else
+            steering = -atan(2.0 * l * sin(atan2(-ly, -lx)) / look_ahead);
+    }
+    if(steering > result.upper[4])
+        steering = result.upper[4];
+    else if(steering < result.lower[4])
+        steering = result.lower[4];
 
-    status = app->OptimizeTNLP(mynlp);
+    nmpc_fallback_pursuit_counter++;
+    WriteSteeringAndSpeed(speed, steering);
 
-    //LOG_INFO(adtf_util::cString::Format("****Current inputs: V=%g Theta=%g ****",XX[3], XX[4]));
-    gettimeofday(&ts, 0);
-    long ipoptTime = ts.tv_sec * 1000000 + ts.tv_usec;
-    ipoptDt = (ipoptTime - ipoptStartTime) / 1000000.;
-    //    std::cout << "Ipopt time measurement: " << ipoptDt << std::endl;
+    RETURN_NOERROR;
+}
 
-    //if (m_log) fprintf(m_log,"%f %f %f %d\n", ipoptDt, car_speed, XX[4], current_car_state_flag);
-    
-    mpcIdx += 1;
-    
-    if(XX[4] == 0)
+tResult SOP_AutonomousDriving::WriteSteeringAndSpeed(double speed, double steering)
+{
+    if(steering == 0)
         output_steering = 0;
-    else if(XX[4] > 0)
-        output_steering = (XX[4] * RADIAN_TO_DEGREES) * POSITIVE_STEERING_ANGLE_TO_PERCENT;
-    else if(XX[4] < 0)
-        output_steering = (XX[4] * RADIAN_TO_DEGREES) * NEGATIVE_STEERING_ANGLE_TO_PERCENT;
+    else if(steering > 0)
+        output_steering = (steering * RADIAN_TO_DEGREES) * POSITIVE_STEERING_ANGLE_TO_PERCENT;
+    else if(steering < 0)
+        output_steering = (steering * RADIAN_TO_DEGREES) * NEGATIVE_STEERING_ANGLE_TO_PERCENT;
     WriteSignalValue(&steering_output, -output_steering, 0);
-    WriteSignalValue(&speed_output, XX[3], 0);
+    WriteSignalValue(&speed_output, speed, 0);
 
-    last_mpc_steering = XX[4];
-    last_speed = XX[3];
+    last_mpc_steering = steering;
+    last_speed = speed;
     last_steering = -output_steering;
 
-    
-    //    curvefitting();
-
     RETURN_NOERROR;
 }
 
+/* Path of the car for the collision checks, y = a*x^2 + b*x in cm in the frame of the car (x forward,
+ * y to the right) as car_curve_a/b: the predicted trajectory of a solve which was written to the car,
+ * the reference the fallback pursues otherwise. Both are fitted in one batch, y/x = b + a*x through
+ * the car, points closer than NMPC_PATH_CURVE_MIN_X in front of or behind the car are left out.
+ */
+void SOP_AutonomousDriving::FitNMPCPathCurve(const NMPC_RESULT& result, tBool used)
+{
+    double reference_x[N];
+    double reference_y[N];
+    double path_x[N];
+    double path_y[N];
+    double reference_curve[2];
+    double path_curve[2];
+    POLYNOMIAL_FIT_SET sets[2];
+    double heading = result.initial_state[2];
+
+    sets[0].x = reference_x;
+    sets[0].y = reference_y;
+    sets[0].size = 0;
+    sets[0].coefficients = reference_curve;
+    sets[1].x = path_x;
+    sets[1].y = path_y;
+    sets[1].size = 0;
+    sets[1].coefficients = path_curve;
+
+    for(int k = 1; k <= N; k++)
+    {
+        double dx = result.reference.X[k] - result.initial_state[0];
+        double dy = result.reference.Y[k] - result.initial_state[1];
+        double x = 100.0 * ( cos(heading) * dx + sin(heading) * dy);
+        double y = 100.0 * ( sin(heading) * dx - cos(heading) * dy);
+        if(fabs(x) >= NMPC_PATH_CURVE_MIN_X)
+        {
+            reference_x[sets[0].size] = x;
+            reference_y[sets[0].size] = y / x;
+            sets[0].size++;
+        }
+
+        dx = result.solution[k*NXU + 0] - result.initial_state[0];
+        dy = result.solution[k*NXU + 1] - result.initial_state[1];
+        x = 100.0 * ( cos(heading) * dx + sin(heading) * dy);
+        y = 100.0 * ( sin(heading) * dx - cos(heading) * dy);
+        if(fabs(x) >= NMPC_PATH_CURVE_MIN_X)
+        {
+            path_x[sets[1].size] = x;
+            path_y[sets[1].size] = y / x;
+            sets[1].size++;
+        }
+    }
+
+    // the trajectory of a solve which was not written is not the path of the car
+    int fitted = PolynomialFit<1>::FitBatch(sets, (used == tTrue) ? 2 : 1);
+
+    nmpc_path_curve_valid = tFalse;
+    if(used == tTrue && fitted == 2)
+    {
+        nmpc_path_curve[0] = path_curve[1];
+        nmpc_path_curve[1] = path_curve[0];
+        nmpc_path_curve_valid = tTrue;
+    }
+    else if(used == tFalse && fitted == 1)
+    {
+        nmpc_path_curve[0] = reference_curve[1];
+        nmpc_path_curve[1] = reference_curve[0];
+        nmpc_path_curve_valid = tTrue;
+    }
+    nmpc_path_curve_flag = result.car_state_flag;
+}
+
+/* car_curve_a/b from the last solve while the MPC drives the car (FitNMPCPathCurve), from the steering otherwise */
 tResult SOP_AutonomousDriving::curvefitting(void)
 {
- 
+    timeval ts;
+    gettimeofday(&ts, 0);
+    long current_time = ts.tv_sec * 1000000 + ts.tv_usec;
+
+    if(nmpc_path_curve_valid == tTrue && nmpc_path_curve_flag == current_car_state_flag
+            && current_time - nmpc_last_problem_time <= 2 * MPC_sampling_rate * 1000)
+    {
+        car_curve_a = nmpc_path_curve[0];
+        car_curve_b = nmpc_path_curve[1];
+        car_curve_c = 0;
+    }
+    else
     {
         if(output_steering == 0)
         {
@@ -1339,107 +1424,60 @@ tResult SOP_AutonomousDriving::curvefitting(void)
 tResult SOP_AutonomousDriving::ExtendedKF(void)
 {
     /* KALMAN FILTER */
-    funcs.resize(3);
     const double h = 0.00500; // Length of the time intervals in [s]
 
-    funcs[0] = dotX1;
-    funcs[1] = dotX2;
-    funcs[2] = dotX3;
-    rk4 = new RungeKutta(funcs, 3);
-    vector <double> res;
-//    LOG_INFO(adtf_util::cString::Format("****SENSORS Position in X Y: is equal to %g %g****",car_cur_position.X_Position, car_cur_position.Y_Position));
-    //     LOG_INFO(adtf_util::cString::Format("****Estimated Position in X Y: is equal to %g %g****",car_est_position.X_Position, car_est_position.Y_Position));
-    //LOG_INFO(adtf_util::cString::Format("SENSORS befor Haading: is equal to %g ",car_est_position.HeadingAngle ));
-    for(double t = 0; t < DT; t += h)
+    // prediction, the covariance is propagated with the Jacobian of every sub-step
+    //BicycleInput u(last_speed, last_mpc_steering);
+    BicycleInput u(car_speed, last_mpc_steering);
+    BicycleState x = estimates;
+    BicycleStateJacobian A;
+    if(ekf_arc_prediction)
     {
-        // Control and State arrays for Runge-Kutta method
-        //double uu[] = {XX[3], XX[4]};
-        //double uu[] = {car_speed, XX[4]};
-       double uu[] = {car_speed, last_mpc_steering};
-  //       double uu[] = {last_speed, last_mpc_steering};
-
-        double xx[] = {estimates(0), estimates(1), estimates(2)};
-        // Calculate next step
-        res = rk4->calcState(xx, uu, h);
-
-        estimates(0) += res[0];
-        estimates(1) += res[1];
-        estimates(2) += res[2];
+        // the input is held over DT, one exact step instead of the sub-steps
+        BicycleArc(x, u, DT, estimates, A);
+        P = A * P * A.transpose();
+        P.diagonal() += ekf_process_noise * DT;
+    }
+    else
+    {
+        BicycleInputJacobian B;
+        int steps = (int)(DT / h + 0.5);
+        for(int i = 0; i < steps; i++)
+        {
+            BicycleIntegrate(x, u, h, estimates, A, B);
+            x = estimates;
+            P = A * P * A.transpose();
+            P.diagonal() += ekf_process_noise * h;
+        }
     }
 
+    // correction, the heading wraps at +-pi
+    double heading_error = car_cur_position.HeadingAngle - estimates(2);
+    heading_error -= 2.0 * M_PI * floor((heading_error + M_PI) / (2.0 * M_PI));
 
     if(car_cur_position.radius < 0.5 /*&& road_marker_ID != NO_TRAFFIC_SIGN*/)
     {
-        sensors(0) = car_cur_position.X_Position; // Should be the data from sensors X
-        sensors(1) = car_cur_position.Y_Position;  // Should be the data from sensors Y
-        sensors(2) = car_cur_position.HeadingAngle; // Should be the data from sensors PSI
-
-        PP = 0.5;
+        // the position is measured as well, H = I
+        Vector3d innovation(car_cur_position.X_Position - estimates(0), car_cur_position.Y_Position - estimates(1), heading_error);
+        Matrix3d S = P;
+        S.diagonal() += ekf_measurement_noise;
+        Matrix3d KG = P * S.inverse();
+        estimates += KG * innovation;
+        P = (Matrix3d::Identity() - KG) * P;
     }
     else
     {
-        sensors(0) = estimates(0); // Should be the data from sensors X
-        sensors(1) = estimates(1);  // Should be the data from sensors Y
-        sensors(2) = car_cur_position.HeadingAngle; // Should be the data from sensors PSI
+        // the heading only, H = [0 0 1]
+        Vector3d KG = P.col(2) / (P(2, 2) + ekf_measurement_noise(2));
+        estimates += KG * heading_error;
+        P -= KG * P.row(2);
     }
-
+    estimates(2) -= 2.0 * M_PI * floor((estimates(2) + M_PI) / (2.0 * M_PI));
 
     car_est_position.X_Position =  estimates(0); // X Messwerte
     car_est_position.Y_Position =  estimates(1); // Y Messwerte
     car_est_position.HeadingAngle =  estimates(2); // Psi Messwerte
 
-
-
-    // Compute transition matrix
-    //
-    /*F << 1, 0, -sin(estimates(2) + ((lf/(lf+lr))*XX[4]))*XX[3]*DT,
-          0, 1,  cos(estimates(2) + ((lf/(lf+lr))*XX[4]))*XX[3]*DT,
-          0, 0, 1;*/
-    /*
-    F << 1, 0, -sin(estimates(2) + ((lf/(lf+lr))*XX[4]))*car_speed*DT,
-          0, 1,  cos(estimates(2) + ((lf/(lf+lr))*XX[4]))*car_speed*DT,
-          0, 0, 1;
-
-    H << 1, 0, 0,
-         0, 1, 0,
-         0, 0, 1;
-
-    Q << 0.00001, 0,  0,
-          0, 0.000001, 0,
-          0,  0, 0.000001;
-
-    R <<  10, 0,  0,
-          0,  10, 0,
-          0,  0, 10;
-    */
-
-//    if(car_cur_position.radius > 0.5)
-    {
-        PP = FF * PP * FF + QQ;
-
-        //Matrix3d T = (H * P * H.transpose() + R);
-        double TT = (HH * PP * HH + RR);
-        /*
-        I << 1, 0, 0,
-             0, 1, 0,
-             0, 0, 1;
-        */
-        //T = T.inverse().eval();
-        TT = 1.0/TT;
-        //Matrix3d KG = P * H.transpose() * T;
-        double KG = PP * HH * TT;
-        if(fabs(last_heading - car_cur_position.HeadingAngle) > 3.0)
-            estimates(2) =( estimates(2) * -1.0 );
-        //estimates = estimates + KG * (sensors - H * estimates);
-
-            estimates(2) = estimates(2) + KG * (sensors(2) - HH * estimates(2));
-
-        //P = (I - KG * H) * P;
-        PP = (1.0 - KG * HH) * PP;
-    }
-
-    last_heading = car_cur_position.HeadingAngle;
-
     /* KALMAN FILTER END */
 
     tFloat32 EKF_position_value[5];
@@ -1462,54 +1500,537 @@ tResult SOP_AutonomousDriving::ResetExtendedKF(void)
     estimates(0) = car_cur_position.X_Position ;
     estimates(1) = car_cur_position.Y_Position;
     estimates(2) = car_cur_position.HeadingAngle;
-    last_heading = car_cur_position.HeadingAngle;
+    P = ekf_measurement_noise.asDiagonal();
     //    LOG_INFO(adtf_util::cString::Format("ResetExtendedKF position_value[X]    [Y] %f %f  Heading %f", estimates(0), estimates(1), estimates(2)));
 
     RETURN_NOERROR;
 }
 
 
-tResult SOP_AutonomousDriving::CloseIpopt(void)
+tResult SOP_AutonomousDriving::SetNMPCSolvers(void)
 {
-    app->~IpoptApplication();
-    app->~ReferencedObject();
-    free(soll);
-    free(MPC_parameter);
-    
-    
+    // SetIpopt() has created the NLP, the Ipopt backend only wraps it
+    nmpc_ipopt_solver = new NMPC_IpoptSolver();
+    nmpc_ipopt_solver->SetWarmStart(nmpc_warm_start == tTrue);
+    SetNMPCMoveBlocking();
+    nmpc_solver[NMPC_BACKEND_IPOPT] = nmpc_ipopt_solver;
+    nmpc_solver[NMPC_BACKEND_RTI] = new NMPC_RTISolver();
+
+    // lane following from the table of Tools/NMPC_Table_Generator, everything else by Ipopt
+    cFilename fileTable = GetPropertyStr("NMPC::Backend::Lookup table");
+    ADTF_GET_CONFIG_FILENAME(fileTable);
+    fileTable = fileTable.CreateAbsolutePath(".");
+#if(CAMERA_DISTANCE == 0)
+    double table_start_x = 1;
+#else
+    double table_start_x = CAMERA_DISTANCE;
+#endif
+    nmpc_table_solver = new NMPC_LookupTableSolver(nmpc_ipopt_solver, fileTable.GetPtr(), table_start_x);
+    nmpc_solver[NMPC_BACKEND_TABLE] = nmpc_table_solver;
+
+    for(int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        if(!nmpc_solver[i]->Setup())
+        {
+            LOG_ERROR(adtf_util::cString::Format("NMPC backend %s can not be set up", nmpc_solver[i]->GetName()));
+            RETURN_ERROR(ERR_NOT_INITIALISED);
+        }
+        // Ipopt itself only knows CPU time and iteration caps, the wall clock is checked after the solve
+        nmpc_solver[i]->SetLimits(nmpc_solve_budget, nmpc_max_iterations);
+        nmpc_backend_time_sum[i] = 0;
+        nmpc_backend_solve_counter[i] = 0;
+    }
+
+    if(nmpc_backend_lane_follow < 0 || nmpc_backend_lane_follow >= NMPC_BACKEND_COUNT)
+        nmpc_backend_lane_follow = NMPC_BACKEND_IPOPT;
+    if(nmpc_backend_maneuver < 0 || nmpc_backend_maneuver >= NMPC_BACKEND_COUNT)
+        nmpc_backend_maneuver = NMPC_BACKEND_IPOPT;
+    if(!nmpc_table_solver->IsLoaded() && (nmpc_backend_lane_follow == NMPC_BACKEND_TABLE || nmpc_backend_maneuver == NMPC_BACKEND_TABLE))
+        LOG_WARNING(adtf_util::cString::Format("NMPC lookup table %s not loaded, all problems are solved by Ipopt", fileTable.GetPtr()));
+    // only the real-time iteration respects the obstacle, with any other backend the avoidance maneuver stays on
+    if(nmpc_obstacle_constraints == tTrue && (nmpc_backend_lane_follow != NMPC_BACKEND_RTI || nmpc_backend_maneuver != NMPC_BACKEND_RTI))
+    {
+        LOG_WARNING("NMPC obstacles need the real-time iteration for lane following and maneuvers, the avoidance maneuver is used");
+        nmpc_obstacle_constraints = tFalse;
+    }
+    if(nmpc_horizon_nominal_speed > 0 && nmpc_backend_lane_follow != NMPC_BACKEND_RTI && nmpc_backend_maneuver != NMPC_BACKEND_RTI)
+        LOG_INFO("NMPC horizon: only the real-time iteration changes its horizon, Ipopt and the lookup table solve N stages");
+
+    // BuildNMPCWeightProfiles() has run, the profile table is the only source of weights
+    mpc_weights = nmpc_weight_profile[NMPC_PROFILE_DEFAULT][NMPC_PROFILE_AXIS_X];
+    mpc_speed_reference = 0.5;
+    mpc_horizon = N;
+    mpc_obstacle_count = 0;
+    mpc_car_state_flag = CAR_STOP;
+    memset(&mpc_reference, 0, sizeof(mpc_reference));
+    memset(mpc_initial_state, 0, sizeof(mpc_initial_state));
+    memset(mpc_solution, 0, sizeof(mpc_solution));
+    memset(ref_lane_coefficients, 0, sizeof(ref_lane_coefficients));
+    initialize_bounds();
+
+    last_mpc_start_time = 0;
+    nmpc_overrun_counter = 0;
+    nmpc_overrun_logged_counter = 0;
+    nmpc_last_overrun_log_time = 0;
+    nmpc_fallback_replay_counter = 0;
+    nmpc_fallback_pursuit_counter = 0;
+    mpc_input_sequence_time = 0;
+    mpc_input_sequence_flag = CAR_STOP;
+    mpc_input_sequence_valid = tFalse;
+    nmpc_path_curve_flag = CAR_STOP;
+    nmpc_path_curve_valid = tFalse;
+    nmpc_last_problem_time = 0;
+    nmpc_last_replay_time = 0;
+    nmpc_seed_flag = CAR_STOP;
+    nmpc_seed_valid = tFalse;
+
+    // before the worker thread below solves on the backends
+    RETURN_IF_FAILED(PrewarmNMPCSolvers());
+
+    if(nmpc_speculation_enabled == tTrue)
+    {
+        nmpc_speculation = new NMPC_ManeuverSpeculation();
+        RETURN_IF_FAILED(nmpc_speculation->Create());
+    }
+    if(nmpc_benchmark_backends == tTrue)
+    {
+        nmpc_benchmark = new NMPC_BenchmarkWorker(m_log);
+        RETURN_IF_FAILED(nmpc_benchmark->Create(fileTable.GetPtr(), table_start_x, nmpc_solve_budget, nmpc_max_iterations));
+    }
+    if(nmpc_async_enabled == tTrue)
+    {
+        nmpc_async = new NMPC_AsyncWorker(this, nmpc_benchmark);
+        RETURN_IF_FAILED(nmpc_async->Create());
+    }
+
+    LOG_INFO(adtf_util::cString::Format("NMPC backends: lane following %s, maneuvers %s, warm start %s, speculative maneuver solve %s",
+                                        nmpc_solver[nmpc_backend_lane_follow]->GetName(), nmpc_solver[nmpc_backend_maneuver]->GetName(),
+                                        nmpc_warm_start ? "on" : "off", nmpc_speculation_enabled ? "on" : "off"));
+    LOG_INFO(adtf_util::cString::Format("NMPC solve budget: %g ms, %d iterations, %s", nmpc_solve_budget, nmpc_max_iterations,
+                                        nmpc_async_enabled ? "worker thread" : "in Cycle"));
+
     RETURN_NOERROR;
 }
 
 
-void SOP_AutonomousDriving::initialize_bounds(){
-    
-    xupper[0] = 1e19;    // x-coordinate
-    xupper[1] = 1e19;//0.05;     // y-coordinate
-    xupper[2] = 2 * PI;    // psi
-    xupper[3] = vcc;    //vcc// velocity
-    xupper[4] = 0.436;//0.585;   // steering angle [rad]
-    xlower[0] = -1e19;//0;
-    xlower[1] = -1e19;//-0.05;
-    xlower[2] = -2 * PI;
-    xlower[3] = vcc;    //vcc// velocity
-    xlower[4] = -0.49;//-0.585                                                                                                                                                      ;
+/* Reads the blocks of "NMPC::Move blocking::Blocks", a comma separated list of stage counts */
+void SOP_AutonomousDriving::SetNMPCMoveBlocking(void)
+{
+    cString blocks_property = GetPropertyStr("NMPC::Move blocking::Blocks");
+    tBool eliminate_fixed_speed = GetPropertyBool("NMPC::Move blocking::Eliminate fixed speed");
+
+    int blocks[N];
+    int count = 0;
+    const char *text = blocks_property.GetPtr();
+    while(*text != '\0' && count < N)
+    {
+        char *end;
+        long length = strtol(text, &end, 10);
+        if(end == text)
+        {
+            text++;     // separator
+            continue;
+        }
+        blocks[count++] = static_cast<int>(length);
+        text = end;
+    }
+
+    nmpc_ipopt_solver->SetMoveBlocking(blocks, count, eliminate_fixed_speed == tTrue);
+    if(count > 0 || eliminate_fixed_speed)
+        LOG_INFO(adtf_util::cString::Format("NMPC move blocking: %d blocks, fixed speed %s", count,
+                                            eliminate_fixed_speed ? "eliminated" : "kept"));
+}
+
+
+/* Car state and maneuver library reference of every weight profile, -1 drives straight ahead */
+static const int nmpc_prewarm_flags[NMPC_PROFILE_COUNT] =
+{
+    LANE_FOLLOW, AVOIDANCE, TURN_LEFT, TURN_RIGHT, STRAIGHT, PULL_OUT_LEFT, PULL_OUT_RIGHT, PARKING
+};
+
+static const int nmpc_prewarm_references[NMPC_PROFILE_COUNT] =
+{
+    -1, MANEUVER_REFERENCE_AVOIDANCE_OUT, MANEUVER_REFERENCE_TURN_LEFT, MANEUVER_REFERENCE_TURN_RIGHT,
+    MANEUVER_REFERENCE_STRAIGHT, MANEUVER_REFERENCE_PULL_OUT_LEFT, MANEUVER_REFERENCE_PULL_OUT_RIGHT,
+    MANEUVER_REFERENCE_PARKING_FORWARD
+};
+
+/* Solves one problem of every weight profile with every backend before the first Cycle().
+ * Ipopt parses its options, allocates and analyses the sparsity of the KKT system on its first
+ * OptimizeTNLP, the decorators build their maps; that first solve takes a multiple of the later
+ * ones and must not be the first maneuver of the run. The solutions are thrown away and the
+ * warm start data is reset, the statistics of CloseIpopt() do not count these solves.
+ */
+tResult SOP_AutonomousDriving::PrewarmNMPCSolvers(void)
+{
+    if(nmpc_prewarm == tFalse)
+        RETURN_NOERROR;
+
+    NMPC_PROBLEM problem;
+    memset(&problem, 0, sizeof(problem));
+    problem.speed_reference = mpc_speed_reference;
+    problem.speed = mpc_speed_reference;
+    problem.horizon = N;
+    NMPCBounds(problem.speed_reference, problem.lower, problem.upper);
+
+    for(int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        NMPC_Solver *solver = nmpc_solver[i];
+        double first_time = 0;
+        double time_sum = 0;
+        int failed = 0;
+
+        for(int p = 0; p < NMPC_PROFILE_COUNT; p++)
+        {
+            TURN_AROUND_REFERENCE_COORDINATE reference;
+            int size = 0;
+            if(nmpc_prewarm_references[p] >= 0)
+                size = ManeuverLibraryReference(nmpc_prewarm_references[p], &reference);
+            for(int k = 0; k <= N; k++)
+            {
+                problem.reference.X[k] = (size > N) ? reference.X[k] : k * problem.speed_reference * DT;
+                problem.reference.Y[k] = (size > N) ? reference.Y[k] : 0;
+            }
+            problem.backend = i;
+            problem.car_state_flag = nmpc_prewarm_flags[p];
+            problem.weights = nmpc_weight_profile[p][NMPC_PROFILE_AXIS_X];
+
+            timeval ts;
+            gettimeofday(&ts, 0);
+            long start_time = ts.tv_sec * 1000000 + ts.tv_usec;
+
+            solver->Reset();
+            SetNMPCProblem(solver, nmpc_table_solver, problem);
+            if(!solver->Solve(problem.car_state_flag, 0))
+                failed++;
+
+            gettimeofday(&ts, 0);
+            double dt = ((ts.tv_sec * 1000000 + ts.tv_usec) - start_time) / 1000.;
+            if(p == 0)
+                first_time = dt;
+            else
+                time_sum += dt;
+        }
+        solver->Reset();
+
+        LOG_INFO(adtf_util::cString::Format("NMPC %s pre-warmed: first solve %g ms, %d profiles after it %g ms mean, %d not converged",
+                                            solver->GetName(), first_time, NMPC_PROFILE_COUNT - 1,
+                                            time_sum / (NMPC_PROFILE_COUNT - 1), failed));
+    }
+
+    RETURN_NOERROR;
+}
+
+
+/* The nearest tracked obstacle in the path of the car within the detection range, in the frame of
+ * mpc_initial_state: the car frame for lane following, the map for all maneuvers. Without
+ * "Avoidance::Obstacles in NMPC" there is none.
+ */
+void SOP_AutonomousDriving::SetNMPCObstacles(void)
+{
+    mpc_obstacle_count = 0;
+    if(nmpc_obstacle_constraints == tFalse)
+        return;
+    const ULTRASONIC_TRACK *track = FrontTrack(static_cast<float>(obstacle_detect_distance + (29)));
+    if(track == NULL)
+        return;
+
+    // the track is in cm, x forward from the front sensors and y to the right
+    double car_x = (track->x + (29)) * 0.01;
+    double car_y = track->y * -0.01;
+
+    NMPC_OBSTACLE& obstacle = mpc_obstacles[mpc_obstacle_count++];
+    if(mpc_car_state_flag == LANE_FOLLOW)
+    {
+        obstacle.x = car_x;
+        obstacle.y = car_y;
+    }
+    else
+    {
+        double c = cos(car_est_position.HeadingAngle);
+        double s = sin(car_est_position.HeadingAngle);
+        obstacle.x = c * car_x - s * car_y + car_est_position.X_Position;
+        obstacle.y = s * car_x + c * car_y + car_est_position.Y_Position;
+    }
+    obstacle.clearance = nmpc_obstacle_clearance;
+    obstacle.weight = nmpc_obstacle_weight;
+}
+
+
+/* Horizon of the NMPC for a reference speed: N stages at the nominal speed, a fast car looks
+ * further ahead and a slow one, parking for example, does with fewer stages, the QP of the
+ * real-time iteration grows with the cube of the horizon. The reference of the maneuvers has N
+ * points, only lane following samples up to NMPC_MAX_HORIZON. The NLP of Ipopt and the table
+ * have N stages.
+ */
+int SOP_AutonomousDriving::NMPCHorizon(int backend, int car_state_flag, double speed)
+{
+    if(backend != NMPC_BACKEND_RTI || nmpc_horizon_nominal_speed <= 0)
+        return N;
+
+    int max_stages = (car_state_flag == LANE_FOLLOW) ? NMPC_MAX_HORIZON : N;
+    int stages = static_cast<int>(ceil(N * fabs(speed) / nmpc_horizon_nominal_speed));
+    if(stages < nmpc_horizon_min)
+        stages = nmpc_horizon_min;
+    if(stages > max_stages)
+        stages = max_stages;
+    return stages;
 }
 
 
-double dotX1(double *sVars, double *uu, double h)
+/* Profile of the weights of a car state, lane following is weighted by LaneFollowWeights() */
+int SOP_AutonomousDriving::NMPCProfile(int car_state_flag)
 {
-    return h * (uu[0]*cos((sVars[2]+((lf/l)*uu[1]))));
+    switch(car_state_flag)
+    {
+    case AVOIDANCE:
+        return NMPC_PROFILE_AVOIDANCE;
+    case TURN_LEFT:
+        return NMPC_PROFILE_TURN_LEFT;
+    case TURN_RIGHT:
+        return NMPC_PROFILE_TURN_RIGHT;
+    case STRAIGHT:
+        return NMPC_PROFILE_STRAIGHT;
+    case PULL_OUT_LEFT:
+        return NMPC_PROFILE_PULL_OUT_LEFT;
+    case PULL_OUT_RIGHT:
+        return NMPC_PROFILE_PULL_OUT_RIGHT;
+    case PARKING:
+        return NMPC_PROFILE_PARKING;
+    default:
+        return NMPC_PROFILE_DEFAULT;
+    }
+}
+
+
+static const char *nmpc_profile_names[NMPC_PROFILE_COUNT] =
+{
+    "default", "avoidance", "turn_left", "turn_right", "straight", "pull_out_left", "pull_out_right", "parking"
+};
+
+static double NMPC_WEIGHTS::* const nmpc_weight_fields[] =
+{
+    &NMPC_WEIGHTS::Qx, &NMPC_WEIGHTS::QxN, &NMPC_WEIGHTS::Qy, &NMPC_WEIGHTS::QyN, &NMPC_WEIGHTS::Qpsi,
+    &NMPC_WEIGHTS::Rv, &NMPC_WEIGHTS::Rd, &NMPC_WEIGHTS::CHGsa, &NMPC_WEIGHTS::CHGss
+};
+
+static const char *nmpc_weight_field_names[] =
+{
+    "Qx", "QxN", "Qy", "QyN", "Qpsi", "Rv", "Rd", "CHGsa", "CHGss"
+};
+
+#define NMPC_WEIGHT_FIELD_COUNT (int(sizeof(nmpc_weight_field_names) / sizeof(nmpc_weight_field_names[0])))
+
+/* a weight is finite and not negative, NaN fails the first comparison */
+static bool NMPCWeightsValid(const NMPC_WEIGHTS& weights)
+{
+    for(int i = 0; i < NMPC_WEIGHT_FIELD_COUNT; i++)
+    {
+        double w = weights.*nmpc_weight_fields[i];
+        if(!(w >= 0) || w > 1e19)
+            return false;
+    }
+    return true;
+}
+
+
+/* Weight profiles of CalculateMPC, indexed by NMPC_PROFILE and NMPC_PROFILE_AXIS.
+ * The weights of the properties belong to the frame of the road (Qx along, Qy across it), the
+ * file "NMPC::Weight profiles" may replace them. A road along the Y axis swaps Qx and Qy.
+ */
+tResult SOP_AutonomousDriving::BuildNMPCWeightProfiles(void)
+{
+    //                                                  Qx  QxN  Qy  QyN Qpsi Rv  Rd CHGsa CHGss
+    const NMPC_WEIGHTS default_weights =                {20, 2,  5,  5,  2,  1,  1,  0.5, 3.0};
+    const NMPC_WEIGHTS avoidance_weights =              {weightFact_Avoidance_X, 2, weightFact_Avoidance_Y, 1, 2, 1, 1, 1.0, 3.0};
+    const NMPC_WEIGHTS turn_left_weights =              {weightFact_TurnLeft_X, 2, weightFact_TurnLeft_Y, 1, 2, 1, 1, 1.0, 3.0};
+    const NMPC_WEIGHTS turn_right_weights =             {weightFact_TurnRight_X, 2, weightFact_TurnRight_Y, 1, 2, 1, 1, 1.0, 3.0};
+    const NMPC_WEIGHTS straight_weights =               {weightFact_Straight_X, 2, weightFact_Straight_Y, 1, 2, 1, 1, 1.0, 3.0};
+    const NMPC_WEIGHTS pull_out_left_weights =          {weightFact_PullOutLeft_X, 2, weightFact_PullOutLeft_Y, 5, 2, 1, 1, 1.0, 3.0};
+    const NMPC_WEIGHTS pull_out_right_weights =         {weightFact_PullOutRight_X, 5, weightFact_PullOutRight_Y, 5, 2, 1, 1, 1.0, 3.0};
+    const NMPC_WEIGHTS parking_weights =                {weightFact_Parking_X, 2, weightFact_Parking_Y, 0, 2, 1, 1, 0.0, 3.0};
+
+    NMPC_WEIGHTS road_frame[NMPC_PROFILE_COUNT];
+    road_frame[NMPC_PROFILE_DEFAULT] = default_weights;
+    road_frame[NMPC_PROFILE_AVOIDANCE] = avoidance_weights;
+    road_frame[NMPC_PROFILE_TURN_LEFT] = turn_left_weights;
+    road_frame[NMPC_PROFILE_TURN_RIGHT] = turn_right_weights;
+    road_frame[NMPC_PROFILE_STRAIGHT] = straight_weights;
+    road_frame[NMPC_PROFILE_PULL_OUT_LEFT] = pull_out_left_weights;
+    road_frame[NMPC_PROFILE_PULL_OUT_RIGHT] = pull_out_right_weights;
+    road_frame[NMPC_PROFILE_PARKING] = parking_weights;
+
+    RETURN_IF_FAILED(LoadNMPCWeightProfiles(road_frame));
+
+    for(int i = 0; i < NMPC_PROFILE_COUNT; i++)
+    {
+        if(!NMPCWeightsValid(road_frame[i]))
+        {
+            LOG_ERROR(adtf_util::cString::Format("NMPC weight profile %s has a negative or infinite weight", nmpc_profile_names[i]));
+            RETURN_ERROR(ERR_INVALID_ARG);
+        }
+
+        nmpc_weight_profile[i][NMPC_PROFILE_AXIS_X] = road_frame[i];
+        nmpc_weight_profile[i][NMPC_PROFILE_AXIS_Y] = road_frame[i];
+        // the default weights do not depend on the road
+        if(i != NMPC_PROFILE_DEFAULT)
+        {
+            nmpc_weight_profile[i][NMPC_PROFILE_AXIS_Y].Qx = road_frame[i].Qy;
+            nmpc_weight_profile[i][NMPC_PROFILE_AXIS_Y].Qy = road_frame[i].Qx;
+        }
+    }
+
+    RETURN_NOERROR;
+}
+
+
+/* Reads the file of "NMPC::Weight profiles":
+ *   <profiles>
+ *     <profile name="turn_left" Qx="20" Qy="40" QyN="1"/>
+ *   </profiles>
+ * An attribute replaces one weight of the profile in the frame of the road, a profile with an
+ * invalid weight is ignored as a whole. A missing or unreadable file keeps the properties, Start()
+ * goes on.
+ */
+tResult SOP_AutonomousDriving::LoadNMPCWeightProfiles(NMPC_WEIGHTS *road_frame)
+{
+    cFilename fileProfiles = GetPropertyStr("NMPC::Weight profiles");
+    if(fileProfiles.IsEmpty())
+        RETURN_NOERROR;
+
+    ADTF_GET_CONFIG_FILENAME(fileProfiles);
+    fileProfiles = fileProfiles.CreateAbsolutePath(".");
+    if(!cFileSystem::Exists(fileProfiles))
+    {
+        LOG_WARNING(adtf_util::cString::Format("NMPC weight profiles %s do not exist, the properties are used", fileProfiles.GetPtr()));
+        RETURN_NOERROR;
+    }
+
+    cDOM oDOM;
+    if(IS_FAILED(oDOM.Load(fileProfiles)))
+    {
+        LOG_WARNING(adtf_util::cString::Format("NMPC weight profiles %s are no valid XML, the properties are used", fileProfiles.GetPtr()));
+        RETURN_NOERROR;
+    }
+    cDOMElementRefList oElems;
+    if(IS_FAILED(oDOM.FindNodes("profiles/profile", oElems)))
+    {
+        LOG_WARNING(adtf_util::cString::Format("NMPC weight profiles %s have no profile, the properties are used", fileProfiles.GetPtr()));
+        RETURN_NOERROR;
+    }
+
+    for(cDOMElementRefList::iterator itElem = oElems.begin(); itElem != oElems.end(); ++itElem)
+    {
+        cString name = (*itElem)->GetAttribute("name", "");
+        int profile = 0;
+        while(profile < NMPC_PROFILE_COUNT && name != nmpc_profile_names[profile])
+            profile++;
+        if(profile == NMPC_PROFILE_COUNT)
+        {
+            LOG_ERROR(adtf_util::cString::Format("NMPC weight profiles: unknown profile %s", name.GetPtr()));
+            continue;
+        }
+
+        NMPC_WEIGHTS weights = road_frame[profile];
+        for(int i = 0; i < NMPC_WEIGHT_FIELD_COUNT; i++)
+        {
+            cString value = (*itElem)->GetAttribute(nmpc_weight_field_names[i], "");
+            if(!value.IsEmpty())
+                weights.*nmpc_weight_fields[i] = value.AsFloat64();
+        }
+        if(!NMPCWeightsValid(weights))
+        {
+            LOG_ERROR(adtf_util::cString::Format("NMPC weight profiles: profile %s has a negative or infinite weight, the properties are used", name.GetPtr()));
+            continue;
+        }
+        road_frame[profile] = weights;
+    }
+
+    RETURN_NOERROR;
+}
+
+
+/* Posts the next maneuver of the maneuver list to the background solve while a crossing is
+ * approached. The problem is the one CalculateMPC builds on the first tick of the maneuver,
+ * in the frame of the road (see ManeuverLocalReference).
+ */
+tResult SOP_AutonomousDriving::RequestManeuverSpeculation(void)
+{
+    if(nmpc_speculation == NULL)
+        RETURN_NOERROR;
+
+    int maneuver = ManeuverList.action[ManeuverList.id][0];
+    if(maneuver != TURN_LEFT && maneuver != TURN_RIGHT && maneuver != STRAIGHT)
+        RETURN_NOERROR;
+
+    double lower[NXU];
+    double upper[NXU];
+    NMPCBounds(no_lane_follow_speed, lower, upper);
+    nmpc_speculation->Request(maneuver, RoadQuadrantOffset(estimates(2)), no_lane_follow_speed,
+                              nmpc_weight_profile[NMPCProfile(maneuver)][NMPC_PROFILE_AXIS_X], lower, upper);
+
+    RETURN_NOERROR;
 }
 
-double dotX2(double *sVars, double *uu, double h)
+
+void SOP_AutonomousDriving::SetNMPCProblem(NMPC_Solver *solver, NMPC_LookupTableSolver *table, const NMPC_PROBLEM& problem)
 {
-    return h * (uu[0]*sin((sVars[2]+((lf/l)*uu[1]))));
+    solver->SetHorizon(problem.horizon);
+    solver->SetObstacles(problem.obstacles, problem.obstacle_count);
+    solver->SetWeights(problem.weights);
+    solver->SetBounds(problem.lower, problem.upper);
+    solver->SetReference(problem.reference, problem.speed_reference);
+    solver->SetInitialState(problem.initial_state, problem.speed, problem.steering);
+    if(solver == table && problem.car_state_flag == LANE_FOLLOW)
+        table->SetLaneCoefficients(problem.lane_coefficients);
 }
 
-double dotX3(double *sVars, double *uu, double h)
+
+tResult SOP_AutonomousDriving::CloseIpopt(void)
 {
-    return h * ((uu[0]/(lf + lr))*tan(uu[1]));
+    // the workers finish their solves first, the backends are deleted below
+    delete nmpc_async;
+    nmpc_async = NULL;
+    delete nmpc_benchmark;
+    nmpc_benchmark = NULL;
+
+    LOG_INFO(adtf_util::cString::Format("NMPC overruns: %d, replayed inputs: %d, pure pursuit: %d",
+                                        nmpc_overrun_counter, nmpc_fallback_replay_counter, nmpc_fallback_pursuit_counter));
+
+    for(int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        if(nmpc_solver[i] == NULL)
+            continue;
+        if(nmpc_backend_solve_counter[i] > 0)
+            LOG_INFO(adtf_util::cString::Format("NMPC %s: %d solves, mean %g ms", nmpc_solver[i]->GetName(), nmpc_backend_solve_counter[i],
+                                                nmpc_backend_time_sum[i] * 1000.0 / nmpc_backend_solve_counter[i]));
+    }
+
+    delete nmpc_speculation;
+    nmpc_speculation = NULL;
+
+    if(nmpc_ipopt_solver != NULL)
+        nmpc_ipopt_solver->Close();
+    for(int i = 0; i < NMPC_BACKEND_COUNT; i++)
+    {
+        delete nmpc_solver[i];
+        nmpc_solver[i] = NULL;
+    }
+    nmpc_ipopt_solver = NULL;
+    nmpc_table_solver = NULL;
+    
+    
+    RETURN_NOERROR;
 }
 
 
+void SOP_AutonomousDriving::initialize_bounds(){
+    
+    NMPCBounds(mpc_speed_reference, mpc_lower, mpc_upper);
+    mpc_bounds_speed = mpc_speed_reference;
+}
+
+
+
+
 
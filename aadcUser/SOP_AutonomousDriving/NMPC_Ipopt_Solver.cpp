@@ -0,0 +1,201 @@
+#include "NMPC_Ipopt_Solver.h"
+#include "IpIpoptApplication.hpp"
+
+#include "Nmpc/audi_q2_nlp.h"
+
+#include <cstdlib>
+#include <cstring>
+
+
+/* Data of the NLP in Nmpc/audi_q2_nlp.cpp, accessed by name */
+double Qx = 20;     // Weighting matrix for X-coordinate
+double QxN = 2;  // Weighting matrix for X-coordinate at final point
+double Qy = 5; 	 // Weighting matrix for Y-coordinate
+double QyN = 5;//5; 	 // Weighting matrix for Y-coordinate at final point
+double Qpsi = 2; // Weighting factor for heading
+double Rv = 1; 	 // Weighting matrix for velocity
+double Rd = 1;//3; 	 // Weighting matrix for steering angle
+double CHGsa = 1;
+double CHGss = 1;
+double Qrd = 1.5;
+double vcc = 0.5;
+
+double XX[N*NXU + NX];
+double LAMBDA[(N+1)*NX + N +1];
+double ZL[N*NXU + NX];
+double ZU[N*NXU + NX];
+MatrixXd dxdu(N*NX,NXU);
+double Xini[NX];
+double OUTPUT[(N+1)*NX];
+double xlower[NXU];
+double xupper[NXU];
+MatrixXd M(3,4); // Collocation matrix, derivatives of the Lagrange polynomials at collocation points
+
+COORDINATE_STRUCT *soll;
+MPC_PARAMETER *MPC_parameter;
+
+SmartPtr<TNLP> mynlp;
+SmartPtr<IpoptApplication> app;
+ApplicationReturnStatus status;
+
+/* the instance which owns the data above */
+static NMPC_IpoptSolver *ipopt_solver_owner = NULL;
+
+
+NMPC_IpoptSolver::NMPC_IpoptSolver()
+    : m_pWarmStartNLP(NULL),
+      m_pMoveBlockingNLP(NULL),
+      m_bWarmStart(false),
+      m_bWarmStarted(false),
+      m_bSetup(false),
+      m_nIterations(0)
+{
+    m_pMoveBlockingNLP = new NMPC_MoveBlockingNLP(N, NX, NXU);
+    m_pMoveBlockingTNLP = m_pMoveBlockingNLP;
+}
+
+NMPC_IpoptSolver::~NMPC_IpoptSolver()
+{
+    m_pWarmStartTNLP = NULL;
+    m_pMoveBlockingTNLP = NULL;
+    if (ipopt_solver_owner == this)
+        ipopt_solver_owner = NULL;
+}
+
+bool NMPC_IpoptSolver::Setup()
+{
+    if (ipopt_solver_owner != NULL && ipopt_solver_owner != this)
+        return false;
+    if (IsNull(app) || IsNull(mynlp) || soll == NULL || MPC_parameter == NULL)
+        return false;
+    ipopt_solver_owner = this;
+
+    m_pWarmStartTNLP = NULL;
+    m_pWarmStartNLP = new NMPC_WarmStartNLP(mynlp, N, NX, NXU, XX, ZL, ZU, LAMBDA);
+    m_pWarmStartTNLP = m_pWarmStartNLP;
+
+    // keep the warm started iterate away from the bounds only as far as necessary
+    app->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+    app->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+    app->Options()->SetStringValue("warm_start_init_point", "no");
+
+    m_bSetup = true;
+    return true;
+}
+
+void NMPC_IpoptSolver::Reset()
+{
+    if (m_pWarmStartNLP != NULL)
+        m_pWarmStartNLP->Invalidate();
+}
+
+void NMPC_IpoptSolver::SetLimits(double max_time_ms, int max_iterations)
+{
+    if (!m_bSetup)
+        return;
+    app->Options()->SetNumericValue("max_cpu_time", max_time_ms / 1000.0);
+    app->Options()->SetIntegerValue("max_iter", max_iterations);
+}
+
+void NMPC_IpoptSolver::SetReference(const COORDINATE_STRUCT& reference, double speed)
+{
+    memcpy(soll->X, reference.X, sizeof(soll->X));
+    memcpy(soll->Y, reference.Y, sizeof(soll->Y));
+    vcc = speed;
+}
+
+void NMPC_IpoptSolver::SetWeights(const NMPC_WEIGHTS& weights)
+{
+    Qx = weights.Qx;
+    QxN = weights.QxN;
+    Qy = weights.Qy;
+    QyN = weights.QyN;
+    Qpsi = weights.Qpsi;
+    Rv = weights.Rv;
+    Rd = weights.Rd;
+    CHGsa = weights.CHGsa;
+    CHGss = weights.CHGss;
+}
+
+void NMPC_IpoptSolver::SetBounds(const double *lower, const double *upper)
+{
+    memcpy(xlower, lower, sizeof(xlower));
+    memcpy(xupper, upper, sizeof(xupper));
+}
+
+void NMPC_IpoptSolver::SetInitialState(const double *x0, double /*speed*/, double /*steering*/)
+{
+    memcpy(Xini, x0, sizeof(Xini));
+}
+
+void NMPC_IpoptSolver::SetMoveBlocking(const int *lengths, int count, bool eliminate_fixed_speed)
+{
+    m_pMoveBlockingNLP->SetBlocks(lengths, count, eliminate_fixed_speed);
+}
+
+void NMPC_IpoptSolver::SetInitialGuess(const double *xx, int car_state_flag)
+{
+    if (m_bSetup)
+        m_pWarmStartNLP->Seed(xx, car_state_flag);
+}
+
+bool NMPC_IpoptSolver::Solve(int car_state_flag, double shift_steps)
+{
+    if (!m_bSetup)
+        return false;
+
+    MPC_parameter->MPC_car_state_flag = car_state_flag;
+
+    SmartPtr<TNLP> nlp = mynlp;
+    m_bWarmStarted = false;
+    if (m_bWarmStart || m_pWarmStartNLP->IsSeeded())
+    {
+        // shift the last solution by the time passed since the last solve and start from there,
+        // a seed of SetInitialGuess() is taken as it is
+        m_bWarmStarted = m_pWarmStartNLP->Prepare(car_state_flag, shift_steps, car_state_flag == LANE_FOLLOW);
+        app->Options()->SetStringValue("warm_start_init_point", m_bWarmStarted ? "yes" : "no");
+        app->Options()->SetNumericValue("mu_init", m_bWarmStarted ? 1e-4 : 0.1);
+        nlp = m_pWarmStartTNLP;
+    }
+
+    // the warm start keeps the full layout, the blocking sits on top of it
+    if (m_pMoveBlockingNLP->IsActive())
+    {
+        m_pMoveBlockingNLP->Wrap(nlp);
+        nlp = m_pMoveBlockingTNLP;
+    }
+    status = app->OptimizeTNLP(nlp);
+
+    if (IsValid(app->Statistics()))
+        m_nIterations = app->Statistics()->IterationCount();
+
+    // a solve which ran into the CPU time or iteration cap (or failed) is not used
+    return (status == Solve_Succeeded || status == Solved_To_Acceptable_Level);
+}
+
+void NMPC_IpoptSolver::GetInputs(double *speed, double *steering) const
+{
+    *speed = XX[3];
+    *steering = XX[4];
+}
+
+void NMPC_IpoptSolver::GetSolution(double *xx) const
+{
+    memcpy(xx, XX, sizeof(XX));
+}
+
+void NMPC_IpoptSolver::Close()
+{
+    m_pWarmStartTNLP = NULL;
+    m_pWarmStartNLP = NULL;
+    if (!m_bSetup)
+        return;
+    m_bSetup = false;
+
+    app->~IpoptApplication();
+    app->~ReferencedObject();
+    free(soll);
+    free(MPC_parameter);
+    soll = NULL;
+    MPC_parameter = NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef _NMPC_IPOPT_SOLVER_H_
+#define _NMPC_IPOPT_SOLVER_H_
+
+#include "NMPC_Solver.h"
+#include "NMPC_WarmStart.h"
+#include "NMPC_MoveBlocking.h"
+
+/*! Ipopt backend, solves the collocation NLP of Nmpc/audi_q2_nlp to convergence.
+ *
+ *  The NLP exchanges its data (soll, Xini, xlower/xupper, the weights, XX, ...) through
+ *  file-scope variables which are defined in NMPC_Ipopt_Solver.cpp and created by
+ *  SOP_AutonomousDriving::SetIpopt(). This class is the only user of them, so there can be
+ *  one Ipopt backend per process; a second instance refuses Setup().
+ */
+class NMPC_IpoptSolver : public NMPC_Solver
+{
+public:
+    NMPC_IpoptSolver();
+    virtual ~NMPC_IpoptSolver();
+
+    virtual const char* GetName() const { return "Ipopt"; }
+    /*! wraps the NLP created by SetIpopt(), which must have been called before */
+    virtual bool Setup();
+    virtual void Reset();
+    /*! Ipopt only knows a CPU time cap (max_cpu_time) and an iteration cap (max_iter) */
+    virtual void SetLimits(double max_time_ms, int max_iterations);
+    /*! the NLP has N stages, the horizon can not be changed */
+    virtual void SetHorizon(int /*stages*/) {}
+    virtual void SetReference(const COORDINATE_STRUCT& reference, double speed);
+    virtual void SetWeights(const NMPC_WEIGHTS& weights);
+    virtual void SetBounds(const double *lower, const double *upper);
+    virtual void SetInitialState(const double *x0, double speed, double steering);
+    /*! primal starting point of the next solve, see NMPC_WarmStartNLP::Seed() */
+    virtual void SetInitialGuess(const double *xx, int car_state_flag);
+    virtual bool Solve(int car_state_flag, double shift_steps);
+    virtual void GetInputs(double *speed, double *steering) const;
+    virtual void GetSolution(double *xx) const;
+    virtual int GetIterations() const { return m_nIterations; }
+
+    /*! starts every solve from the shifted solution of the last solve, see NMPC_WarmStartNLP */
+    void SetWarmStart(bool enable) { m_bWarmStart = enable; }
+    /*! \return true if the last solve was warm started */
+    bool IsWarmStarted() const { return m_bWarmStarted; }
+
+    /*! holds the inputs over blocks of stages, see NMPC_MoveBlockingNLP::SetBlocks() */
+    void SetMoveBlocking(const int *lengths, int count, bool eliminate_fixed_speed);
+
+    /*! releases Ipopt and the NLP data allocated by SetIpopt() */
+    void Close();
+
+private:
+    NMPC_WarmStartNLP *m_pWarmStartNLP;
+    Ipopt::SmartPtr<Ipopt::TNLP> m_pWarmStartTNLP;
+    NMPC_MoveBlockingNLP *m_pMoveBlockingNLP;
+    Ipopt::SmartPtr<Ipopt::TNLP> m_pMoveBlockingTNLP;
+    bool m_bWarmStart;
+    bool m_bWarmStarted;
+    bool m_bSetup;
+    int m_nIterations;
+};
+
+#endif // _NMPC_IPOPT_SOLVER_H_
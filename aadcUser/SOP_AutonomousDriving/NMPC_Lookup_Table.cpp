@@ -0,0 +1,285 @@
+#include "NMPC_Lookup_Table.h"
+#include "Bicycle_Model.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+NMPC_LookupTableSolver::NMPC_LookupTableSolver(NMPC_Solver *online, const char *file_name, double start_x)
+    : m_pOnline(online),
+      m_fStartX(start_x),
+      m_pWeights(NULL),
+      m_pSteering(NULL),
+      m_fSpeedReference(0),
+      m_fSpeed(0),
+      m_fSteering(0),
+      m_bCoefficients(false),
+      m_nHorizon(N),
+      m_nObstacles(0),
+      m_bLookup(false),
+      m_fOutputSteering(0)
+{
+    strncpy(m_strFileName, file_name, sizeof(m_strFileName) - 1);
+    m_strFileName[sizeof(m_strFileName) - 1] = '\0';
+    memset(&m_sHeader, 0, sizeof(m_sHeader));
+    memset(&m_sReference, 0, sizeof(m_sReference));
+    memset(&m_sWeights, 0, sizeof(m_sWeights));
+    memset(m_lower, 0, sizeof(m_lower));
+    memset(m_upper, 0, sizeof(m_upper));
+    memset(m_x0, 0, sizeof(m_x0));
+    memset(m_coefficients, 0, sizeof(m_coefficients));
+}
+
+NMPC_LookupTableSolver::~NMPC_LookupTableSolver()
+{
+    delete[] m_pWeights;
+    delete[] m_pSteering;
+}
+
+bool NMPC_LookupTableSolver::Setup()
+{
+    delete[] m_pWeights;
+    delete[] m_pSteering;
+    m_pWeights = NULL;
+    m_pSteering = NULL;
+
+    FILE *file = fopen(m_strFileName, "rb");
+    if (file == NULL)
+        return true;
+
+    bool valid = (fread(&m_sHeader, sizeof(m_sHeader), 1, file) == 1)
+            && m_sHeader.magic == NMPC_TABLE_MAGIC
+            && m_sHeader.version == NMPC_TABLE_VERSION
+            && m_sHeader.horizon == N
+            && fabs(m_sHeader.start_x - m_fStartX) < 1e-6;
+    long entries = 1;
+    for (int d = 0; valid && d < TABLE_AXES; d++)
+    {
+        valid = m_sHeader.size[d] >= 2 && m_sHeader.upper[d] > m_sHeader.lower[d];
+        entries *= m_sHeader.size[d];
+    }
+
+    if (valid)
+    {
+        m_pWeights = new NMPC_WEIGHTS[m_sHeader.size[TABLE_SPEED]];
+        m_pSteering = new float[entries];
+        valid = fread(m_pWeights, sizeof(NMPC_WEIGHTS), m_sHeader.size[TABLE_SPEED], file) == (size_t)m_sHeader.size[TABLE_SPEED]
+                && fread(m_pSteering, sizeof(float), entries, file) == (size_t)entries;
+    }
+    fclose(file);
+
+    if (!valid)
+    {
+        delete[] m_pWeights;
+        delete[] m_pSteering;
+        m_pWeights = NULL;
+        m_pSteering = NULL;
+    }
+    return true;
+}
+
+void NMPC_LookupTableSolver::Reset()
+{
+    m_bLookup = false;
+    m_pOnline->Reset();
+}
+
+void NMPC_LookupTableSolver::SetLimits(double max_time_ms, int max_iterations)
+{
+    m_pOnline->SetLimits(max_time_ms, max_iterations);
+}
+
+void NMPC_LookupTableSolver::SetHorizon(int stages)
+{
+    m_nHorizon = stages;
+    m_pOnline->SetHorizon(stages);
+}
+
+void NMPC_LookupTableSolver::SetReference(const COORDINATE_STRUCT& reference, double speed)
+{
+    m_sReference = reference;
+    m_fSpeedReference = speed;
+}
+
+void NMPC_LookupTableSolver::SetWeights(const NMPC_WEIGHTS& weights)
+{
+    m_sWeights = weights;
+}
+
+void NMPC_LookupTableSolver::SetBounds(const double *lower, const double *upper)
+{
+    memcpy(m_lower, lower, sizeof(m_lower));
+    memcpy(m_upper, upper, sizeof(m_upper));
+}
+
+void NMPC_LookupTableSolver::SetObstacles(const NMPC_OBSTACLE *obstacles, int count)
+{
+    m_nObstacles = count;
+    m_pOnline->SetObstacles(obstacles, count);
+}
+
+void NMPC_LookupTableSolver::SetInitialState(const double *x0, double speed, double steering)
+{
+    memcpy(m_x0, x0, sizeof(m_x0));
+    m_fSpeed = speed;
+    m_fSteering = steering;
+}
+
+void NMPC_LookupTableSolver::SetInitialGuess(const double *xx, int car_state_flag)
+{
+    m_pOnline->SetInitialGuess(xx, car_state_flag);
+}
+
+void NMPC_LookupTableSolver::SetLaneCoefficients(const float *coefficients)
+{
+    memcpy(m_coefficients, coefficients, sizeof(m_coefficients));
+    m_bCoefficients = true;
+}
+
+bool NMPC_LookupTableSolver::Solve(int car_state_flag, double shift_steps)
+{
+    // the table is built in the car frame with the speed fixed to the reference speed
+    bool lookup = car_state_flag == LANE_FOLLOW && IsLoaded() && m_bCoefficients
+            && m_nHorizon == m_sHeader.horizon && m_nObstacles == 0
+            && m_x0[0] == 0 && m_x0[1] == 0 && m_x0[2] == 0
+            && m_lower[3] == m_fSpeedReference && m_upper[3] == m_fSpeedReference
+            && fabs(m_lower[4] - m_sHeader.steering_lower) < 1e-9
+            && fabs(m_upper[4] - m_sHeader.steering_upper) < 1e-9;
+
+    double steering = 0;
+    if (lookup && Lookup(&steering))
+    {
+        // the online solver misses these problems, it starts cold when it is needed again
+        if (!m_bLookup)
+            m_pOnline->Reset();
+        m_bLookup = true;
+        m_fOutputSteering = steering;
+        m_bCoefficients = false;
+        return true;
+    }
+
+    m_bLookup = false;
+    m_bCoefficients = false;
+    m_pOnline->SetWeights(m_sWeights);
+    m_pOnline->SetBounds(m_lower, m_upper);
+    m_pOnline->SetReference(m_sReference, m_fSpeedReference);
+    m_pOnline->SetInitialState(m_x0, m_fSpeed, m_fSteering);
+    return m_pOnline->Solve(car_state_flag, shift_steps);
+}
+
+bool NMPC_LookupTableSolver::MatchesWeights(int i) const
+{
+    const NMPC_WEIGHTS& a = m_pWeights[i];
+    const NMPC_WEIGHTS& b = m_sWeights;
+    return a.Qx == b.Qx && a.QxN == b.QxN && a.Qy == b.Qy && a.QyN == b.QyN && a.Qpsi == b.Qpsi
+            && a.Rv == b.Rv && a.Rd == b.Rd && a.CHGsa == b.CHGsa && a.CHGss == b.CHGss;
+}
+
+bool NMPC_LookupTableSolver::Lookup(double *steering) const
+{
+    const double point[TABLE_AXES] = {m_coefficients[0], m_coefficients[1], m_coefficients[2], m_fSpeedReference};
+    int index[TABLE_AXES];
+    double t[TABLE_AXES];
+    int stride[TABLE_AXES];
+
+    for (int d = 0; d < TABLE_AXES; d++)
+    {
+        const double step = (m_sHeader.upper[d] - m_sHeader.lower[d]) / (m_sHeader.size[d] - 1);
+        const double f = (point[d] - m_sHeader.lower[d]) / step;
+        if (f < -1e-6 || f > m_sHeader.size[d] - 1 + 1e-6)
+            return false;
+        index[d] = static_cast<int>(floor(f));
+        if (index[d] < 0)
+            index[d] = 0;
+        if (index[d] > m_sHeader.size[d] - 2)
+            index[d] = m_sHeader.size[d] - 2;
+        t[d] = f - index[d];
+        if (t[d] < 0)
+            t[d] = 0;
+        if (t[d] > 1)
+            t[d] = 1;
+    }
+
+    // the weights switch with the speed, a speed cell across a switch takes the matching side
+    const bool lower_match = MatchesWeights(index[TABLE_SPEED]);
+    const bool upper_match = MatchesWeights(index[TABLE_SPEED] + 1);
+    if (!lower_match && !upper_match)
+        return false;
+    if (!lower_match)
+        t[TABLE_SPEED] = 1;
+    else if (!upper_match)
+        t[TABLE_SPEED] = 0;
+
+    stride[TABLE_SPEED] = 1;
+    for (int d = TABLE_SPEED - 1; d >= 0; d--)
+        stride[d] = stride[d + 1] * m_sHeader.size[d + 1];
+
+    int base = 0;
+    for (int d = 0; d < TABLE_AXES; d++)
+        base += index[d] * stride[d];
+
+    // multilinear interpolation between the 16 corners of the cell
+    double sum = 0;
+    for (int corner = 0; corner < (1 << TABLE_AXES); corner++)
+    {
+        double weight = 1;
+        int offset = 0;
+        for (int d = 0; d < TABLE_AXES; d++)
+        {
+            if (corner & (1 << d))
+            {
+                weight *= t[d];
+                offset += stride[d];
+            }
+            else
+                weight *= 1 - t[d];
+        }
+        if (weight != 0)
+            sum += weight * m_pSteering[base + offset];
+    }
+
+    *steering = sum;
+    return true;
+}
+
+void NMPC_LookupTableSolver::GetInputs(double *speed, double *steering) const
+{
+    if (!m_bLookup)
+    {
+        m_pOnline->GetInputs(speed, steering);
+        return;
+    }
+    *speed = m_fSpeedReference;
+    *steering = m_fOutputSteering;
+}
+
+void NMPC_LookupTableSolver::GetSolution(double *xx) const
+{
+    if (!m_bLookup)
+    {
+        m_pOnline->GetSolution(xx);
+        return;
+    }
+
+    BicycleState x(m_x0[0], m_x0[1], m_x0[2]);
+    BicycleInput u(m_fSpeedReference, m_fOutputSteering);
+    for (int k = 0; k < N; k++)
+    {
+        xx[k * NXU + 0] = x(0);
+        xx[k * NXU + 1] = x(1);
+        xx[k * NXU + 2] = x(2);
+        xx[k * NXU + 3] = u(0);
+        xx[k * NXU + 4] = u(1);
+        BicycleState x_next;
+        BicycleIntegrate(x, u, DT, x_next);
+        x = x_next;
+    }
+    xx[N * NXU + 0] = x(0);
+    xx[N * NXU + 1] = x(1);
+    xx[N * NXU + 2] = x(2);
+}
+
+int NMPC_LookupTableSolver::GetIterations() const
+{
+    return m_bLookup ? 0 : m_pOnline->GetIterations();
+}
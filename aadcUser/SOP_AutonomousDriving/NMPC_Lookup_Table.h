@@ -0,0 +1,108 @@
+#ifndef _NMPC_LOOKUP_TABLE_H_
+#define _NMPC_LOOKUP_TABLE_H_
+
+#include "NMPC_Solver.h"
+
+#define NMPC_TABLE_MAGIC    0x544c4d4e  // "NMLT"
+#define NMPC_TABLE_VERSION  2   // 2: lane reference sampled by arc length
+
+enum NMPC_TABLE_AXIS {TABLE_A, TABLE_B, TABLE_C, TABLE_SPEED, TABLE_AXES};
+
+/*! Header of a lookup table file written by Tools/NMPC_Table_Generator.
+ *
+ *  The table holds the optimal first steering angle of lane following on a regular grid of
+ *  the lane polynomial {a, b, c} (reference_value[1..3]) and the speed. The file is
+ *  header, NMPC_WEIGHTS[size[TABLE_SPEED]] (the weights at each speed sample) and
+ *  float steering[size[A]][size[B]][size[C]][size[SPEED]].
+ */
+typedef struct _NMPC_TABLE_HEADER
+{
+    int magic;
+    int version;
+    int horizon;                // N of the solver which filled the table
+    int size[TABLE_AXES];       // grid points per axis, at least 2
+    double lower[TABLE_AXES];   // first grid point
+    double upper[TABLE_AXES];   // last grid point
+    double start_x;             // first reference point, see SampleLaneReference
+    double steering_lower;
+    double steering_upper;
+} NMPC_TABLE_HEADER;
+
+/*! Explicit NMPC for lane following.
+ *
+ *  Lane following always starts in the car frame (initial state zero) and its reference only
+ *  depends on the lane polynomial, so its solution is a function of four numbers. It is read
+ *  from a precomputed table by multilinear interpolation, in constant time.
+ *  Every problem the table does not cover (other maneuvers, lane outside the grid, other
+ *  weights or bounds than the table was built with) is handed to the online solver.
+ */
+class NMPC_LookupTableSolver : public NMPC_Solver
+{
+public:
+    /*! \param online      solves the problems outside the table
+     *  \param file_name   table written by Tools/NMPC_Table_Generator
+     *  \param start_x     first reference point of the filter, the table must match it
+     */
+    NMPC_LookupTableSolver(NMPC_Solver *online, const char *file_name, double start_x);
+    virtual ~NMPC_LookupTableSolver();
+
+    virtual const char* GetName() const { return "Table"; }
+    /*! loads the table, without a table every problem goes to the online solver */
+    virtual bool Setup();
+    virtual void Reset();
+    virtual void SetLimits(double max_time_ms, int max_iterations);
+    /*! the table is built for its own horizon, any other goes to the online solver */
+    virtual void SetHorizon(int stages);
+    virtual void SetReference(const COORDINATE_STRUCT& reference, double speed);
+    virtual void SetWeights(const NMPC_WEIGHTS& weights);
+    virtual void SetBounds(const double *lower, const double *upper);
+    /*! the table knows no obstacles, with an obstacle every problem goes to the online solver */
+    virtual void SetObstacles(const NMPC_OBSTACLE *obstacles, int count);
+    virtual void SetInitialState(const double *x0, double speed, double steering);
+    /*! the table has no use for a guess, it goes to the online solver */
+    virtual void SetInitialGuess(const double *xx, int car_state_flag);
+    virtual bool Solve(int car_state_flag, double shift_steps);
+    virtual void GetInputs(double *speed, double *steering) const;
+    /*! from the table: the first input held over the horizon */
+    virtual void GetSolution(double *xx) const;
+    /*! \return 0 after a lookup */
+    virtual int GetIterations() const;
+
+    /*! the lane polynomial {a, b, c} the reference was sampled from */
+    void SetLaneCoefficients(const float *coefficients);
+
+    bool IsLoaded() const { return m_pSteering != NULL; }
+    /*! \return true if the last solve was a lookup */
+    bool IsLookup() const { return m_bLookup; }
+
+private:
+    bool Lookup(double *steering) const;
+    /*! \return true if the weights at speed sample i are the current ones */
+    bool MatchesWeights(int i) const;
+
+    NMPC_Solver *m_pOnline;
+    char m_strFileName[256];
+    double m_fStartX;
+
+    NMPC_TABLE_HEADER m_sHeader;
+    NMPC_WEIGHTS *m_pWeights;
+    float *m_pSteering;
+
+    COORDINATE_STRUCT m_sReference;
+    NMPC_WEIGHTS m_sWeights;
+    double m_lower[NXU];
+    double m_upper[NXU];
+    double m_x0[NX];
+    double m_fSpeedReference;
+    double m_fSpeed;
+    double m_fSteering;
+    float m_coefficients[3];
+    bool m_bCoefficients;
+    int m_nHorizon;
+    int m_nObstacles;
+
+    bool m_bLookup;
+    double m_fOutputSteering;
+};
+
+#endif // _NMPC_LOOKUP_TABLE_H_
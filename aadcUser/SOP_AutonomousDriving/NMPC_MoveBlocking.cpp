@@ -0,0 +1,326 @@
+#include "NMPC_MoveBlocking.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Ipopt;
+
+#define MOVE_BLOCKING_BOUND_INF 1e20    // beyond nlp_lower_bound_inf / nlp_upper_bound_inf of Ipopt
+
+NMPC_MoveBlockingNLP::NMPC_MoveBlockingNLP(int horizon, int nx, int nxu)
+    : m_nHorizon(horizon),
+      m_nX(nx),
+      m_nXU(nxu),
+      m_nVariables(horizon * nxu + nx),
+      m_block(horizon),
+      m_nBlocks(horizon),
+      m_bEliminateFixedSpeed(false),
+      m_nConstraints(0),
+      m_nReduced(horizon * nxu + nx),
+      m_eIndexStyle(C_STYLE),
+      m_map(horizon * nxu + nx),
+      m_constant(horizon * nxu + nx),
+      m_x(horizon * nxu + nx),
+      m_xl(horizon * nxu + nx),
+      m_xu(horizon * nxu + nx),
+      m_zl(horizon * nxu + nx),
+      m_zu(horizon * nxu + nx),
+      m_grad(horizon * nxu + nx)
+{
+    for (int k = 0; k < m_nHorizon; k++)
+        m_block[k] = k;
+    m_blockVar.resize(m_nBlocks * (m_nXU - m_nX));
+}
+
+NMPC_MoveBlockingNLP::~NMPC_MoveBlockingNLP()
+{
+}
+
+void NMPC_MoveBlockingNLP::SetBlocks(const int *lengths, int count, bool eliminate_fixed_speed)
+{
+    m_bEliminateFixedSpeed = eliminate_fixed_speed;
+
+    int k = 0;
+    m_nBlocks = 0;
+    for (int b = 0; b < count && k < m_nHorizon; b++)
+    {
+        if (lengths[b] <= 0)
+            continue;
+        for (int s = 0; s < lengths[b] && k < m_nHorizon; s++)
+            m_block[k++] = m_nBlocks;
+        m_nBlocks++;
+    }
+
+    if (m_nBlocks == 0)
+    {
+        for (k = 0; k < m_nHorizon; k++)
+            m_block[k] = k;
+        m_nBlocks = m_nHorizon;
+    }
+    else
+    {
+        while (k < m_nHorizon)
+            m_block[k++] = m_nBlocks - 1;
+    }
+    m_blockVar.resize(m_nBlocks * (m_nXU - m_nX));
+}
+
+bool NMPC_MoveBlockingNLP::BuildMap()
+{
+    Index n, m, nnz_jac, nnz_h;
+    if (!m_pNLP->get_nlp_info(n, m, nnz_jac, nnz_h, m_eIndexStyle) || n != m_nVariables)
+        return false;
+    m_nConstraints = m;
+    const int offset = (m_eIndexStyle == FORTRAN_STYLE) ? 1 : 0;
+
+    // the bounds tell whether the speed is fixed
+    m_gl.resize(m);
+    m_gu.resize(m);
+    if (!m_pNLP->get_bounds_info(n, &m_xl[0], &m_xu[0], m, &m_gl[0], &m_gu[0]))
+        return false;
+
+    // states in their own variables, the inputs of a block in one, stage by stage
+    const int nu = m_nXU - m_nX;
+    std::fill(m_blockVar.begin(), m_blockVar.end(), -1);
+    std::fill(m_map.begin(), m_map.end(), -1);
+    int next = 0;
+    for (int k = 0; k <= m_nHorizon; k++)
+    {
+        for (int j = 0; j < m_nXU; j++)
+        {
+            if (k == m_nHorizon && j >= m_nX)
+                break;
+            int i = k * m_nXU + j;
+            if (j < m_nX)
+            {
+                m_map[i] = next++;
+                continue;
+            }
+            if (j == m_nX && m_bEliminateFixedSpeed && m_xl[i] == m_xu[i])
+            {
+                m_constant[i] = m_xl[i];
+                continue;
+            }
+            int& var = m_blockVar[m_block[k] * nu + j - m_nX];
+            if (var < 0)
+                var = next++;
+            m_map[i] = var;
+        }
+    }
+    m_nReduced = next;
+
+    m_members.assign(m_nReduced, 0);
+    for (int i = 0; i < n; i++)
+    {
+        if (m_map[i] >= 0)
+            m_members[m_map[i]]++;
+    }
+
+    // a Jacobian column of a constant drops out
+    m_jacRow.resize(nnz_jac);
+    m_jacCol.resize(nnz_jac);
+    m_jacValues.resize(nnz_jac);
+    m_jacKept.clear();
+    if (nnz_jac > 0)
+    {
+        if (!m_pNLP->eval_jac_g(n, NULL, false, m, nnz_jac, &m_jacRow[0], &m_jacCol[0], NULL))
+            return false;
+        for (int e = 0; e < nnz_jac; e++)
+        {
+            if (m_map[m_jacCol[e] - offset] >= 0)
+                m_jacKept.push_back(e);
+        }
+    }
+
+    // d2/da2 of an entry (i, j), i != j, of the lower triangle counts twice if both are variable a
+    m_hessRow.resize(nnz_h);
+    m_hessCol.resize(nnz_h);
+    m_hessValues.resize(nnz_h);
+    m_hessKept.clear();
+    m_hessFactor.clear();
+    if (nnz_h > 0)
+    {
+        if (!m_pNLP->eval_h(n, NULL, false, 0, m, NULL, false, nnz_h, &m_hessRow[0], &m_hessCol[0], NULL))
+            return false;
+        for (int e = 0; e < nnz_h; e++)
+        {
+            int i = m_hessRow[e] - offset;
+            int j = m_hessCol[e] - offset;
+            if (m_map[i] < 0 || m_map[j] < 0)
+                continue;
+            m_hessKept.push_back(e);
+            m_hessFactor.push_back((i != j && m_map[i] == m_map[j]) ? 2.0 : 1.0);
+        }
+    }
+
+    return true;
+}
+
+const Number* NMPC_MoveBlockingNLP::Expand(const Number* x)
+{
+    for (int i = 0; i < m_nVariables; i++)
+        m_x[i] = (m_map[i] >= 0) ? x[m_map[i]] : m_constant[i];
+    return &m_x[0];
+}
+
+void NMPC_MoveBlockingNLP::Reduce(const Number* v, Number* reduced) const
+{
+    memset(reduced, 0, m_nReduced * sizeof(Number));
+    for (int i = 0; i < m_nVariables; i++)
+    {
+        if (m_map[i] >= 0)
+            reduced[m_map[i]] += v[i];
+    }
+}
+
+bool NMPC_MoveBlockingNLP::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g, Index& nnz_h_lag,
+                                        IndexStyleEnum& index_style)
+{
+    if (!BuildMap())
+        return false;
+
+    n = m_nReduced;
+    m = m_nConstraints;
+    nnz_jac_g = static_cast<Index>(m_jacKept.size());
+    nnz_h_lag = static_cast<Index>(m_hessKept.size());
+    index_style = m_eIndexStyle;
+    return true;
+}
+
+bool NMPC_MoveBlockingNLP::get_bounds_info(Index n, Number* x_l, Number* x_u, Index m, Number* g_l, Number* g_u)
+{
+    // the stages of a block have the same bounds, the tightest is taken anyway
+    for (int a = 0; a < n; a++)
+    {
+        x_l[a] = -MOVE_BLOCKING_BOUND_INF;
+        x_u[a] = MOVE_BLOCKING_BOUND_INF;
+    }
+    for (int i = 0; i < m_nVariables; i++)
+    {
+        int a = m_map[i];
+        if (a < 0)
+            continue;
+        x_l[a] = std::max(x_l[a], m_xl[i]);
+        x_u[a] = std::min(x_u[a], m_xu[i]);
+    }
+    memcpy(g_l, &m_gl[0], m * sizeof(Number));
+    memcpy(g_u, &m_gu[0], m * sizeof(Number));
+    return true;
+}
+
+bool NMPC_MoveBlockingNLP::get_starting_point(Index n, bool init_x, Number* x, bool init_z, Number* z_L,
+                                              Number* z_U, Index m, bool init_lambda, Number* lambda)
+{
+    if (!m_pNLP->get_starting_point(m_nVariables, init_x, &m_x[0], init_z, &m_zl[0], &m_zu[0],
+                                    m, init_lambda, lambda))
+        return false;
+
+    // a block starts from the mean of its stages
+    if (init_x)
+    {
+        Reduce(&m_x[0], x);
+        for (int a = 0; a < n; a++)
+            x[a] /= m_members[a];
+    }
+    if (init_z)
+    {
+        Reduce(&m_zl[0], z_L);
+        Reduce(&m_zu[0], z_U);
+    }
+    return true;
+}
+
+bool NMPC_MoveBlockingNLP::eval_f(Index /*n*/, const Number* x, bool new_x, Number& obj_value)
+{
+    return m_pNLP->eval_f(m_nVariables, Expand(x), new_x, obj_value);
+}
+
+bool NMPC_MoveBlockingNLP::eval_grad_f(Index /*n*/, const Number* x, bool new_x, Number* grad_f)
+{
+    if (!m_pNLP->eval_grad_f(m_nVariables, Expand(x), new_x, &m_grad[0]))
+        return false;
+    Reduce(&m_grad[0], grad_f);
+    return true;
+}
+
+bool NMPC_MoveBlockingNLP::eval_g(Index /*n*/, const Number* x, bool new_x, Index m, Number* g)
+{
+    return m_pNLP->eval_g(m_nVariables, Expand(x), new_x, m, g);
+}
+
+bool NMPC_MoveBlockingNLP::eval_jac_g(Index /*n*/, const Number* x, bool new_x, Index m, Index nele_jac,
+                                      Index* iRow, Index *jCol, Number* values)
+{
+    const int offset = (m_eIndexStyle == FORTRAN_STYLE) ? 1 : 0;
+
+    if (values == NULL)
+    {
+        for (int c = 0; c < nele_jac; c++)
+        {
+            int e = m_jacKept[c];
+            iRow[c] = m_jacRow[e];
+            jCol[c] = m_map[m_jacCol[e] - offset] + offset;
+        }
+        return true;
+    }
+
+    if (!m_pNLP->eval_jac_g(m_nVariables, Expand(x), new_x, m, static_cast<Index>(m_jacValues.size()),
+                            NULL, NULL, &m_jacValues[0]))
+        return false;
+    for (int c = 0; c < nele_jac; c++)
+        values[c] = m_jacValues[m_jacKept[c]];
+    return true;
+}
+
+bool NMPC_MoveBlockingNLP::eval_h(Index /*n*/, const Number* x, bool new_x, Number obj_factor, Index m,
+                                  const Number* lambda, bool new_lambda, Index nele_hess,
+                                  Index* iRow, Index* jCol, Number* values)
+{
+    const int offset = (m_eIndexStyle == FORTRAN_STYLE) ? 1 : 0;
+
+    if (values == NULL)
+    {
+        for (int c = 0; c < nele_hess; c++)
+        {
+            int e = m_hessKept[c];
+            int a = m_map[m_hessRow[e] - offset];
+            int b = m_map[m_hessCol[e] - offset];
+            iRow[c] = std::max(a, b) + offset;
+            jCol[c] = std::min(a, b) + offset;
+        }
+        return true;
+    }
+
+    if (!m_pNLP->eval_h(m_nVariables, Expand(x), new_x, obj_factor, m, lambda, new_lambda,
+                        static_cast<Index>(m_hessValues.size()), NULL, NULL, &m_hessValues[0]))
+        return false;
+    for (int c = 0; c < nele_hess; c++)
+        values[c] = m_hessFactor[c] * m_hessValues[m_hessKept[c]];
+    return true;
+}
+
+void NMPC_MoveBlockingNLP::finalize_solution(SolverReturn status, Index /*n*/, const Number* x,
+                                             const Number* z_L, const Number* z_U, Index m,
+                                             const Number* g, const Number* lambda, Number obj_value,
+                                             const IpoptData* ip_data, IpoptCalculatedQuantities* ip_cq)
+{
+    // the multiplier of a block is shared by its stages, a constant has none
+    for (int i = 0; i < m_nVariables; i++)
+    {
+        int a = m_map[i];
+        m_zl[i] = (a >= 0) ? z_L[a] / m_members[a] : 0;
+        m_zu[i] = (a >= 0) ? z_U[a] / m_members[a] : 0;
+    }
+    m_pNLP->finalize_solution(status, m_nVariables, Expand(x), &m_zl[0], &m_zu[0], m, g, lambda,
+                              obj_value, ip_data, ip_cq);
+}
+
+bool NMPC_MoveBlockingNLP::intermediate_callback(AlgorithmMode mode, Index iter, Number obj_value,
+                                                 Number inf_pr, Number inf_du, Number mu, Number d_norm,
+                                                 Number regularization_size, Number alpha_du, Number alpha_pr,
+                                                 Index ls_trials, const IpoptData* ip_data,
+                                                 IpoptCalculatedQuantities* ip_cq)
+{
+    return m_pNLP->intermediate_callback(mode, iter, obj_value, inf_pr, inf_du, mu, d_norm,
+                                         regularization_size, alpha_du, alpha_pr, ls_trials, ip_data, ip_cq);
+}
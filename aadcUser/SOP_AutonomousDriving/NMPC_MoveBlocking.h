@@ -0,0 +1,123 @@
+#ifndef _NMPC_MOVE_BLOCKING_H_
+#define _NMPC_MOVE_BLOCKING_H_
+
+#include "IpTNLP.hpp"
+
+#include <vector>
+
+/*! TNLP decorator which solves the wrapped NMPC problem with fewer input variables.
+ *
+ *  The inputs are held constant over blocks of stages: all stages of a block share one speed and
+ *  one steering variable. A speed whose lower and upper bound are equal (the reference speed of
+ *  NMPCBounds) can be removed from the variables altogether, it enters the wrapped NLP as a
+ *  constant. The states stay variables of their own.
+ *
+ *  Every full variable is either one reduced variable or a constant, so the derivatives of the
+ *  reduced problem are sums of those of the wrapped NLP: its Jacobian and Hessian entries are
+ *  handed to Ipopt at the position of the reduced variables, duplicate positions are summed by
+ *  Ipopt. The solution is expanded before finalize_solution() of the wrapped NLP, which sees the
+ *  full layout as without blocking.
+ *
+ *  Expected layout, as in NMPC_WarmStartNLP:
+ *  x = [x y psi v delta]_0 ... [x y psi v delta]_N-1 [x y psi]_N
+ */
+class NMPC_MoveBlockingNLP : public Ipopt::TNLP
+{
+public:
+    /*! \param horizon  number of control intervals N
+     *  \param nx       number of states per stage
+     *  \param nxu      number of states and inputs per stage, the speed is input nx
+     */
+    NMPC_MoveBlockingNLP(int horizon, int nx, int nxu);
+    virtual ~NMPC_MoveBlockingNLP();
+
+    /*! \param nlp  the problem which is solved, may change between two solves */
+    void Wrap(const Ipopt::SmartPtr<Ipopt::TNLP>& nlp) { m_pNLP = nlp; }
+
+    /*! \param lengths  stages of each block, the blocks are cut at the horizon and the last one
+     *                  is extended to it. No blocks: one block per stage
+     *  \param count    number of blocks
+     *  \param eliminate_fixed_speed  removes the speed if its bounds are equal
+     */
+    void SetBlocks(const int *lengths, int count, bool eliminate_fixed_speed);
+
+    /*! \return true if the reduced problem has fewer variables than the wrapped one */
+    bool IsActive() const { return m_nBlocks < m_nHorizon || m_bEliminateFixedSpeed; }
+
+    /*! \return variables of the last reduced problem */
+    int GetVariables() const { return m_nReduced; }
+
+    virtual bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                              Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+    virtual bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l, Ipopt::Number* x_u,
+                                 Ipopt::Index m, Ipopt::Number* g_l, Ipopt::Number* g_u);
+    virtual bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number* x,
+                                    bool init_z, Ipopt::Number* z_L, Ipopt::Number* z_U,
+                                    Ipopt::Index m, bool init_lambda, Ipopt::Number* lambda);
+    virtual bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number& obj_value);
+    virtual bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number* grad_f);
+    virtual bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Index m, Ipopt::Number* g);
+    virtual bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Index m,
+                            Ipopt::Index nele_jac, Ipopt::Index* iRow, Ipopt::Index *jCol, Ipopt::Number* values);
+    virtual bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number obj_factor,
+                        Ipopt::Index m, const Ipopt::Number* lambda, bool new_lambda,
+                        Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol, Ipopt::Number* values);
+    virtual void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number* x,
+                                   const Ipopt::Number* z_L, const Ipopt::Number* z_U,
+                                   Ipopt::Index m, const Ipopt::Number* g, const Ipopt::Number* lambda,
+                                   Ipopt::Number obj_value, const Ipopt::IpoptData* ip_data,
+                                   Ipopt::IpoptCalculatedQuantities* ip_cq);
+    virtual bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                                       Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                                       Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                                       Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                                       const Ipopt::IpoptData* ip_data, Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+private:
+    /*! builds m_map and the sparsity of the reduced problem */
+    bool BuildMap();
+    /*! \return x of the wrapped NLP for the reduced x, kept in m_x */
+    const Ipopt::Number* Expand(const Ipopt::Number* x);
+    /*! sums v of the wrapped NLP into the reduced variables */
+    void Reduce(const Ipopt::Number* v, Ipopt::Number* reduced) const;
+
+    Ipopt::SmartPtr<Ipopt::TNLP> m_pNLP;
+
+    int m_nHorizon;
+    int m_nX;
+    int m_nXU;
+    int m_nVariables;
+
+    std::vector<int> m_block;           // block of each stage
+    int m_nBlocks;
+    bool m_bEliminateFixedSpeed;
+    std::vector<int> m_blockVar;        // reduced variable of each input of each block
+
+    int m_nConstraints;
+    int m_nReduced;
+    IndexStyleEnum m_eIndexStyle;
+    std::vector<int> m_map;             // reduced variable of each full variable, -1 for a constant
+    std::vector<int> m_members;         // full variables per reduced variable
+    std::vector<double> m_constant;     // value of the constant variables
+    std::vector<double> m_x;
+    std::vector<double> m_xl;
+    std::vector<double> m_xu;
+    std::vector<double> m_gl;
+    std::vector<double> m_gu;
+    std::vector<double> m_zl;
+    std::vector<double> m_zu;
+    std::vector<double> m_grad;
+
+    // sparsity of the wrapped NLP and which of its entries are kept
+    std::vector<Ipopt::Index> m_jacRow;
+    std::vector<Ipopt::Index> m_jacCol;
+    std::vector<Ipopt::Number> m_jacValues;
+    std::vector<int> m_jacKept;
+    std::vector<Ipopt::Index> m_hessRow;
+    std::vector<Ipopt::Index> m_hessCol;
+    std::vector<Ipopt::Number> m_hessValues;
+    std::vector<int> m_hessKept;
+    std::vector<double> m_hessFactor;   // 2 for an off-diagonal entry folded onto the diagonal
+};
+
+#endif // _NMPC_MOVE_BLOCKING_H_
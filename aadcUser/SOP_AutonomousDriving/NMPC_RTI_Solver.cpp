@@ -0,0 +1,449 @@
+#include "NMPC_RTI_Solver.h"
+
+#define OBSTACLE_SIDE_TOLERANCE     0.01    // m, lateral offset below which an obstacle is straight ahead
+
+NMPC_RTISolver::NMPC_RTISolver()
+    : m_nHorizon(0),
+      m_nObstacles(0),
+      m_vRef(0),
+      m_nIterations(0),
+      m_nMaxIterations(MAX_QP_ITERATIONS),
+      m_nCarStateFlag(-1),
+      m_bInitialized(false),
+      m_bSeeded(false)
+{
+    NMPC_WEIGHTS weights = {20, 2, 5, 5, 2, 1, 1, 1, 1};
+    m_sWeights = weights;
+    m_uLower.setZero();
+    m_uUpper.setZero();
+    Resize(N);
+    m_x0.setZero();
+    m_uPrev.setZero();
+    for (int k = 0; k <= NMPC_MAX_HORIZON; k++)
+    {
+        m_X[k].setZero();
+        m_ref[k].setZero();
+    }
+}
+
+bool NMPC_RTISolver::Setup()
+{
+    Reset();
+    return true;
+}
+
+void NMPC_RTISolver::Reset()
+{
+    m_bInitialized = false;
+    m_bSeeded = false;
+}
+
+void NMPC_RTISolver::SetLimits(double /*max_time_ms*/, int max_iterations)
+{
+    m_nMaxIterations = (max_iterations > 0 && max_iterations < MAX_QP_ITERATIONS) ? max_iterations : MAX_QP_ITERATIONS;
+}
+
+void NMPC_RTISolver::SetHorizon(int stages)
+{
+    if (stages < MIN_HORIZON)
+        stages = MIN_HORIZON;
+    else if (stages > NMPC_MAX_HORIZON)
+        stages = NMPC_MAX_HORIZON;
+    if (stages != m_nHorizon)
+        Resize(stages);
+}
+
+void NMPC_RTISolver::Resize(int stages)
+{
+    int old = m_nHorizon;
+    m_nHorizon = stages;
+    const int nv = 2 * stages;
+
+    m_U.conservativeResize(nv);
+    for (int k = old; k < stages; k++)
+    {
+        m_U(2 * k)     = (old > 0) ? m_U(2 * old - 2) : m_vRef;
+        m_U(2 * k + 1) = (old > 0) ? m_U(2 * old - 1) : 0;
+    }
+    m_lower.resize(nv);
+    m_upper.resize(nv);
+    for (int k = 0; k < stages; k++)
+    {
+        m_lower.segment<2>(2 * k) = m_uLower;
+        m_upper.segment<2>(2 * k) = m_uUpper;
+    }
+
+    m_dU.resize(nv);
+    m_g.resize(nv);
+    m_grad.resize(nv);
+    m_rhs.resize(nv);
+    m_step.resize(nv);
+    m_H.resize(nv, nv);
+    m_K.resize(nv, nv);
+    m_G.resize(3, nv);
+    m_WG.resize(3, nv);
+}
+
+void NMPC_RTISolver::SetWeights(const NMPC_WEIGHTS& weights)
+{
+    m_sWeights = weights;
+}
+
+void NMPC_RTISolver::SetBounds(const double *lower, const double *upper)
+{
+    m_uLower << lower[3], lower[4];
+    m_uUpper << upper[3], upper[4];
+    for (int k = 0; k < m_nHorizon; k++)
+    {
+        m_lower.segment<2>(2 * k) = m_uLower;
+        m_upper.segment<2>(2 * k) = m_uUpper;
+    }
+}
+
+void NMPC_RTISolver::SetObstacles(const NMPC_OBSTACLE *obstacles, int count)
+{
+    m_nObstacles = (count < NMPC_MAX_OBSTACLES) ? count : NMPC_MAX_OBSTACLES;
+    for (int o = 0; o < m_nObstacles; o++)
+        m_aObstacles[o] = obstacles[o];
+}
+
+void NMPC_RTISolver::SetReference(const COORDINATE_STRUCT& reference, double speed)
+{
+    for (int k = 0; k <= NMPC_MAX_HORIZON; k++)
+    {
+        m_ref[k](0) = reference.X[k];
+        m_ref[k](1) = reference.Y[k];
+    }
+    m_vRef = speed;
+}
+
+void NMPC_RTISolver::SetInitialState(const double *x0, double speed, double steering)
+{
+    m_x0 << x0[0], x0[1], x0[2];
+    m_uPrev << speed, steering;
+}
+
+void NMPC_RTISolver::SetInitialGuess(const double *xx, int car_state_flag)
+{
+    for (int k = 0; k < m_nHorizon; k++)
+    {
+        m_U(2 * k) = xx[k * NXU + 3];
+        m_U(2 * k + 1) = xx[k * NXU + 4];
+    }
+    m_nCarStateFlag = car_state_flag;
+    m_bInitialized = true;
+    m_bSeeded = true;
+}
+
+void NMPC_RTISolver::Shift(double shift_steps)
+{
+    if (!m_bInitialized || m_bSeeded || shift_steps <= 0)
+        return;
+
+    const int last = m_nHorizon - 1;
+    int whole = static_cast<int>(floor(shift_steps));
+    double frac = shift_steps - whole;
+    for (int k = 0; k < m_nHorizon; k++)
+    {
+        int k0 = k + whole;
+        int k1 = k0 + 1;
+        if (k0 > last)
+            k0 = last;
+        if (k1 > last)
+            k1 = last;
+        m_U(2 * k)     = (1.0 - frac) * m_U(2 * k0)     + frac * m_U(2 * k1);
+        m_U(2 * k + 1) = (1.0 - frac) * m_U(2 * k0 + 1) + frac * m_U(2 * k1 + 1);
+    }
+}
+
+bool NMPC_RTISolver::Solve(int car_state_flag, double shift_steps)
+{
+    Shift(shift_steps);
+    if (!m_bInitialized || car_state_flag != m_nCarStateFlag)
+    {
+        for (int k = 0; k < m_nHorizon; k++)
+        {
+            m_U(2 * k) = m_vRef;
+            m_U(2 * k + 1) = 0;
+        }
+        m_nCarStateFlag = car_state_flag;
+        m_bInitialized = true;
+    }
+    m_bSeeded = false;
+    ClampInputs();
+
+    Linearize();
+    bool converged = SolveBoxQP();
+
+    m_U += m_dU;
+    ClampInputs();
+    Simulate();
+
+    return converged;
+}
+
+void NMPC_RTISolver::GetInputs(double *speed, double *steering) const
+{
+    *speed = m_U(0);
+    *steering = m_U(1);
+}
+
+void NMPC_RTISolver::GetSolution(double *xx) const
+{
+    for (int k = 0; k < N; k++)
+    {
+        int ku = (k < m_nHorizon) ? k : m_nHorizon - 1;
+        xx[k * NXU + 0] = m_X[k](0);
+        xx[k * NXU + 1] = m_X[k](1);
+        xx[k * NXU + 2] = m_X[k](2);
+        xx[k * NXU + 3] = m_U(2 * ku);
+        xx[k * NXU + 4] = m_U(2 * ku + 1);
+    }
+    xx[N * NXU + 0] = m_X[N](0);
+    xx[N * NXU + 1] = m_X[N](1);
+    xx[N * NXU + 2] = m_X[N](2);
+}
+
+void NMPC_RTISolver::ClampInputs()
+{
+    m_U = m_U.cwiseMax(m_lower).cwiseMin(m_upper);
+}
+
+void NMPC_RTISolver::Simulate()
+{
+    const double h = DT / SUBSTEPS;
+    BicycleState x = m_x0;
+    m_X[0] = x;
+    // at least up to N, GetSolution() hands out the full trajectory
+    const int stages = (m_nHorizon > N) ? m_nHorizon : N;
+    for (int k = 0; k < stages; k++)
+    {
+        int ku = (k < m_nHorizon) ? k : m_nHorizon - 1;
+        BicycleInput u(m_U(2 * ku), m_U(2 * ku + 1));
+        for (int s = 0; s < SUBSTEPS; s++)
+        {
+            BicycleState x_next;
+            BicycleIntegrate(x, u, h, x_next);
+            x = x_next;
+        }
+        m_X[k + 1] = x;
+    }
+}
+
+void NMPC_RTISolver::Linearize()
+{
+    const double h = DT / SUBSTEPS;
+    const NMPC_WEIGHTS& w = m_sWeights;
+    const int n = m_nHorizon;
+
+    m_H.setZero();
+    m_g.setZero();
+    m_G.setZero();
+
+    // heading reference along the reference points, unwrapped around the current heading
+    double psi_ref = m_x0(2);
+    for (int k = 1; k <= n; k++)
+    {
+        int k0 = (k < NMPC_MAX_HORIZON) ? k : NMPC_MAX_HORIZON - 1;
+        double dx = m_ref[k0 + 1](0) - m_ref[k0](0);
+        double dy = m_ref[k0 + 1](1) - m_ref[k0](1);
+        if (dx * dx + dy * dy > 1e-8)
+        {
+            double angle = atan2(dy, dx);
+            if (m_vRef < 0)
+                angle += M_PI;
+            double diff = angle - psi_ref;
+            diff -= 2.0 * M_PI * floor((diff + M_PI) / (2.0 * M_PI));
+            psi_ref += diff;
+        }
+        m_ref[k](2) = psi_ref;
+    }
+
+    // simulate and condense: x_k+1 depends on u_0..u_k through G = dx_k+1/dU
+    BicycleState x = m_x0;
+    m_X[0] = x;
+    for (int k = 0; k < n; k++)
+    {
+        BicycleInput u(m_U(2 * k), m_U(2 * k + 1));
+        BicycleStateJacobian A = BicycleStateJacobian::Identity();
+        BicycleInputJacobian B = BicycleInputJacobian::Zero();
+        for (int s = 0; s < SUBSTEPS; s++)
+        {
+            BicycleState x_next;
+            BicycleStateJacobian As;
+            BicycleInputJacobian Bs;
+            BicycleIntegrate(x, u, h, x_next, As, Bs);
+            B = As * B + Bs;
+            A = As * A;
+            x = x_next;
+        }
+        m_X[k + 1] = x;
+
+        m_WG.noalias() = A * m_G;
+        m_G = m_WG;
+        m_G.col(2 * k) += B.col(0);
+        m_G.col(2 * k + 1) += B.col(1);
+
+        BicycleState q;
+        if (k + 1 < n)
+            q << w.Qx, w.Qy, w.Qpsi;
+        else
+            q << w.QxN, w.QyN, w.Qpsi;
+        BicycleState e = x - m_ref[k + 1];
+
+        m_WG.noalias() = q.asDiagonal() * m_G;
+        m_H.noalias() += m_G.transpose() * m_WG;
+        m_g.noalias() += m_WG.transpose() * e;
+
+        // Gauss-Newton on the violated clearances, r = C - |p - p_o|, dr/dp = -(p - p_o) / |p - p_o|
+        for (int o = 0; o < m_nObstacles; o++)
+        {
+            const NMPC_OBSTACLE& obstacle = m_aObstacles[o];
+            double dx = x(0) - obstacle.x;
+            double dy = x(1) - obstacle.y;
+            // straight at the obstacle the gradient has no side, it is passed on the left like
+            // in the avoidance maneuver
+            double lateral = -dx * sin(x(2)) + dy * cos(x(2));
+            if (fabs(lateral) < OBSTACLE_SIDE_TOLERANCE)
+            {
+                dx -= (OBSTACLE_SIDE_TOLERANCE - lateral) * sin(x(2));
+                dy += (OBSTACLE_SIDE_TOLERANCE - lateral) * cos(x(2));
+            }
+            double d = sqrt(dx * dx + dy * dy);
+            if (d >= obstacle.clearance || d < 1e-6)
+                continue;
+            double r = obstacle.clearance - d;
+            m_WG.row(0).noalias() = (-dx / d) * m_G.row(0) + (-dy / d) * m_G.row(1);
+            m_H.noalias() += obstacle.weight * m_WG.row(0).transpose() * m_WG.row(0);
+            m_g.noalias() += (obstacle.weight * r) * m_WG.row(0).transpose();
+        }
+    }
+
+    // input magnitude and input change
+    for (int k = 0; k < n; k++)
+    {
+        int iv = 2 * k;
+        int id = 2 * k + 1;
+        m_H(iv, iv) += w.Rv;
+        m_g(iv) += w.Rv * (m_U(iv) - m_vRef);
+        m_H(id, id) += w.Rd;
+        m_g(id) += w.Rd * m_U(id);
+
+        double chg[2] = {w.CHGss, w.CHGsa};
+        for (int c = 0; c < 2; c++)
+        {
+            int i = 2 * k + c;
+            double prev = (k == 0) ? m_uPrev(c) : m_U(i - 2);
+            double d = m_U(i) - prev;
+            m_H(i, i) += chg[c];
+            m_g(i) += chg[c] * d;
+            if (k > 0)
+            {
+                m_H(i - 2, i - 2) += chg[c];
+                m_H(i, i - 2) -= chg[c];
+                m_H(i - 2, i) -= chg[c];
+                m_g(i - 2) -= chg[c] * d;
+            }
+        }
+    }
+
+    m_H.diagonal().array() += 1e-6;
+}
+
+bool NMPC_RTISolver::SolveBoxQP()
+{
+    // bounds of the step, the current inputs are feasible so the zero step is a feasible start
+    const InputVector lb = m_lower - m_U;
+    const InputVector ub = m_upper - m_U;
+    const double tol = 1e-9;
+    const int nv = 2 * m_nHorizon;
+
+    m_dU.setZero();
+    for (int i = 0; i < nv; i++)
+        m_active[i] = (ub(i) - lb(i) < tol) ? 2 : 0;
+
+    for (m_nIterations = 0; m_nIterations < m_nMaxIterations; m_nIterations++)
+    {
+        // equality constrained step on the free inputs
+        m_grad.noalias() = m_H * m_dU;
+        m_grad += m_g;
+        m_K = m_H;
+        m_rhs = -m_grad;
+        for (int i = 0; i < nv; i++)
+        {
+            if (m_active[i] != 0)
+            {
+                m_K.row(i).setZero();
+                m_K.col(i).setZero();
+                m_K(i, i) = 1.0;
+                m_rhs(i) = 0;
+            }
+        }
+        m_llt.compute(m_K);
+        m_step = m_llt.solve(m_rhs);
+
+        if (m_step.cwiseAbs().maxCoeff() < tol)
+        {
+            // stationary on the working set, release the bound with the wrong multiplier sign
+            int release = -1;
+            double worst = -tol;
+            for (int i = 0; i < nv; i++)
+            {
+                double mult = 0;
+                if (m_active[i] == -1)
+                    mult = m_grad(i);
+                else if (m_active[i] == 1)
+                    mult = -m_grad(i);
+                else
+                    continue;
+                if (mult < worst)
+                {
+                    worst = mult;
+                    release = i;
+                }
+            }
+            if (release < 0)
+                return true;
+            m_active[release] = 0;
+            continue;
+        }
+
+        // longest feasible step, the first blocking bound joins the working set
+        double alpha = 1.0;
+        int blocking = -1;
+        int side = 0;
+        for (int i = 0; i < nv; i++)
+        {
+            if (m_active[i] != 0)
+                continue;
+            if (m_step(i) < 0 && m_dU(i) + m_step(i) < lb(i))
+            {
+                double a = (lb(i) - m_dU(i)) / m_step(i);
+                if (a < alpha)
+                {
+                    alpha = a;
+                    blocking = i;
+                    side = -1;
+                }
+            }
+            else if (m_step(i) > 0 && m_dU(i) + m_step(i) > ub(i))
+            {
+                double a = (ub(i) - m_dU(i)) / m_step(i);
+                if (a < alpha)
+                {
+                    alpha = a;
+                    blocking = i;
+                    side = 1;
+                }
+            }
+        }
+        m_dU += alpha * m_step;
+        if (blocking >= 0)
+        {
+            m_active[blocking] = side;
+            m_dU(blocking) = (side < 0) ? lb(blocking) : ub(blocking);
+        }
+    }
+
+    return false;
+}
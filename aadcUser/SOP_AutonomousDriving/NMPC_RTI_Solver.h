@@ -0,0 +1,111 @@
+#ifndef _NMPC_RTI_SOLVER_H_
+#define _NMPC_RTI_SOLVER_H_
+
+#include "NMPC_Solver.h"
+#include "Bicycle_Model.h"
+
+/*! Real-time iteration NMPC for the kinematic bicycle model.
+ *
+ *  Every call of Solve() performs exactly one Gauss-Newton SQP step around the shifted
+ *  input trajectory of the last call. The states are eliminated by single shooting
+ *  (condensing), which leaves a dense box constrained QP in the 2*N inputs. It is solved
+ *  by a primal active set method on fixed-size matrices, nothing is allocated after
+ *  construction.
+ *
+ *  The horizon is N until SetHorizon() changes it, up to NMPC_MAX_HORIZON: the matrices keep the
+ *  storage of NMPC_MAX_HORIZON and are used up to the active horizon only, so every horizon costs
+ *  the QP of its own size. Up to N the inputs behind the active horizon repeat its last input.
+ *
+ *  Cost: sum_k=1..N Q(k) * (x_k - ref_k)^2 + sum_k=0..N-1 Rv*(v_k - v_ref)^2 + Rd*delta_k^2
+ *        + CHGss*(v_k - v_k-1)^2 + CHGsa*(delta_k - delta_k-1)^2
+ *        + sum_k=1..N sum_o Wo * max(0, Co - |p_k - p_o|)^2
+ *  with Q(k) = {Qx, Qy, Qpsi} and {QxN, QyN, Qpsi} at the final point and the obstacles o at p_o
+ *  with clearance Co. Only the input bounds are enforced, the obstacles are soft constraints.
+ */
+class NMPC_RTISolver : public NMPC_Solver
+{
+public:
+    enum { HORIZON = NMPC_MAX_HORIZON, MIN_HORIZON = 3, NVAR = 2 * NMPC_MAX_HORIZON, SUBSTEPS = 2, MAX_QP_ITERATIONS = 8 * N };
+
+    // storage of the longest horizon, the size follows the active horizon
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, NVAR, 1> InputVector;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, NVAR, NVAR> HessianMatrix;
+    typedef Eigen::Matrix<double, 3, Eigen::Dynamic, 0, 3, NVAR> SensitivityMatrix;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    NMPC_RTISolver();
+
+    virtual const char* GetName() const { return "RTI"; }
+    virtual bool Setup();
+    /*! drops the input trajectory, the next solve starts from straight driving */
+    virtual void Reset();
+    /*! only the iteration cap of the QP is used, one iteration costs a fixed amount of time */
+    virtual void SetLimits(double max_time_ms, int max_iterations);
+    /*! \param stages  MIN_HORIZON..NMPC_MAX_HORIZON, the input trajectory is kept */
+    virtual void SetHorizon(int stages);
+    virtual void SetReference(const COORDINATE_STRUCT& reference, double speed);
+    virtual void SetWeights(const NMPC_WEIGHTS& weights);
+    /*! only the inputs {v, delta} are bounded */
+    virtual void SetBounds(const double *lower, const double *upper);
+    virtual void SetObstacles(const NMPC_OBSTACLE *obstacles, int count);
+    virtual void SetInitialState(const double *x0, double speed, double steering);
+    /*! takes the inputs of xx, the states follow from the next simulation */
+    virtual void SetInitialGuess(const double *xx, int car_state_flag);
+
+    /*! one real-time iteration
+     *  \return false if the QP did not converge, the inputs are still within their bounds
+     */
+    virtual bool Solve(int car_state_flag, double shift_steps);
+
+    virtual void GetInputs(double *speed, double *steering) const;
+    virtual void GetSolution(double *xx) const;
+    /*! \return number of active set iterations of the last QP */
+    virtual int GetIterations() const { return m_nIterations; }
+
+private:
+    /*! moves the input trajectory forward by shift_steps sampling intervals DT */
+    void Shift(double shift_steps);
+    /*! sizes the matrices for the horizon, new stages repeat the last input */
+    void Resize(int stages);
+    void ClampInputs();
+    void Simulate();
+    void Linearize();
+    bool SolveBoxQP();
+
+    NMPC_WEIGHTS m_sWeights;
+
+    int m_nHorizon;         // active horizon
+    InputVector m_U;        // {v_0, delta_0, ..., v_n-1, delta_n-1}, n = m_nHorizon
+    InputVector m_lower;
+    InputVector m_upper;
+    InputVector m_dU;
+    InputVector m_g;
+    InputVector m_grad;
+    InputVector m_rhs;
+    InputVector m_step;
+    HessianMatrix m_H;
+    HessianMatrix m_K;
+    Eigen::LLT<HessianMatrix> m_llt;
+    SensitivityMatrix m_G;
+    SensitivityMatrix m_WG;
+    int m_active[NVAR];     // 0 free, -1 at lower bound, 1 at upper bound, 2 fixed
+
+    BicycleState m_x0;
+    BicycleState m_X[NMPC_MAX_HORIZON + 1];
+    BicycleState m_ref[NMPC_MAX_HORIZON + 1];
+    NMPC_OBSTACLE m_aObstacles[NMPC_MAX_OBSTACLES];
+    int m_nObstacles;
+    BicycleInput m_uPrev;
+    BicycleInput m_uLower;
+    BicycleInput m_uUpper;
+    double m_vRef;
+
+    int m_nIterations;
+    int m_nMaxIterations;
+    int m_nCarStateFlag;
+    bool m_bInitialized;
+    bool m_bSeeded;         // m_U comes from SetInitialGuess(), the next solve does not shift it
+};
+
+#endif // _NMPC_RTI_SOLVER_H_
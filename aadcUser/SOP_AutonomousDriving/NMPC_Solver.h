@@ -0,0 +1,102 @@
+#ifndef _NMPC_SOLVER_H_
+#define _NMPC_SOLVER_H_
+
+#include "Nmpc/parameter_settings.h"
+
+/*! Weighting factors of the NMPC cost function */
+typedef struct _NMPC_WEIGHTS
+{
+    double Qx;      // X-coordinate
+    double QxN;     // X-coordinate at final point
+    double Qy;      // Y-coordinate
+    double QyN;     // Y-coordinate at final point
+    double Qpsi;    // heading
+    double Rv;      // velocity
+    double Rd;      // steering angle
+    double CHGsa;   // change of the steering angle
+    double CHGss;   // change of the speed
+} NMPC_WEIGHTS;
+
+#define NMPC_MAX_OBSTACLES  4
+#define NMPC_MAX_HORIZON    15      // stages, the 16 points of COORDINATE_STRUCT; N is the nominal horizon
+
+/*! Obstacle kept away from the predicted positions by a penalty in the cost function */
+typedef struct _NMPC_OBSTACLE
+{
+    double x;           // in the frame of the initial state
+    double y;
+    double clearance;   // m, distance from which on the penalty acts
+    double weight;      // of the squared violation of the clearance
+} NMPC_OBSTACLE;
+
+/*! Interface of an NMPC solver backend.
+ *
+ *  The controller hands the same problem to every backend: N+1 reference points with a
+ *  reference speed, the weights, the bounds in the layout of the stage vector
+ *  {x, y, psi, v, delta} and the initial state. A backend keeps everything it needs between
+ *  two solves (warm start data, linearisation) in its own instance.
+ */
+class NMPC_Solver
+{
+public:
+    virtual ~NMPC_Solver() {}
+
+    /*! \return short name for logging */
+    virtual const char* GetName() const = 0;
+
+    /*! prepares the backend, called once before the first solve
+     *  \return false if the backend can not be used */
+    virtual bool Setup() = 0;
+
+    /*! drops all data of the previous solves, the next solve is a cold start */
+    virtual void Reset() = 0;
+
+    /*! \param max_time_ms      budget of one solve
+     *  \param max_iterations   iteration cap of one solve */
+    virtual void SetLimits(double max_time_ms, int max_iterations) = 0;
+
+    /*! \param stages  horizon of the next solves, at most NMPC_MAX_HORIZON. A backend built for
+     *                 a fixed horizon keeps N */
+    virtual void SetHorizon(int /*stages*/) {}
+
+    /*! \param reference  N+1 reference points, one more than the horizon if it is longer; point k
+     *                    is tracked by the state at stage k
+     *  \param speed      reference speed, negative when driving backwards */
+    virtual void SetReference(const COORDINATE_STRUCT& reference, double speed) = 0;
+
+    virtual void SetWeights(const NMPC_WEIGHTS& weights) = 0;
+
+    /*! \param lower, upper  bounds of {x, y, psi, v, delta} */
+    virtual void SetBounds(const double *lower, const double *upper) = 0;
+
+    /*! \param obstacles  at most NMPC_MAX_OBSTACLES obstacles of the next solves. A backend
+     *                    without a penalty for them ignores them */
+    virtual void SetObstacles(const NMPC_OBSTACLE * /*obstacles*/, int /*count*/) {}
+
+    /*! \param x0               initial state {x, y, psi}
+     *  \param speed, steering  the input applied at the moment */
+    virtual void SetInitialState(const double *x0, double speed, double steering) = 0;
+
+    /*! starts the next solve of the given maneuver from a trajectory computed elsewhere
+     *  instead of the shifted solution of the last solve
+     *  \param xx              trajectory in the layout of GetSolution()
+     *  \param car_state_flag  the maneuver of the next solve, the guess is dropped if it differs */
+    virtual void SetInitialGuess(const double *xx, int car_state_flag) = 0;
+
+    /*! solves the problem
+     *  \param car_state_flag  the maneuver, a change drops the data of the previous solves
+     *  \param shift_steps     time since the last solve in multiples of DT
+     *  \return true if the solution can be applied */
+    virtual bool Solve(int car_state_flag, double shift_steps) = 0;
+
+    /*! \return the first input of the solution */
+    virtual void GetInputs(double *speed, double *steering) const = 0;
+
+    /*! writes the predicted trajectory in the layout {x, y, psi, v, delta}_0..N-1 {x, y, psi}_N */
+    virtual void GetSolution(double *xx) const = 0;
+
+    /*! \return iterations of the last solve */
+    virtual int GetIterations() const = 0;
+};
+
+#endif // _NMPC_SOLVER_H_
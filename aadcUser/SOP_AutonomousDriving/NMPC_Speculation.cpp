@@ -0,0 +1,199 @@
+#include "NMPC_Speculation.h"
+#include "NMPC_RTI_Solver.h"
+
+#include <algorithm>
+
+#define SPECULATION_WAIT_TIMEOUT        100     // the worker looks for a termination request now and then
+#define SPECULATION_MAX_ITERATIONS      50      // real-time iterations until the solve is taken as converged
+#define SPECULATION_TOLERANCE           1e-6    // largest input change of a converged iteration
+#define SPECULATION_HEADING_TOLERANCE   0.05    // rad, heading change which needs a new solve
+
+NMPC_ManeuverSpeculation::NMPC_ManeuverSpeculation()
+    : m_bCreated(tFalse),
+      m_pSolver(NULL),
+      m_nRequestId(0),
+      m_nSolvedId(0),
+      m_nResultSize(0),
+      m_bResultValid(tFalse)
+{
+    memset(&m_sRequest, 0, sizeof(m_sRequest));
+    m_sRequest.maneuver = -1;
+    m_sResultProblem = m_sRequest;
+}
+
+NMPC_ManeuverSpeculation::~NMPC_ManeuverSpeculation()
+{
+    Destroy();
+}
+
+tResult NMPC_ManeuverSpeculation::Create()
+{
+    if (m_bCreated)
+        RETURN_NOERROR;
+
+    m_pSolver = new NMPC_RTISolver();
+    m_pSolver->Setup();
+
+    RETURN_IF_FAILED(m_oRequestEvent.Create());
+    RETURN_IF_FAILED(m_oThread.Create(cKernelThread::TF_Suspended, static_cast<IKernelThreadFunc*>(this)));
+    RETURN_IF_FAILED(m_oThread.Run());
+    m_bCreated = tTrue;
+
+    RETURN_NOERROR;
+}
+
+tResult NMPC_ManeuverSpeculation::Destroy()
+{
+    if (!m_bCreated)
+        RETURN_NOERROR;
+    m_bCreated = tFalse;
+
+    // the event wakes the worker, Terminate() waits until the current call of ThreadFunc returns
+    m_oRequestEvent.Set();
+    m_oThread.Terminate(tTrue);
+    m_oThread.Release();
+    m_oRequestEvent.Delete();
+
+    delete m_pSolver;
+    m_pSolver = NULL;
+
+    RETURN_NOERROR;
+}
+
+bool NMPC_ManeuverSpeculation::SameProblem(const SPECULATION_PROBLEM& a, const SPECULATION_PROBLEM& b)
+{
+    return a.maneuver == b.maneuver
+            && fabs(a.heading_offset - b.heading_offset) < SPECULATION_HEADING_TOLERANCE
+            && a.speed == b.speed
+            && memcmp(&a.weights, &b.weights, sizeof(a.weights)) == 0
+            && memcmp(a.lower, b.lower, sizeof(a.lower)) == 0
+            && memcmp(a.upper, b.upper, sizeof(a.upper)) == 0;
+}
+
+tVoid NMPC_ManeuverSpeculation::Request(int maneuver, double heading_offset, double speed, const NMPC_WEIGHTS& weights,
+                                        const double *lower, const double *upper)
+{
+    if (!m_bCreated)
+        return;
+
+    SPECULATION_PROBLEM problem;
+    problem.maneuver = maneuver;
+    problem.heading_offset = heading_offset;
+    problem.speed = speed;
+    problem.weights = weights;
+    memcpy(problem.lower, lower, sizeof(problem.lower));
+    memcpy(problem.upper, upper, sizeof(problem.upper));
+
+    {
+        __synchronized_obj(m_oLock);
+        // called every cycle during the approach, only a changed problem is solved again
+        if (SameProblem(problem, m_sRequest))
+            return;
+        m_sRequest = problem;
+        m_nRequestId++;
+        m_bResultValid = tFalse;
+    }
+    m_oRequestEvent.Set();
+}
+
+tVoid NMPC_ManeuverSpeculation::Cancel()
+{
+    __synchronized_obj(m_oLock);
+    m_sRequest.maneuver = -1;
+    m_nRequestId++;
+    m_bResultValid = tFalse;
+}
+
+tBool NMPC_ManeuverSpeculation::Take(int maneuver, double heading_offset, TURN_AROUND_REFERENCE_COORDINATE *reference,
+                                     int *size, double *xx)
+{
+    __synchronized_obj(m_oLock);
+    if (!m_bResultValid || m_sResultProblem.maneuver != maneuver
+            || fabs(m_sResultProblem.heading_offset - heading_offset) >= SPECULATION_HEADING_TOLERANCE)
+        return tFalse;
+
+    memcpy(reference, &m_sResultReference, sizeof(m_sResultReference));
+    *size = m_nResultSize;
+    memcpy(xx, m_aResult, sizeof(m_aResult));
+
+    // one solve per approach
+    m_bResultValid = tFalse;
+    m_sRequest.maneuver = -1;
+    return tTrue;
+}
+
+tResult NMPC_ManeuverSpeculation::ThreadFunc(cKernelThread* /*pThread*/, tVoid* /*pvUserData*/, tSize /*szUserData*/)
+{
+    m_oRequestEvent.Wait(SPECULATION_WAIT_TIMEOUT);
+    // a request posted from here on sets the event again
+    m_oRequestEvent.Reset();
+
+    SPECULATION_PROBLEM problem;
+    int id;
+    {
+        __synchronized_obj(m_oLock);
+        if (m_nRequestId == m_nSolvedId || m_sRequest.maneuver < 0)
+            RETURN_NOERROR;
+        problem = m_sRequest;
+        id = m_nRequestId;
+        m_nSolvedId = id;
+    }
+
+    // reference of the first round of CalculateTurnAroundReferencePoint, before the rotation
+    TURN_AROUND_REFERENCE_COORDINATE reference;
+    int size = SOP_AutonomousDriving::ManeuverLocalReference(problem.maneuver, &reference);
+    if (size < N + 1)
+        RETURN_NOERROR;
+
+    // all points a solve may read, as the window of the live solve (WriteManeuverWindow)
+    COORDINATE_STRUCT mpc_reference;
+    for (int k = 0; k <= NMPC_MAX_HORIZON; k++)
+    {
+        int index = (k < size) ? k : size - 1;
+        mpc_reference.X[k] = reference.X[index];
+        mpc_reference.Y[k] = reference.Y[index];
+    }
+
+    // the car enters the maneuver at the reference speed with straight wheels
+    double x0[NX] = {0, 0, problem.heading_offset};
+    m_pSolver->Reset();
+    m_pSolver->SetWeights(problem.weights);
+    m_pSolver->SetBounds(problem.lower, problem.upper);
+    m_pSolver->SetReference(mpc_reference, problem.speed);
+    m_pSolver->SetInitialState(x0, problem.speed, 0);
+
+    double xx[N*NXU + NX];
+    double xx_last[N*NXU + NX];
+    memset(xx_last, 0, sizeof(xx_last));
+    for (int i = 0; i < SPECULATION_MAX_ITERATIONS; i++)
+    {
+        m_pSolver->Solve(problem.maneuver, 0);
+        m_pSolver->GetSolution(xx);
+
+        double change = 0;
+        for (int k = 0; k < N; k++)
+        {
+            change = std::max(change, fabs(xx[k*NXU + 3] - xx_last[k*NXU + 3]));
+            change = std::max(change, fabs(xx[k*NXU + 4] - xx_last[k*NXU + 4]));
+        }
+        memcpy(xx_last, xx, sizeof(xx));
+        if (change < SPECULATION_TOLERANCE)
+            break;
+
+        // a newer problem makes this one useless
+        __synchronized_obj(m_oLock);
+        if (id != m_nRequestId)
+            RETURN_NOERROR;
+    }
+
+    __synchronized_obj(m_oLock);
+    if (id != m_nRequestId)
+        RETURN_NOERROR;
+    m_sResultProblem = problem;
+    memcpy(&m_sResultReference, &reference, sizeof(reference));
+    m_nResultSize = size;
+    memcpy(m_aResult, xx, sizeof(m_aResult));
+    m_bResultValid = tTrue;
+
+    RETURN_NOERROR;
+}
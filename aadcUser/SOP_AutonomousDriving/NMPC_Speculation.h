@@ -0,0 +1,86 @@
+#ifndef _NMPC_SPECULATION_H_
+#define _NMPC_SPECULATION_H_
+
+#include "SOP_AutonomousDriving.h"
+
+class NMPC_RTISolver;
+
+/*! Solves the maneuver after a crossing in the background while the car approaches it.
+ *
+ *  The filter posts the next maneuver of the maneuver list (TURN_LEFT, TURN_RIGHT or STRAIGHT)
+ *  as long as the crossing sign is active. A worker thread builds the Bezier reference of the
+ *  maneuver and iterates its own RTI solver on it to convergence. Reference and trajectory are
+ *  kept in the frame of CalculateTurnAroundReferencePoint before the rotation to the road
+ *  quadrant, so they do not depend on where the car stops; only the heading of the car relative
+ *  to the road enters the problem. On the first tick of the maneuver the filter takes both and
+ *  moves them into the world frame.
+ *
+ *  The worker uses an RTI instance, the Ipopt NLP exists only once and belongs to the filter.
+ */
+class NMPC_ManeuverSpeculation : public IKernelThreadFunc
+{
+public:
+    NMPC_ManeuverSpeculation();
+    virtual ~NMPC_ManeuverSpeculation();
+
+    /*! starts the worker */
+    tResult Create();
+    /*! stops the worker, a running solve is finished first */
+    tResult Destroy();
+
+    /*! posts the problem of a maneuver, nothing happens if the same problem is posted already
+     *  \param maneuver        TURN_LEFT, TURN_RIGHT or STRAIGHT
+     *  \param heading_offset  heading of the car relative to the road quadrant
+     *  \param speed           reference speed of the maneuver
+     *  \param weights         weights in the frame of the road quadrant
+     *  \param lower, upper    bounds of {x, y, psi, v, delta}
+     */
+    tVoid Request(int maneuver, double heading_offset, double speed, const NMPC_WEIGHTS& weights,
+                  const double *lower, const double *upper);
+
+    /*! drops the posted problem and the finished solve */
+    tVoid Cancel();
+
+    /*! hands over the finished solve of maneuver, a solve for a different heading is dropped
+     *  \param reference  the Bezier reference in the frame of the road quadrant
+     *  \param size       number of points of reference
+     *  \param xx         the trajectory in the same frame, layout of NMPC_Solver::GetSolution()
+     *  \return tTrue if reference and xx have been written
+     */
+    tBool Take(int maneuver, double heading_offset, TURN_AROUND_REFERENCE_COORDINATE *reference, int *size, double *xx);
+
+    tResult ThreadFunc(cKernelThread* pThread, tVoid* pvUserData, tSize szUserData);
+
+private:
+    typedef struct _SPECULATION_PROBLEM
+    {
+        int maneuver;
+        double heading_offset;
+        double speed;
+        NMPC_WEIGHTS weights;
+        double lower[NXU];
+        double upper[NXU];
+    } SPECULATION_PROBLEM;
+
+    /*! \return true if both problems lead to the same solution within the heading tolerance */
+    static bool SameProblem(const SPECULATION_PROBLEM& a, const SPECULATION_PROBLEM& b);
+
+    cKernelThread m_oThread;
+    cKernelEvent m_oRequestEvent;
+    cCriticalSection m_oLock;
+    tBool m_bCreated;
+
+    NMPC_RTISolver *m_pSolver;              // used by the worker only
+
+    SPECULATION_PROBLEM m_sRequest;         // guarded by m_oLock
+    int m_nRequestId;
+    int m_nSolvedId;
+
+    SPECULATION_PROBLEM m_sResultProblem;   // guarded by m_oLock
+    TURN_AROUND_REFERENCE_COORDINATE m_sResultReference;
+    int m_nResultSize;
+    double m_aResult[N*NXU + NX];
+    tBool m_bResultValid;
+};
+
+#endif // _NMPC_SPECULATION_H_
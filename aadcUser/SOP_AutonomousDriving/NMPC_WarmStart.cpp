@@ -0,0 +1,223 @@
+#include "NMPC_WarmStart.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace Ipopt;
+
+NMPC_WarmStartNLP::NMPC_WarmStartNLP(const SmartPtr<TNLP>& nlp, int horizon, int nx, int nxu,
+                                     double *x, double *z_L, double *z_U, double *lambda)
+    : m_pNLP(nlp),
+      m_nHorizon(horizon),
+      m_nX(nx),
+      m_nXU(nxu),
+      m_nVariables(horizon * nxu + nx),
+      m_nConstraints((horizon + 1) * nx + horizon + 1),
+      m_pX(x),
+      m_pZL(z_L),
+      m_pZU(z_U),
+      m_pLambda(lambda),
+      m_bValid(false),
+      m_bSeeded(false),
+      m_nCarStateFlag(-1)
+{
+}
+
+NMPC_WarmStartNLP::~NMPC_WarmStartNLP()
+{
+}
+
+bool NMPC_WarmStartNLP::Prepare(int car_state_flag, double shift_steps, bool moving_frame)
+{
+    if (car_state_flag != m_nCarStateFlag)
+    {
+        m_bValid = false;
+        m_bSeeded = false;
+    }
+    m_nCarStateFlag = car_state_flag;
+
+    // nothing to shift if the last solve is older than the whole horizon
+    if (!m_bValid || shift_steps < 0 || shift_steps >= m_nHorizon)
+    {
+        m_bValid = false;
+        return false;
+    }
+
+    for (int j = 0; j < m_nXU; j++)
+    {
+        int last_stage = (j < m_nX) ? m_nHorizon : m_nHorizon - 1;
+        ShiftComponent(m_pX + j, m_nXU, last_stage, shift_steps);
+        ShiftComponent(m_pZL + j, m_nXU, last_stage, shift_steps);
+        ShiftComponent(m_pZU + j, m_nXU, last_stage, shift_steps);
+    }
+    for (int j = 0; j < m_nX; j++)
+        ShiftComponent(m_pLambda + j, m_nX, m_nHorizon, shift_steps);
+    ShiftComponent(m_pLambda + (m_nHorizon + 1) * m_nX, 1, m_nHorizon, shift_steps);
+
+    if (moving_frame)
+        RebaseToFirstStage();
+
+    return true;
+}
+
+void NMPC_WarmStartNLP::Invalidate()
+{
+    m_bValid = false;
+    m_bSeeded = false;
+}
+
+void NMPC_WarmStartNLP::Seed(const double *x, int car_state_flag)
+{
+    memcpy(m_pX, x, m_nVariables * sizeof(double));
+    m_nCarStateFlag = car_state_flag;
+    m_bValid = false;
+    m_bSeeded = true;
+}
+
+void NMPC_WarmStartNLP::ShiftComponent(double *v, int stride, int last_stage, double shift_steps)
+{
+    int whole = static_cast<int>(floor(shift_steps));
+    double frac = shift_steps - whole;
+
+    for (int i = 0; i <= last_stage; i++)
+    {
+        int i0 = i + whole;
+        int i1 = i0 + 1;
+        if (i0 > last_stage)
+            i0 = last_stage;
+        if (i1 > last_stage)
+            i1 = last_stage;
+        v[i * stride] = (1.0 - frac) * v[i0 * stride] + frac * v[i1 * stride];
+    }
+}
+
+void NMPC_WarmStartNLP::RebaseToFirstStage()
+{
+    const double x0 = m_pX[0];
+    const double y0 = m_pX[1];
+    const double psi0 = m_pX[2];
+    const double c = cos(psi0);
+    const double s = sin(psi0);
+
+    for (int i = 0; i <= m_nHorizon; i++)
+    {
+        double *stage = m_pX + i * m_nXU;
+        double dx = stage[0] - x0;
+        double dy = stage[1] - y0;
+        stage[0] =  c * dx + s * dy;
+        stage[1] = -s * dx + c * dy;
+        stage[2] -= psi0;
+
+        // the multipliers of the x/y dynamic constraints turn with the frame
+        double *mult = m_pLambda + i * m_nX;
+        double lx = mult[0];
+        double ly = mult[1];
+        mult[0] =  c * lx + s * ly;
+        mult[1] = -s * lx + c * ly;
+    }
+}
+
+bool NMPC_WarmStartNLP::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g, Index& nnz_h_lag,
+                                     IndexStyleEnum& index_style)
+{
+    return m_pNLP->get_nlp_info(n, m, nnz_jac_g, nnz_h_lag, index_style);
+}
+
+bool NMPC_WarmStartNLP::get_bounds_info(Index n, Number* x_l, Number* x_u, Index m, Number* g_l, Number* g_u)
+{
+    return m_pNLP->get_bounds_info(n, x_l, x_u, m, g_l, g_u);
+}
+
+bool NMPC_WarmStartNLP::get_starting_point(Index n, bool init_x, Number* x, bool init_z, Number* z_L,
+                                           Number* z_U, Index m, bool init_lambda, Number* lambda)
+{
+    if (m_bSeeded && n == m_nVariables && m == m_nConstraints)
+    {
+        // primal guess only, everything else as in a cold start
+        if (!m_pNLP->get_starting_point(n, init_x, x, init_z, z_L, z_U, m, init_lambda, lambda))
+            return false;
+        if (init_x)
+            memcpy(x, m_pX, n * sizeof(Number));
+        return true;
+    }
+
+    if (!m_bValid || n != m_nVariables || m != m_nConstraints)
+        return m_pNLP->get_starting_point(n, init_x, x, init_z, z_L, z_U, m, init_lambda, lambda);
+
+    if (init_x)
+        memcpy(x, m_pX, n * sizeof(Number));
+    if (init_z)
+    {
+        memcpy(z_L, m_pZL, n * sizeof(Number));
+        memcpy(z_U, m_pZU, n * sizeof(Number));
+    }
+    if (init_lambda)
+        memcpy(lambda, m_pLambda, m * sizeof(Number));
+
+    return true;
+}
+
+bool NMPC_WarmStartNLP::eval_f(Index n, const Number* x, bool new_x, Number& obj_value)
+{
+    return m_pNLP->eval_f(n, x, new_x, obj_value);
+}
+
+bool NMPC_WarmStartNLP::eval_grad_f(Index n, const Number* x, bool new_x, Number* grad_f)
+{
+    return m_pNLP->eval_grad_f(n, x, new_x, grad_f);
+}
+
+bool NMPC_WarmStartNLP::eval_g(Index n, const Number* x, bool new_x, Index m, Number* g)
+{
+    return m_pNLP->eval_g(n, x, new_x, m, g);
+}
+
+bool NMPC_WarmStartNLP::eval_jac_g(Index n, const Number* x, bool new_x, Index m, Index nele_jac,
+                                   Index* iRow, Index *jCol, Number* values)
+{
+    return m_pNLP->eval_jac_g(n, x, new_x, m, nele_jac, iRow, jCol, values);
+}
+
+bool NMPC_WarmStartNLP::eval_h(Index n, const Number* x, bool new_x, Number obj_factor, Index m,
+                               const Number* lambda, bool new_lambda, Index nele_hess,
+                               Index* iRow, Index* jCol, Number* values)
+{
+    return m_pNLP->eval_h(n, x, new_x, obj_factor, m, lambda, new_lambda, nele_hess, iRow, jCol, values);
+}
+
+void NMPC_WarmStartNLP::finalize_solution(SolverReturn status, Index n, const Number* x,
+                                          const Number* z_L, const Number* z_U, Index m,
+                                          const Number* g, const Number* lambda, Number obj_value,
+                                          const IpoptData* ip_data, IpoptCalculatedQuantities* ip_cq)
+{
+    m_bValid = false;
+    m_bSeeded = false;
+    if ((status == SUCCESS || status == STOP_AT_ACCEPTABLE_POINT)
+            && n == m_nVariables && m == m_nConstraints)
+    {
+        memcpy(m_pX, x, n * sizeof(Number));
+        memcpy(m_pZL, z_L, n * sizeof(Number));
+        memcpy(m_pZU, z_U, n * sizeof(Number));
+        memcpy(m_pLambda, lambda, m * sizeof(Number));
+        m_bValid = true;
+    }
+
+    m_pNLP->finalize_solution(status, n, x, z_L, z_U, m, g, lambda, obj_value, ip_data, ip_cq);
+}
+
+bool NMPC_WarmStartNLP::intermediate_callback(AlgorithmMode mode, Index iter, Number obj_value,
+                                              Number inf_pr, Number inf_du, Number mu, Number d_norm,
+                                              Number regularization_size, Number alpha_du, Number alpha_pr,
+                                              Index ls_trials, const IpoptData* ip_data,
+                                              IpoptCalculatedQuantities* ip_cq)
+{
+    return m_pNLP->intermediate_callback(mode, iter, obj_value, inf_pr, inf_du, mu, d_norm,
+                                         regularization_size, alpha_du, alpha_pr, ls_trials, ip_data, ip_cq);
+}
+
+bool NMPC_WarmStartNLP::get_scaling_parameters(Number& obj_scaling, bool& use_x_scaling, Index n,
+                                               Number* x_scaling, bool& use_g_scaling, Index m,
+                                               Number* g_scaling)
+{
+    return m_pNLP->get_scaling_parameters(obj_scaling, use_x_scaling, n, x_scaling, use_g_scaling, m, g_scaling);
+}
@@ -0,0 +1,113 @@
+#ifndef _NMPC_WARM_START_H_
+#define _NMPC_WARM_START_H_
+
+#include "IpTNLP.hpp"
+
+/*! TNLP decorator which warm starts the wrapped NMPC problem.
+ *
+ *  The primal solution, the bound multipliers and the constraint multipliers of the
+ *  last successful solve are kept in the arrays handed over in the constructor
+ *  (the global XX, ZL, ZU and LAMBDA of the NMPC controller). Before the next solve
+ *  the horizon is shifted forward by the time elapsed since the last solve and handed
+ *  to Ipopt as starting point, so the interior point method starts next to the optimum
+ *  instead of at the cold initial guess of the wrapped NLP.
+ *
+ *  Expected layout (see Nmpc/parameter_settings.h):
+ *  x      = [x y psi v delta]_0 ... [x y psi v delta]_N-1 [x y psi]_N
+ *  lambda = [x y psi]_0 ... [x y psi]_N [c_0 ... c_N]
+ */
+class NMPC_WarmStartNLP : public Ipopt::TNLP
+{
+public:
+    /*! \param nlp      the NMPC problem which is solved
+     *  \param horizon  number of control intervals N
+     *  \param nx       number of states per stage
+     *  \param nxu      number of states and inputs per stage
+     *  \param x        storage for the primal solution (horizon*nxu + nx)
+     *  \param z_L      storage for the lower bound multipliers (horizon*nxu + nx)
+     *  \param z_U      storage for the upper bound multipliers (horizon*nxu + nx)
+     *  \param lambda   storage for the constraint multipliers ((horizon+1)*nx + horizon+1)
+     */
+    NMPC_WarmStartNLP(const Ipopt::SmartPtr<Ipopt::TNLP>& nlp, int horizon, int nx, int nxu,
+                      double *x, double *z_L, double *z_U, double *lambda);
+    virtual ~NMPC_WarmStartNLP();
+
+    /*! Prepares the starting point for the next solve.
+     *  \param car_state_flag   the maneuver of the next solve, a change drops the stored solution
+     *  \param shift_steps      elapsed time since the last solve in multiples of DT
+     *  \param moving_frame     the problem is formulated in the car frame (lane following),
+     *                          the shifted solution is moved into the new car frame
+     *  \return true if a warm start is available for the next solve
+     */
+    bool Prepare(int car_state_flag, double shift_steps, bool moving_frame);
+
+    /*! Drops the stored solution, the next solve is a cold start */
+    void Invalidate();
+
+    /*! Replaces the stored solution by a primal guess computed elsewhere. The next solve of
+     *  car_state_flag starts from x as it is (no shift), the multipliers come from the wrapped NLP.
+     *  \param x  primal starting point (horizon*nxu + nx)
+     */
+    void Seed(const double *x, int car_state_flag);
+
+    /*! \return true if the last solve has left a usable solution */
+    bool IsValid() const { return m_bValid; }
+
+    /*! \return true if the next solve starts from a guess handed over by Seed() */
+    bool IsSeeded() const { return m_bSeeded; }
+
+    virtual bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                              Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+    virtual bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l, Ipopt::Number* x_u,
+                                 Ipopt::Index m, Ipopt::Number* g_l, Ipopt::Number* g_u);
+    virtual bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number* x,
+                                    bool init_z, Ipopt::Number* z_L, Ipopt::Number* z_U,
+                                    Ipopt::Index m, bool init_lambda, Ipopt::Number* lambda);
+    virtual bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number& obj_value);
+    virtual bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number* grad_f);
+    virtual bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Index m, Ipopt::Number* g);
+    virtual bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Index m,
+                            Ipopt::Index nele_jac, Ipopt::Index* iRow, Ipopt::Index *jCol, Ipopt::Number* values);
+    virtual bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x, Ipopt::Number obj_factor,
+                        Ipopt::Index m, const Ipopt::Number* lambda, bool new_lambda,
+                        Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol, Ipopt::Number* values);
+    virtual void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n, const Ipopt::Number* x,
+                                   const Ipopt::Number* z_L, const Ipopt::Number* z_U,
+                                   Ipopt::Index m, const Ipopt::Number* g, const Ipopt::Number* lambda,
+                                   Ipopt::Number obj_value, const Ipopt::IpoptData* ip_data,
+                                   Ipopt::IpoptCalculatedQuantities* ip_cq);
+    virtual bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+                                       Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+                                       Ipopt::Number d_norm, Ipopt::Number regularization_size,
+                                       Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                                       const Ipopt::IpoptData* ip_data, Ipopt::IpoptCalculatedQuantities* ip_cq);
+    virtual bool get_scaling_parameters(Ipopt::Number& obj_scaling, bool& use_x_scaling, Ipopt::Index n,
+                                        Ipopt::Number* x_scaling, bool& use_g_scaling, Ipopt::Index m,
+                                        Ipopt::Number* g_scaling);
+
+private:
+    /*! shifts one component of a stage structured vector forward in time, the tail is held
+     *  at the value of the last stage (linear interpolation for fractional shifts, works in place) */
+    void ShiftComponent(double *v, int stride, int last_stage, double shift_steps);
+    /*! moves the shifted primal solution into the car frame located at its first stage */
+    void RebaseToFirstStage();
+
+    Ipopt::SmartPtr<Ipopt::TNLP> m_pNLP;
+
+    int m_nHorizon;
+    int m_nX;
+    int m_nXU;
+    int m_nVariables;
+    int m_nConstraints;
+
+    double *m_pX;
+    double *m_pZL;
+    double *m_pZU;
+    double *m_pLambda;
+
+    bool m_bValid;
+    bool m_bSeeded;
+    int m_nCarStateFlag;
+};
+
+#endif // _NMPC_WARM_START_H_
@@ -0,0 +1,159 @@
+#include "Occupancy_Grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+OccupancyGrid::OccupancyGrid()
+{
+    Reset();
+}
+
+void OccupancyGrid::Reset()
+{
+    memset(m_cells, 0, sizeof(m_cells));
+    m_dX = 0;
+    m_dY = 0;
+    m_dCos = 1;
+    m_dSin = 0;
+    m_nColumn = -OCCUPANCY_GRID_SIZE / 2;
+    m_nRow = -OCCUPANCY_GRID_SIZE / 2;
+}
+
+void OccupancyGrid::SetPose(double x, double y, double heading)
+{
+    m_dX = x;
+    m_dY = y;
+    m_dCos = cos(heading);
+    m_dSin = sin(heading);
+
+    int column = static_cast<int>(floor(x / OCCUPANCY_GRID_CELL)) - OCCUPANCY_GRID_SIZE / 2;
+    int row = static_cast<int>(floor(y / OCCUPANCY_GRID_CELL)) - OCCUPANCY_GRID_SIZE / 2;
+    if (abs(column - m_nColumn) >= OCCUPANCY_GRID_SIZE || abs(row - m_nRow) >= OCCUPANCY_GRID_SIZE)
+    {
+        memset(m_cells, 0, sizeof(m_cells));
+        m_nColumn = column;
+        m_nRow = row;
+        return;
+    }
+
+    // the cells which come in use the storage of the cells which drop out
+    if (column > m_nColumn)
+        ClearColumns(m_nColumn + OCCUPANCY_GRID_SIZE, column + OCCUPANCY_GRID_SIZE - 1);
+    else if (column < m_nColumn)
+        ClearColumns(column, m_nColumn - 1);
+    m_nColumn = column;
+
+    if (row > m_nRow)
+        ClearRows(m_nRow + OCCUPANCY_GRID_SIZE, row + OCCUPANCY_GRID_SIZE - 1);
+    else if (row < m_nRow)
+        ClearRows(row, m_nRow - 1);
+    m_nRow = row;
+}
+
+void OccupancyGrid::ClearColumns(int first, int last)
+{
+    for (int row = 0; row < OCCUPANCY_GRID_SIZE; row++)
+    {
+        for (int column = first; column <= last; column++)
+            m_cells[row][column & (OCCUPANCY_GRID_SIZE - 1)] = 0;
+    }
+}
+
+void OccupancyGrid::ClearRows(int first, int last)
+{
+    for (int row = first; row <= last; row++)
+        memset(m_cells[row & (OCCUPANCY_GRID_SIZE - 1)], 0, sizeof(m_cells[0]));
+}
+
+/* car frame, y to the right, into the global cells of the odometry frame, y to the left */
+void OccupancyGrid::ToCell(float x, float y, int *column, int *row) const
+{
+    double odometry_x = m_dX + m_dCos * x + m_dSin * y;
+    double odometry_y = m_dY + m_dSin * x - m_dCos * y;
+    *column = static_cast<int>(floor(odometry_x / OCCUPANCY_GRID_CELL));
+    *row = static_cast<int>(floor(odometry_y / OCCUPANCY_GRID_CELL));
+}
+
+bool OccupancyGrid::InGrid(int column, int row) const
+{
+    return column >= m_nColumn && column < m_nColumn + OCCUPANCY_GRID_SIZE
+            && row >= m_nRow && row < m_nRow + OCCUPANCY_GRID_SIZE;
+}
+
+void OccupancyGrid::AddRay(float sensor_x, float sensor_y, float end_x, float end_y, bool hit)
+{
+    int column, row, end_column, end_row;
+    ToCell(sensor_x, sensor_y, &column, &row);
+    ToCell(end_x, end_y, &end_column, &end_row);
+
+    // Bresenham from the sensor to the end cell
+    int dx = abs(end_column - column);
+    int dy = -abs(end_row - row);
+    int step_x = (column < end_column) ? 1 : -1;
+    int step_y = (row < end_row) ? 1 : -1;
+    int error = dx + dy;
+    while (column != end_column || row != end_row)
+    {
+        if (InGrid(column, row))
+        {
+            signed char& cell = Cell(column, row);
+            cell = static_cast<signed char>(std::max(cell - OCCUPANCY_MISS, -OCCUPANCY_LIMIT));
+        }
+        int error2 = 2 * error;
+        if (error2 >= dy)
+        {
+            error += dy;
+            column += step_x;
+        }
+        if (error2 <= dx)
+        {
+            error += dx;
+            row += step_y;
+        }
+    }
+
+    if (InGrid(column, row))
+    {
+        signed char& cell = Cell(column, row);
+        if (hit)
+            cell = static_cast<signed char>(std::min(cell + OCCUPANCY_HIT, OCCUPANCY_LIMIT));
+        else
+            cell = static_cast<signed char>(std::max(cell - OCCUPANCY_MISS, -OCCUPANCY_LIMIT));
+    }
+}
+
+float OccupancyGrid::FreeDistance(float x, float y, float direction, float max_range) const
+{
+    const float step = OCCUPANCY_GRID_CELL / 2;
+    float step_x = static_cast<float>(sin(direction)) * step;
+    float step_y = static_cast<float>(cos(direction)) * step;
+
+    for (float distance = 0; distance < max_range; distance += step)
+    {
+        int column, row;
+        ToCell(x, y, &column, &row);
+        if (InGrid(column, row) && Cell(column, row) >= OCCUPANCY_OCCUPIED)
+            return distance;
+        x += step_x;
+        y += step_y;
+    }
+    return max_range;
+}
+
+bool OccupancyGrid::IsOccupied(float x_min, float x_max, float y_min, float y_max) const
+{
+    const float step = OCCUPANCY_GRID_CELL / 2;
+    for (float x = x_min; x <= x_max; x += step)
+    {
+        for (float y = y_min; y <= y_max; y += step)
+        {
+            int column, row;
+            ToCell(x, y, &column, &row);
+            if (InGrid(column, row) && Cell(column, row) >= OCCUPANCY_OCCUPIED)
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#ifndef _OCCUPANCY_GRID_H_
+#define _OCCUPANCY_GRID_H_
+
+#define OCCUPANCY_GRID_SIZE     128     // cells per edge, a power of two
+#define OCCUPANCY_GRID_CELL     5.0f    // cm, edge of a cell
+#define OCCUPANCY_HIT           16      // log-odds of a return in the cell
+#define OCCUPANCY_MISS          8       // log-odds of a ray through the cell
+#define OCCUPANCY_LIMIT         64      // log-odds saturate at +-OCCUPANCY_LIMIT
+#define OCCUPANCY_OCCUPIED      16      // cells from this log-odds on are occupied
+
+/*! Occupancy of the surroundings of the car from the ultrasonic rays, in log-odds per cell.
+ *
+ *  The grid is fixed to the odometry frame and rolls with the car: when the car leaves the center
+ *  cell, the cells which drop out at one edge are cleared and come in at the other, nothing else
+ *  moves. The positions of the rays and of the queries are in the car frame of ult_world_coord,
+ *  cm with x forward and y to the right, at the pose of the last SetPose().
+ *  An unknown cell has log-odds 0 and counts as free.
+ */
+class OccupancyGrid
+{
+public:
+    OccupancyGrid();
+
+    void Reset();
+    /*! \param x, y     cm, odometry frame
+     *  \param heading  rad, counter clockwise */
+    void SetPose(double x, double y, double heading);
+
+    /*! ray of a sensor at (sensor_x, sensor_y) to (end_x, end_y), the cells before the end get
+     *  free, the end cell gets occupied if hit, car frame */
+    void AddRay(float sensor_x, float sensor_y, float end_x, float end_y, bool hit);
+
+    /*! \return cm from (x, y) along the direction to the first occupied cell, max_range if there is none
+     *  \param direction  rad in the car frame, the convention of the sensor angles: (sin, cos) is (x, y) */
+    float FreeDistance(float x, float y, float direction, float max_range) const;
+    /*! \return whether an occupied cell lies in the box, car frame */
+    bool IsOccupied(float x_min, float x_max, float y_min, float y_max) const;
+
+private:
+    void ToCell(float x, float y, int *column, int *row) const;
+    signed char& Cell(int column, int row) { return m_cells[row & (OCCUPANCY_GRID_SIZE - 1)][column & (OCCUPANCY_GRID_SIZE - 1)]; }
+    signed char Cell(int column, int row) const { return m_cells[row & (OCCUPANCY_GRID_SIZE - 1)][column & (OCCUPANCY_GRID_SIZE - 1)]; }
+    bool InGrid(int column, int row) const;
+    void ClearColumns(int first, int last);
+    void ClearRows(int first, int last);
+
+    signed char m_cells[OCCUPANCY_GRID_SIZE][OCCUPANCY_GRID_SIZE];  // by global cell, modulo the size
+    double m_dX;
+    double m_dY;
+    double m_dCos;
+    double m_dSin;
+    int m_nColumn;          // global cell of the left and the bottom edge
+    int m_nRow;
+};
+
+#endif // _OCCUPANCY_GRID_H_
@@ -0,0 +1,153 @@
+#ifndef _POLYNOMIAL_FIT_H_
+#define _POLYNOMIAL_FIT_H_
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*! One point set of a batch fit */
+typedef struct _POLYNOMIAL_FIT_SET
+{
+    const double *x;
+    const double *y;
+    int size;
+    double *coefficients;   // DEGREE + 1 values, the constant first
+} POLYNOMIAL_FIT_SET;
+
+/*! Least squares fit of y = c0 + c1*x + ... + cD*x^D, D = DEGREE fixed at compile time.
+ *
+ *  The moment sums of the normal equations are accumulated two points at a time with SSE2 and
+ *  the equations are solved by a Cholesky decomposition of fixed size. x is divided by its largest
+ *  magnitude before, so the normal matrix stays well conditioned for points in cm. Nothing is
+ *  allocated.
+ */
+template <int DEGREE>
+class PolynomialFit
+{
+public:
+    enum { TERMS = DEGREE + 1, MOMENTS = 2 * DEGREE + 1 };
+
+    /*! \return false if there are too few points or the points do not determine the polynomial,
+     *  the coefficients are 0 then */
+    static bool Fit(const double *x, const double *y, int size, double *coefficients)
+    {
+        for (int i = 0; i < TERMS; i++)
+            coefficients[i] = 0;
+        if (size < TERMS)
+            return false;
+
+        double scale = 0;
+        for (int i = 0; i < size; i++)
+            scale = std::max(scale, fabs(x[i]));
+        if (scale == 0)
+            return false;
+
+        double moments[MOMENTS];
+        double rhs[TERMS];
+        Accumulate(x, y, size, 1.0 / scale, moments, rhs);
+
+        NormalMatrix A;
+        Vector b;
+        for (int i = 0; i < TERMS; i++)
+        {
+            for (int j = 0; j < TERMS; j++)
+                A(i, j) = moments[i + j];
+            b(i) = rhs[i];
+        }
+
+        Eigen::LLT<NormalMatrix> llt(A);
+        if (llt.info() != Eigen::Success)
+            return false;
+        Vector c = llt.solve(b);
+
+        // back from x / scale to x
+        double power = 1;
+        for (int i = 0; i < TERMS; i++)
+        {
+            coefficients[i] = c(i) / power;
+            power *= scale;
+        }
+        return true;
+    }
+
+    /*! fits every set of the batch
+     *  \return number of sets which could be fitted */
+    static int FitBatch(POLYNOMIAL_FIT_SET *sets, int count)
+    {
+        int fitted = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (Fit(sets[i].x, sets[i].y, sets[i].size, sets[i].coefficients))
+                fitted++;
+        }
+        return fitted;
+    }
+
+private:
+    typedef Eigen::Matrix<double, TERMS, TERMS> NormalMatrix;
+    typedef Eigen::Matrix<double, TERMS, 1> Vector;
+
+    /*! moments[k] = sum t^k, rhs[k] = sum t^k * y with t = x * inv_scale */
+    static void Accumulate(const double *x, const double *y, int size, double inv_scale, double *moments, double *rhs)
+    {
+        int i = 0;
+#ifdef __SSE2__
+        __m128d m[MOMENTS];
+        __m128d r[TERMS];
+        for (int k = 0; k < MOMENTS; k++)
+            m[k] = _mm_setzero_pd();
+        for (int k = 0; k < TERMS; k++)
+            r[k] = _mm_setzero_pd();
+
+        const __m128d s = _mm_set1_pd(inv_scale);
+        for (; i + 1 < size; i += 2)
+        {
+            __m128d t = _mm_mul_pd(_mm_loadu_pd(x + i), s);
+            __m128d yy = _mm_loadu_pd(y + i);
+            __m128d p = _mm_set1_pd(1.0);
+            for (int k = 0; k < MOMENTS; k++)
+            {
+                m[k] = _mm_add_pd(m[k], p);
+                if (k < TERMS)
+                    r[k] = _mm_add_pd(r[k], _mm_mul_pd(p, yy));
+                p = _mm_mul_pd(p, t);
+            }
+        }
+
+        double lanes[2];
+        for (int k = 0; k < MOMENTS; k++)
+        {
+            _mm_storeu_pd(lanes, m[k]);
+            moments[k] = lanes[0] + lanes[1];
+        }
+        for (int k = 0; k < TERMS; k++)
+        {
+            _mm_storeu_pd(lanes, r[k]);
+            rhs[k] = lanes[0] + lanes[1];
+        }
+#else
+        for (int k = 0; k < MOMENTS; k++)
+            moments[k] = 0;
+        for (int k = 0; k < TERMS; k++)
+            rhs[k] = 0;
+#endif
+
+        for (; i < size; i++)
+        {
+            double t = x[i] * inv_scale;
+            double p = 1;
+            for (int k = 0; k < MOMENTS; k++)
+            {
+                moments[k] += p;
+                if (k < TERMS)
+                    rhs[k] += p * y[i];
+                p *= t;
+            }
+        }
+    }
+};
+
+#endif // _POLYNOMIAL_FIT_H_
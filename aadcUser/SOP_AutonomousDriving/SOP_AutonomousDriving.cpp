@@ -1,7 +1,6 @@
 #include "SOP_AutonomousDriving.h"
+#include "Lane_Reference.h"
 
-tFloat32 f32Value = 0;
-tUInt32 Ui32TimeStamp = 0;
 int maneuverIndex = 0;
 int sectorIndex = 0;
 
@@ -30,12 +29,18 @@ SOP_AutonomousDriving::SOP_AutonomousDriving(const tChar* __info) : adtf::cTimeT
     Obstacle_output.ID_set = tFalse;
     ParkingSpace_output.ID_set = tFalse;
     m_bIDsDriverStructSet = tFalse;
+    schedule_running = tFalse;
 
     SetPropertyStr("Configuration","stopLines.xml");
     SetPropertyBool("Configuration" NSSUBPROP_FILENAME, tTrue);
     SetPropertyStr("Configuration" NSSUBPROP_FILENAME NSSUBSUBPROP_EXTENSIONFILTER, "XML Files (*.xml)");
     SetPropertyStr("Configuration" NSSUBPROP_DESCRIPTION, "Configuration file for the stop lines coordinates");
 
+    SetPropertyStr("Digital map", "");
+    SetPropertyBool("Digital map" NSSUBPROP_FILENAME, tTrue);
+    SetPropertyStr("Digital map" NSSUBPROP_FILENAME NSSUBSUBPROP_EXTENSIONFILTER, "XML Files (*.xml)");
+    SetPropertyStr("Digital map" NSSUBPROP_DESCRIPTION, "Crossing, avoidance, pedestrian and child zones of the track, the built-in zones of the test track if empty");
+
     SetPropertyInt("SamplingRate::State Control Sampling rate in ms", 50);
     SetPropertyStr("SamplingRate::State Control Sampling rate in ms" NSSUBPROP_DESCRIPTION, "Sets the interval in msec");
     SetPropertyInt("SamplingRate::State Control Sampling rate in ms" NSSUBPROP_MIN, 10);
@@ -46,15 +51,20 @@ SOP_AutonomousDriving::SOP_AutonomousDriving(const tChar* __info) : adtf::cTimeT
     SetPropertyInt("SamplingRate::MPC Sampling rate in ms" NSSUBPROP_MIN, 10);
     SetPropertyInt("SamplingRate::MPC Sampling rate in ms" NSSUBPROP_MAX, 500);
 
+    SetPropertyInt("SamplingRate::Scheduling", SCHEDULE_POLLING);
+    SetPropertyStr("SamplingRate::Scheduling" NSSUBPROP_DESCRIPTION, "0: counts 1 ms cycles, the state control and the MPC never run in the same cycle (default), 1: absolute deadlines on a timer of the common period, 2: as 1 and the position, lane and ultrasonic samples start the tasks which are due");
+    SetPropertyInt("SamplingRate::Scheduling" NSSUBPROP_MIN, SCHEDULE_POLLING);
+    SetPropertyInt("SamplingRate::Scheduling" NSSUBPROP_MAX, SCHEDULE_SAMPLES);
+
     SetPropertyFloat("EmergencyBreak::Front Minimum break time in S",0.6);
     SetPropertyFloat("EmergencyBreak::Rear Minimum break time in S",0.5);
     SetPropertyFloat("EmergencyBreak::Minimum break distance in cm", 10);
 
 
-    SetPropertyFloat("Lane Following::maximum speed", 0.8);
-    SetPropertyFloat("Lane Following::minimum speed", 0.5);
-    SetPropertyFloat("Lane Following::NMPC Weighting factor::High speed y", 4);
-    SetPropertyFloat("Lane Following::NMPC Weighting factor::Low speed y", 8);
+    SetPropertyFloat("Lane Following::maximum speed", LANE_FOLLOW_MAX_SPEED);
+    SetPropertyFloat("Lane Following::minimum speed", LANE_FOLLOW_MIN_SPEED);
+    SetPropertyFloat("Lane Following::NMPC Weighting factor::High speed y", LANE_FOLLOW_QY_HIGH_SPEED);
+    SetPropertyFloat("Lane Following::NMPC Weighting factor::Low speed y", LANE_FOLLOW_QY_LOW_SPEED);
 
     SetPropertyFloat("Crossing::Marker distance in cm", 150);
     SetPropertyFloat("Crossing::Stop Line distance in cm", 75);
@@ -100,6 +110,12 @@ SOP_AutonomousDriving::SOP_AutonomousDriving(const tChar* __info) : adtf::cTimeT
     SetPropertyFloat("Avoidance::Lane change speed", 0.5);
     SetPropertyFloat("Avoidance::Side detection distance", 50);
     SetPropertyFloat("Avoidance::Come back counter", 20);
+    SetPropertyBool("Avoidance::Obstacles in NMPC", tFalse);
+    SetPropertyStr("Avoidance::Obstacles in NMPC" NSSUBPROP_DESCRIPTION, "The tracked obstacle of the ultrasonic sensors is a soft constraint of the NMPC instead of the avoidance maneuver, needs the real-time iteration backend for lane following and maneuvers");
+    SetPropertyFloat("Avoidance::NMPC obstacle clearance in m", 0.4);
+    SetPropertyStr("Avoidance::NMPC obstacle clearance in m" NSSUBPROP_DESCRIPTION, "Distance between the rear axle and the obstacle from which on the NMPC is penalized");
+    SetPropertyFloat("Avoidance::NMPC obstacle weight", 200);
+    SetPropertyStr("Avoidance::NMPC obstacle weight" NSSUBPROP_DESCRIPTION, "Weight of the squared violation of the clearance");
 
 
     SetPropertyFloat("Parking::Marker distance in cm", 70);
@@ -113,7 +129,60 @@ SOP_AutonomousDriving::SOP_AutonomousDriving(const tChar* __info) : adtf::cTimeT
     SetPropertyFloat("Parking::NMPC Weighting factor::x", 5);
     SetPropertyFloat("Parking::NMPC Weighting factor::y", 50);
 
+    SetPropertyInt("NMPC::Backend::Lane following", NMPC_BACKEND_IPOPT);
+    SetPropertyStr("NMPC::Backend::Lane following" NSSUBPROP_VALUELIST, "0@Ipopt|1@Real-time iteration|2@Lookup table");
+    SetPropertyStr("NMPC::Backend::Lane following" NSSUBPROP_DESCRIPTION, "Ipopt solves every NMPC problem to convergence, the real-time iteration does one SQP step per tick");
+    SetPropertyInt("NMPC::Backend::Maneuvers", NMPC_BACKEND_IPOPT);
+    SetPropertyStr("NMPC::Backend::Maneuvers" NSSUBPROP_VALUELIST, "0@Ipopt|1@Real-time iteration");
+    SetPropertyStr("NMPC::Backend::Maneuvers" NSSUBPROP_DESCRIPTION, "NMPC backend of all maneuvers except lane following");
+    SetPropertyStr("NMPC::Backend::Lookup table", "nmpc_lane_follow.bin");
+    SetPropertyBool("NMPC::Backend::Lookup table" NSSUBPROP_FILENAME, tTrue);
+    SetPropertyStr("NMPC::Backend::Lookup table" NSSUBPROP_FILENAME NSSUBSUBPROP_EXTENSIONFILTER, "Table Files (*.bin)");
+    SetPropertyStr("NMPC::Backend::Lookup table" NSSUBPROP_DESCRIPTION, "Lane following table of Tools/NMPC_Table_Generator, problems outside the table are solved by Ipopt");
+
+    SetPropertyFloat("NMPC::Deadline::Solve budget in ms", 40);
+    SetPropertyStr("NMPC::Deadline::Solve budget in ms" NSSUBPROP_DESCRIPTION, "CPU time cap of one NMPC solve, a longer solve counts as overrun and its solution is replaced by the fallback");
+    SetPropertyInt("NMPC::Deadline::Maximum iterations", 30);
+    SetPropertyStr("NMPC::Deadline::Maximum iterations" NSSUBPROP_DESCRIPTION, "Iteration cap of one NMPC solve");
+    SetPropertyFloat("NMPC::Deadline::Pure pursuit look ahead in m", 0.5);
+    SetPropertyStr("NMPC::Deadline::Pure pursuit look ahead in m" NSSUBPROP_DESCRIPTION, "Look ahead of the fallback control law when no input sequence can be replayed");
+
+    SetPropertyStr("NMPC::Weight profiles", "");
+    SetPropertyBool("NMPC::Weight profiles" NSSUBPROP_FILENAME, tTrue);
+    SetPropertyStr("NMPC::Weight profiles" NSSUBPROP_FILENAME NSSUBSUBPROP_EXTENSIONFILTER, "XML Files (*.xml)");
+    SetPropertyStr("NMPC::Weight profiles" NSSUBPROP_DESCRIPTION, "Replaces single NMPC weights of the maneuvers, without a file the weighting factors of the properties are used");
+
+    SetPropertyInt("NMPC::Horizon::Minimum stages", 5);
+    SetPropertyStr("NMPC::Horizon::Minimum stages" NSSUBPROP_DESCRIPTION, "Horizon of the NMPC at standstill. Only the real-time iteration changes its horizon, Ipopt and the lookup table solve N stages");
+    SetPropertyFloat("NMPC::Horizon::Nominal speed in m/s", 1.0);
+    SetPropertyStr("NMPC::Horizon::Nominal speed in m/s" NSSUBPROP_DESCRIPTION, "At this reference speed the NMPC looks N stages ahead, the horizon grows with the speed; up to 15 stages in lane following, up to N in maneuvers. 0 keeps N stages");
+
+    SetPropertyStr("NMPC::Move blocking::Blocks", "");
+    SetPropertyStr("NMPC::Move blocking::Blocks" NSSUBPROP_DESCRIPTION, "Stages per block of the Ipopt inputs, e.g. 1,1,2,3,4,4. The inputs of a block are one variable, the last block lasts until N. Empty: one block per stage");
+    SetPropertyBool("NMPC::Move blocking::Eliminate fixed speed", tFalse);
+    SetPropertyStr("NMPC::Move blocking::Eliminate fixed speed" NSSUBPROP_DESCRIPTION, "A speed with equal bounds is no variable of the Ipopt NLP");
+
+    SetPropertyFloat("NMPC::Input replay interval in ms", 0);
+    SetPropertyStr("NMPC::Input replay interval in ms" NSSUBPROP_DESCRIPTION, "Between two NMPC solves the predicted inputs of the last solve are written with this interval, 0 turns it off");
+
+    SetPropertyBool("Kalman Filter::Closed form prediction", tFalse);
+    SetPropertyStr("Kalman Filter::Closed form prediction" NSSUBPROP_DESCRIPTION, "Predicts with one exact arc step for the constant input instead of Runge-Kutta sub-steps");
+
     SetPropertyFloat("Obstacles::detection distance", 120);
+    SetPropertyFloat("Obstacles::Tracker::maximum range in cm", 300);
+    SetPropertyStr("Obstacles::Tracker::maximum range in cm" NSSUBPROP_DESCRIPTION, "Ultrasonic values from this distance on, or not above 0, are no echo");
+    SetPropertyFloat("Obstacles::Tracker::alpha", 0.5);
+    SetPropertyStr("Obstacles::Tracker::alpha" NSSUBPROP_DESCRIPTION, "Position gain of the alpha-beta tracks of the ultrasonic returns");
+    SetPropertyFloat("Obstacles::Tracker::beta", 0.2);
+    SetPropertyStr("Obstacles::Tracker::beta" NSSUBPROP_DESCRIPTION, "Velocity gain of the alpha-beta tracks of the ultrasonic returns");
+    SetPropertyFloat("Obstacles::Tracker::gate in cm", 25);
+    SetPropertyStr("Obstacles::Tracker::gate in cm" NSSUBPROP_DESCRIPTION, "Largest distance between a return and the predicted track it is assigned to");
+    SetPropertyInt("Obstacles::Tracker::confirmation hits", 3);
+    SetPropertyStr("Obstacles::Tracker::confirmation hits" NSSUBPROP_DESCRIPTION, "Samples with a return until a track gives the closing speed");
+    SetPropertyInt("Obstacles::Tracker::maximum misses", 3);
+    SetPropertyStr("Obstacles::Tracker::maximum misses" NSSUBPROP_DESCRIPTION, "Samples without a return after which a track is dropped");
+    SetPropertyBool("Obstacles::Occupancy grid", tTrue);
+    SetPropertyStr("Obstacles::Occupancy grid" NSSUBPROP_DESCRIPTION, "The crossing and the avoidance decisions look at an occupancy grid of the ultrasonic rays in the odometry frame instead of the last sample");
 
     SetPropertyFloat("Car following::detection distance", 120);
     SetPropertyFloat("Car following::preceding vehicle minimum speed", 0.1);
@@ -133,8 +202,35 @@ SOP_AutonomousDriving::SOP_AutonomousDriving(const tChar* __info) : adtf::cTimeT
     KI_child = tFalse;
     SetPropertyBool("KI switch::Child on/off", KI_child);
 
+    nmpc_warm_start = tTrue;
+    SetPropertyBool("NMPC::Warm start on/off", nmpc_warm_start);
+    SetPropertyStr("NMPC::Warm start on/off" NSSUBPROP_DESCRIPTION, "Starts every NMPC solve from the shifted solution of the last solve");
+
+    nmpc_benchmark_backends = tFalse;
+    SetPropertyBool("NMPC::Benchmark backends", nmpc_benchmark_backends);
+    SetPropertyStr("NMPC::Benchmark backends" NSSUBPROP_DESCRIPTION, "Solves every NMPC problem with own instances of the real-time iteration and the lookup table in a thread of its own and logs their solve times, only the selected backend drives. Ipopt is timed while it drives");
+
+    nmpc_speculation_enabled = tFalse;
+    SetPropertyBool("NMPC::Speculative maneuver solve", nmpc_speculation_enabled);
+    SetPropertyStr("NMPC::Speculative maneuver solve" NSSUBPROP_DESCRIPTION, "Solves the maneuver after a crossing in a background thread while the car approaches it, the maneuver starts from that solution");
+
+    nmpc_async_enabled = tFalse;
+    SetPropertyBool("NMPC::Worker thread", nmpc_async_enabled);
+    SetPropertyStr("NMPC::Worker thread" NSSUBPROP_DESCRIPTION, "Solves the NMPC in a thread of its own, Cycle only posts the problems and writes the newest solution");
+
+    nmpc_prewarm = tTrue;
+    SetPropertyBool("NMPC::Pre-warm solvers", nmpc_prewarm);
+    SetPropertyStr("NMPC::Pre-warm solvers" NSSUBPROP_DESCRIPTION, "Solves one problem of every weight profile with every backend in Start, so the first maneuver does not pay for the setup of Ipopt");
+
 
     m_log = 0;
+    nmpc_ipopt_solver = NULL;
+    nmpc_table_solver = NULL;
+    nmpc_speculation = NULL;
+    nmpc_async = NULL;
+    nmpc_benchmark = NULL;
+    for (int i = 0; i < NMPC_BACKEND_COUNT; i++)
+        nmpc_solver[i] = NULL;
 }
 
 SOP_AutonomousDriving::~SOP_AutonomousDriving()
@@ -148,6 +244,7 @@ tResult SOP_AutonomousDriving::PropertyChanged(const char* strProperty)
 
     MPC_sampling_rate = static_cast<tFloat32>(GetPropertyFloat("SamplingRate::MPC Sampling rate in ms"));
     state_control_sampling_rate = static_cast<tFloat32>(GetPropertyFloat("SamplingRate::State Control Sampling rate in ms"));
+    schedule_mode = GetPropertyInt("SamplingRate::Scheduling");
 
     lane_follow_maxSpeed = static_cast<tFloat32>(GetPropertyFloat("Lane Following::maximum speed"));
     lane_follow_minSpeed = static_cast<tFloat32>(GetPropertyFloat("Lane Following::minimum speed"));
@@ -199,6 +296,8 @@ tResult SOP_AutonomousDriving::PropertyChanged(const char* strProperty)
     avoidance_laneChange_speed = static_cast<tFloat32>(GetPropertyFloat("Avoidance::Lane change speed"));
     avoidance_side_distance = static_cast<tFloat32>(GetPropertyFloat("Avoidance::Side detection distance"));
     avoidance_comeBack_counter = static_cast<tFloat32>(GetPropertyFloat("Avoidance::Come back counter"));
+    nmpc_obstacle_clearance = GetPropertyFloat("Avoidance::NMPC obstacle clearance in m");
+    nmpc_obstacle_weight = GetPropertyFloat("Avoidance::NMPC obstacle weight");
 
 
 //    crossing_stopLine_mode = static_cast<tFloat32>(GetPropertyFloat("Avoidance::NMPC Weighting factor::y"));
@@ -214,12 +313,37 @@ tResult SOP_AutonomousDriving::PropertyChanged(const char* strProperty)
     weightFact_Parking_X = static_cast<tFloat32>(GetPropertyFloat("Parking::NMPC Weighting factor::x"));
     weightFact_Parking_Y = static_cast<tFloat32>(GetPropertyFloat("Parking::NMPC Weighting factor::y"));
 
+    nmpc_backend_lane_follow = GetPropertyInt("NMPC::Backend::Lane following");
+    nmpc_backend_maneuver = GetPropertyInt("NMPC::Backend::Maneuvers");
+    nmpc_solve_budget = GetPropertyFloat("NMPC::Deadline::Solve budget in ms");
+    nmpc_max_iterations = GetPropertyInt("NMPC::Deadline::Maximum iterations");
+    nmpc_pure_pursuit_look_ahead = GetPropertyFloat("NMPC::Deadline::Pure pursuit look ahead in m");
+    nmpc_replay_interval = GetPropertyFloat("NMPC::Input replay interval in ms");
+    nmpc_horizon_min = GetPropertyInt("NMPC::Horizon::Minimum stages");
+    nmpc_horizon_nominal_speed = GetPropertyFloat("NMPC::Horizon::Nominal speed in m/s");
+
     obstacle_detect_distance = static_cast<tFloat32>(GetPropertyFloat("Obstacles::detection distance"));
+    ultrasonic_max_range = GetPropertyFloat("Obstacles::Tracker::maximum range in cm");
+    ultrasonic_tracker_alpha = GetPropertyFloat("Obstacles::Tracker::alpha");
+    ultrasonic_tracker_beta = GetPropertyFloat("Obstacles::Tracker::beta");
+    ultrasonic_tracker_gate = GetPropertyFloat("Obstacles::Tracker::gate in cm");
+    ultrasonic_tracker_confirm_hits = GetPropertyInt("Obstacles::Tracker::confirmation hits");
+    ultrasonic_tracker_max_misses = GetPropertyInt("Obstacles::Tracker::maximum misses");
 
     carFollowing_detect_distance = static_cast<tFloat32>(GetPropertyFloat("Car following::detection distance"));
     carFollowing_preVeh_minSpeed = static_cast<tFloat32>(GetPropertyFloat("Car following::preceding vehicle minimum speed"));
 
 
+    // the timer and the deadlines of the running filter follow the new periods and mode
+    if(schedule_running == tTrue && strProperty != NULL
+            && (strncmp(strProperty, "SamplingRate::", strlen("SamplingRate::")) == 0 || strcmp(strProperty, "NMPC::Input replay interval in ms") == 0))
+    {
+        __synchronized_obj(m_oCritSectionSchedule);
+        MPC_sampling_rate_counter = 0;
+        state_control_sampling_rate_counter = 0;
+        RETURN_IF_FAILED(ConfigureSchedule());
+    }
+
     RETURN_NOERROR;
 }
 tResult SOP_AutonomousDriving::Start(__exception)
@@ -234,7 +358,7 @@ tResult SOP_AutonomousDriving::Start(__exception)
     stop_line_distance = 0;
     crossing_flag = 0; // tFalse
     parking_Ready_flag = 0;
-    marker_update_counter = 0;
+    marker_update_time = GetTime();
     stop_decision_flag = STOP_DECISION;
     avoidance_permit_flag = 0;
     last_speed = 0;
@@ -276,7 +400,6 @@ tResult SOP_AutonomousDriving::Start(__exception)
     m_Rvec = Mat(3,1,CV_32F,Scalar::all(0));
 
     average_distance = 400;
-    last_average_distance = 400;
     car_following_flag = tFalse;
     relative_speed = 0;
     pre_veh_speed = 2;
@@ -293,6 +416,14 @@ tResult SOP_AutonomousDriving::Start(__exception)
     crossing_stopLine_mode = GetPropertyBool("Mode switch::Stop line mode on/off");
     KI_adult = GetPropertyBool("KI switch::Adult on/off");
     KI_child = GetPropertyBool("KI switch::Child on/off");
+    nmpc_warm_start = GetPropertyBool("NMPC::Warm start on/off");
+    nmpc_benchmark_backends = GetPropertyBool("NMPC::Benchmark backends");
+    nmpc_speculation_enabled = GetPropertyBool("NMPC::Speculative maneuver solve");
+    nmpc_async_enabled = GetPropertyBool("NMPC::Worker thread");
+    nmpc_prewarm = GetPropertyBool("NMPC::Pre-warm solvers");
+    ekf_arc_prediction = GetPropertyBool("Kalman Filter::Closed form prediction");
+    nmpc_obstacle_constraints = GetPropertyBool("Avoidance::Obstacles in NMPC");
+    occupancy_grid_enabled = GetPropertyBool("Obstacles::Occupancy grid");
 
 
 
@@ -331,8 +462,16 @@ tResult SOP_AutonomousDriving::Start(__exception)
     pedestrian_flag = tFalse;
 
     position_input_flag = tFalse;
+    memset(&vehicle_state, 0, sizeof(vehicle_state));
 
-    ultra_read_counter = 0;
+    ultrasonic_tracker.SetParameters(static_cast<float>(ultrasonic_tracker_alpha), static_cast<float>(ultrasonic_tracker_beta),
+                                     static_cast<float>(ultrasonic_tracker_gate), ultrasonic_tracker_confirm_hits, ultrasonic_tracker_max_misses);
+    ultrasonic_tracker.Reset();
+    occupancy_grid.Reset();
+    odometry_started = tFalse;
+    odometry_distance = 0;
+    odometry_x = 0;
+    odometry_y = 0;
 
     ManeuverList.id = 0;
     ManeuverList.id_counter = 0;
@@ -343,9 +482,14 @@ tResult SOP_AutonomousDriving::Start(__exception)
     ManeuverList.stop_flag = tFalse;
 
     ResetDigitialMap();
+    BuildManeuverLibrary();
 
+    RETURN_IF_FAILED(BuildNMPCWeightProfiles());
     RETURN_IF_FAILED(SetIpopt());
+    RETURN_IF_FAILED(SetNMPCSolvers());
+    RETURN_IF_FAILED(ConfigureSchedule());
     RETURN_IF_FAILED(cTimeTriggeredFilter::Start(__exception_ptr));
+    schedule_running = tTrue;
 
     RETURN_NOERROR;
 }
@@ -363,6 +507,7 @@ tResult SOP_AutonomousDriving::Stop(__exception)
     ToggleLights(RIGHT, tFalse);
     CloseIpopt();
 
+    schedule_running = tFalse;
     RETURN_IF_FAILED(cTimeTriggeredFilter::Stop(__exception_ptr));
     RETURN_NOERROR;
 }
@@ -382,11 +527,6 @@ tResult SOP_AutonomousDriving::Init(tInitStage eStage, __exception)
         LoadConfiguration();
     }
 
-    else if (eStage == StageGraphReady)
-    {
-        this->SetInterval(1000);  //cycle time 1 ms
-    }
-
     RETURN_NOERROR;
 }
 
@@ -629,10 +769,8 @@ tResult SOP_AutonomousDriving::Shutdown(tInitStage eStage, __exception)
 
 tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt nParam1, tInt nParam2, IMediaSample* pMediaSample)
 {
-    //mutex to prevent racing conditions for samples coming from different threads
-    __synchronized_obj(m_oCritSectionInputData);
-
-
+    // the sensor samples are published to their sequence locks without waiting for each other,
+    // the commands of the road signs, the state flag and the jury take m_oCritSectionInputData
     if (nEventCode == IPinEventSink::PE_MediaSampleReceived)
     {
         RETURN_IF_POINTER_NULL(pMediaSample);
@@ -641,34 +779,30 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
         {
             // LOG_INFO(adtf_util::cString::Format("OnpinEvent Uss-------------------"));
 
-            RETURN_IF_FAILED(ProcessUssStructValue(pMediaSample, ultrasonic_value));
+            ULTRASONIC_INPUT sample;
+            RETURN_IF_FAILED(ProcessUssStructValue(pMediaSample, sample.value));
+            tTimeStamp sample_time = GetTime();
+            ultrasonic_sample.Write(sample, sample_time);
+            TrackUltrasonicObstacles(sample, sample_time);
+            UpdateOccupancyGrid(sample);
 //                      LOG_INFO(adtf_util::cString::Format("Front L to R: %g, %g, %g, %g, %g", ultrasonic_value[0], ultrasonic_value[2], ultrasonic_value[4], ultrasonic_value[6], ultrasonic_value[8]));
             //          LOG_INFO(adtf_util::cString::Format("Side  L to R: %g, %g", ultrasonic_value[10], ultrasonic_value[12]));
             //          LOG_INFO(adtf_util::cString::Format("Rear  L to R: %g, %g, %g", ultrasonic_value[14], ultrasonic_value[16], ultrasonic_value[18]));
-            CalculateUltrasonicWorldCoordinate(ultrasonic_value);
 //            if (m_log) fprintf(m_log,"%g %g %g %g %g\n", ultrasonic_value[0], ultrasonic_value[2], ultrasonic_value[4], ultrasonic_value[6], ultrasonic_value[8]);
         }
         else if (pSource == &image_info_input.input)
         {
             //LOG_INFO(adtf_util::cString::Format("OnpinEvent Image-------------------"));
 
-            ReadPinArrayValue(pMediaSample,&image_info_input, image_info_ID_name, 11, reference_value);
-            stop_line_distance = reference_value[8];
-            adult_flag = (int)reference_value[9];
-            child_flag = (int)reference_value[10];
-
-            // LOG_INFO(adtf_util::cString::Format("a = %g, b = %g, c = %g", reference_value[1],reference_value[2],reference_value[3]));
-//            LOG_INFO(adtf_util::cString::Format("adult = %d, child = %d", adult_flag,child_flag));
-
-        //    if(input_state_flag == LANE_FOLLOW)
-            CalculateTrackingPoint();
-
-            //          LOG_INFO(adtf_util::cString::Format("stop_line_distance = %g", stop_line_distance));
+            LANE_INPUT sample;
+            ReadPinArrayValue(pMediaSample,&image_info_input, image_info_ID_name, 11, sample.value);
+            lane_sample.Write(sample, GetTime());
         }
         else if (pSource == &position_input.input)
         {
             // LOG_INFO(adtf_util::cString::Format("OnpinEvent Possition-------------------"));
 
+            tFloat32 position_value[5];
             ReadPinArrayValue(pMediaSample,&position_input, position_input_ID_name, 5, position_value);
 
 //            LOG_INFO(adtf_util::cString::Format("x:%f Y:%f Radius:%f Speed:%f Heading:%f", position_value[X], position_value[Y], position_value[RADIUS], position_value[SPEED], position_value[HEADING]));
@@ -686,25 +820,20 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
 //                if(car_position_first_flag == tFalse && car_cur_position.HeadingAngle != 0)
 //                    car_position_first_flag = tTrue;
 //            }
-            car_cur_position.X_Position   = position_value[X];// - CAMERA_TO_CENTER;
-            car_cur_position.Y_Position   = position_value[Y];
-            car_cur_position.HeadingAngle = position_value[HEADING];
-            car_cur_position.radius       = position_value[RADIUS];
-            if(position_input_flag == tFalse)
-            {
-                position_input_flag = tTrue;
-
-                ResetExtendedKF();
-                 ExtendedKF();
-            }
+            CAR_POSITION_STRUCT position;
+            position.X_Position   = position_value[X];// - CAMERA_TO_CENTER;
+            position.Y_Position   = position_value[Y];
+            position.HeadingAngle = position_value[HEADING];
+            position.radius       = position_value[RADIUS];
+            position_sample.Write(position, GetTime());
         }
         else if (pSource == &wheel_speed_input.input)
         {
             //  LOG_INFO(adtf_util::cString::Format("OnpinEvent Speed-------------------"));
 
             //write values with zero
-            f32Value = 0;
-            Ui32TimeStamp = 0;
+            tFloat32 f32Value = 0;
+            tUInt32 Ui32TimeStamp = 0;
             {
                cObjectPtr<IMediaTypeDescription> wheel_speed_m_pDescription;
                 wheel_speed_m_pDescription = wheel_speed_input.m_pDescription;
@@ -723,8 +852,7 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
                 pCoder->Get(wheel_speed_input.ID_timestamp, (tVoid*)&Ui32TimeStamp);
             }
 
-            // write to member variable
-            car_speed = f32Value;
+            wheel_speed_sample.Write(f32Value, GetTime());
         }
 
         else if (pSource == &distance_overall_input.input)
@@ -732,8 +860,8 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
             //  LOG_INFO(adtf_util::cString::Format("OnpinEvent Speed-------------------"));
 
             //write values with zero
-            f32Value = 0;
-            Ui32TimeStamp = 0;
+            tFloat32 f32Value = 0;
+            tUInt32 Ui32TimeStamp = 0;
             {
                 cObjectPtr<IMediaTypeDescription> distance_overall_m_pDescription;
                 distance_overall_m_pDescription = distance_overall_input.m_pDescription;
@@ -752,22 +880,23 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
                 pCoder->Get(distance_overall_input.ID_timestamp, (tVoid*)&Ui32TimeStamp);
             }
 
-            // write to member variable
-            distance_overall = f32Value;
+            distance_sample.Write(f32Value, GetTime());
         }
 
         else if (pSource == &input_road_sign_ext.input)
         {
             // process RoadSignExt sample
+            __synchronized_obj(m_oCritSectionInputData);
 
             RETURN_IF_FAILED(ProcessRoadSignStructExt(pMediaSample));
-            marker_update_counter = 0;
+            marker_update_time = GetTime();
 
         }
 
         else if (pSource == &state_flag.input && m_bJuryModelEnabled == tFalse)
         {
             // LOG_INFO(adtf_util::cString::Format("OnpinEvent State-------------------"));
+            __synchronized_obj(m_oCritSectionInputData);
             cObjectPtr<IMediaTypeDescription> state_flag_m_pDescription;
             state_flag_m_pDescription = state_flag.m_pDescription;
             // focus for sample write lock
@@ -796,6 +925,7 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
 
         else if (pSource == &m_JuryStructInputPin && m_pDescJuryStruct != NULL)
         {
+            __synchronized_obj(m_oCritSectionInputData);
             tInt8 i8ActionID = -2;
             tInt16 i16entry = -1;
 
@@ -907,10 +1037,18 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
                 }
 
             }
+            __synchronized_obj(m_oCritSectionInputData);
             LoadManeuverList();
         }
 
-
+        // the position, the lane model and the ultrasonic sensors start the tasks which are due
+        if(schedule_mode == SCHEDULE_SAMPLES
+                && (pSource == &position_input.input || pSource == &image_info_input.input || pSource == &m_oInputUssStruct))
+        {
+            // never with m_oCritSectionInputData held, TakeVehicleState() takes it after this one
+            __synchronized_obj(m_oCritSectionSchedule);
+            RunScheduledTasks();
+        }
     }
 
     else if (nEventCode == IPinEventSink::PE_MediaTypeChanged)
@@ -921,46 +1059,39 @@ tResult SOP_AutonomousDriving::OnPinEvent(IPin* pSource, tInt nEventCode, tInt n
 }
 
 
+/* The state control and the MPC run every state_control_sampling_rate and MPC_sampling_rate ms.
+ * SCHEDULE_POLLING counts 1 ms cycles, the other modes wake up on the common period of the tasks
+ * only and compare against absolute deadlines, see RunScheduledTasks().
+ */
 tResult SOP_AutonomousDriving::Cycle(__exception)
 {
+    __synchronized_obj(m_oCritSectionSchedule);
 
-    if(state_control_sampling_rate_counter >= state_control_sampling_rate)
+    if(schedule_mode == SCHEDULE_POLLING)
     {
-        if(m_bJuryModelEnabled == tTrue && ManeuverList.state == action_START && position_input_flag == tTrue)
-            current_car_state_flag = DrivingModeDecision(current_car_state_flag);
-        else if(m_bJuryModelEnabled == tFalse &&  position_input_flag == tTrue)
-            current_car_state_flag = DrivingModeDecision_TestModel();
-
-//        LOG_INFO(adtf_util::cString::Format("Current State Flag %d",current_car_state_flag));
-        if(current_car_state_flag == CAR_STOP)
-            WriteSignalValue(&speed_output, 0, 0);
-
-        ProcessVideo();
+        if(state_control_sampling_rate_counter >= state_control_sampling_rate)
+        {
+            TakeVehicleState();
+            RunStateControl();
+            state_control_sampling_rate_counter = 0;
+        }
+        else if(MPC_sampling_rate_counter >= MPC_sampling_rate)
+        {
+            TakeVehicleState();
+            RunMPC();
+            MPC_sampling_rate_counter = 0;
+        }
 
-        state_control_sampling_rate_counter = 0;
+        MPC_sampling_rate_counter++;
+        state_control_sampling_rate_counter++;
     }
+    else
+        RunScheduledTasks();
 
-    else if(MPC_sampling_rate_counter >= MPC_sampling_rate)
-    {
-
-        AutoControl(current_car_state_flag);
-
-//        image_processing_function_switch |= LANE_DETECTION;
-//        image_processing_function_switch |= STOP_LINE_DETECTION;
-//        image_processing_function_switch |= ADULT_DETECTION;
-//        image_processing_function_switch |= CHILD_DETECTION;
-
-//        image_processing_function_switch &= ~LANE_DETECTION;
-//        image_processing_function_switch &= ~ADULT_DETECTION;
-
-        image_processing_control_value[0] = (float)image_processing_function_switch;
-        image_processing_control_value[1] = car_curve_a;
-        image_processing_control_value[2] = car_curve_b;
-        image_processing_control_value[3] = car_curve_c;
-        WritePinArrayValue(&image_processing_control, 4,image_processing_control_ID_name, image_processing_control_value);
-
-        MPC_sampling_rate_counter = 0;
-    }
+    // the newest solution of the NMPC worker, if it runs in a thread of its own
+    PollNMPCWorker();
+    // the predicted inputs between two solves
+    ReplayNMPCInputs();
 
 
     if(ManeuverList.send_ready_flag == tTrue)
@@ -979,12 +1110,181 @@ tResult SOP_AutonomousDriving::Cycle(__exception)
     }
 
 
-    if(marker_update_counter < 120)
-        marker_update_counter++;
+    RETURN_NOERROR;
+}
+
+tResult SOP_AutonomousDriving::RunStateControl(void)
+{
+    tTimeStamp now = GetTime();
+    state_control_dt = (last_state_control_time > 0) ? (now - last_state_control_time) / 1000000.0 : state_control_sampling_rate / 1000.0;
+    last_state_control_time = now;
+
+    if(m_bJuryModelEnabled == tTrue && ManeuverList.state == action_START && position_input_flag == tTrue)
+        current_car_state_flag = DrivingModeDecision(current_car_state_flag);
+    else if(m_bJuryModelEnabled == tFalse &&  position_input_flag == tTrue)
+        current_car_state_flag = DrivingModeDecision_TestModel();
+
+//    LOG_INFO(adtf_util::cString::Format("Current State Flag %d",current_car_state_flag));
+    if(current_car_state_flag == CAR_STOP)
+        WriteSignalValue(&speed_output, 0, 0);
+
+    ProcessVideo();
+
+    RETURN_NOERROR;
+}
+
+tResult SOP_AutonomousDriving::RunMPC(void)
+{
+    AutoControl(current_car_state_flag);
+
+//    image_processing_function_switch |= LANE_DETECTION;
+//    image_processing_function_switch |= STOP_LINE_DETECTION;
+//    image_processing_function_switch |= ADULT_DETECTION;
+//    image_processing_function_switch |= CHILD_DETECTION;
+
+//    image_processing_function_switch &= ~LANE_DETECTION;
+//    image_processing_function_switch &= ~ADULT_DETECTION;
+
+    image_processing_control_value[0] = (float)image_processing_function_switch;
+    image_processing_control_value[1] = car_curve_a;
+    image_processing_control_value[2] = car_curve_b;
+    image_processing_control_value[3] = car_curve_c;
+    WritePinArrayValue(&image_processing_control, 4,image_processing_control_ID_name, image_processing_control_value);
+
+    RETURN_NOERROR;
+}
+
+/* Reads the latest sample of every input once, so the state control and the MPC of one cycle see
+ * the same vehicle state. Samples which are new since the cycle before update the members the
+ * tasks work on, the steps derived from them run here instead of in OnPinEvent().
+ */
+tResult SOP_AutonomousDriving::TakeVehicleState(void)
+{
+    VEHICLE_STATE state;
+    state.time = GetTime();
+    state.ultrasonic_time = ultrasonic_sample.Read(&state.ultrasonic);
+    state.lane_time = lane_sample.Read(&state.lane);
+    state.position_time = position_sample.Read(&state.position);
+    state.speed_time = wheel_speed_sample.Read(&state.speed);
+    state.distance_time = distance_sample.Read(&state.distance_overall);
+    state.tracks_time = ultrasonic_track_sample.Read(&state.tracks);
+
+    if(state.ultrasonic_time != vehicle_state.ultrasonic_time)
+    {
+        memcpy(ultrasonic_value, state.ultrasonic.value, sizeof(ultrasonic_value));
+        CalculateUltrasonicWorldCoordinate(ultrasonic_value, ult_world_coord);
+    }
+
+    if(state.lane_time != vehicle_state.lane_time)
+    {
+        memcpy(reference_value, state.lane.value, sizeof(reference_value));
+        stop_line_distance = reference_value[8];
+        adult_flag = (int)reference_value[9];
+        child_flag = (int)reference_value[10];
+
+        // LOG_INFO(adtf_util::cString::Format("a = %g, b = %g, c = %g", reference_value[1],reference_value[2],reference_value[3]));
+//        LOG_INFO(adtf_util::cString::Format("adult = %d, child = %d", adult_flag,child_flag));
+        CalculateTrackingPoint();
+    }
+
+    if(state.position_time != vehicle_state.position_time)
+    {
+        car_cur_position = state.position;
+        // position_input_flag is cleared by the state flag and the jury
+        __synchronized_obj(m_oCritSectionInputData);
+        if(position_input_flag == tFalse)
+        {
+            position_input_flag = tTrue;
+
+            ResetExtendedKF();
+            ExtendedKF();
+        }
+    }
+
+    if(state.speed_time != 0)
+        car_speed = state.speed;
+    if(state.distance_time != 0)
+        distance_overall = state.distance_overall;
+
+    vehicle_state = state;
+
+    RETURN_NOERROR;
+}
+
+/* Next deadline of a task with a period in ms. The deadlines stay on their grid, so the timer
+ * jitter does not add up; a task which is late by a whole period skips the missed runs.
+ */
+static tTimeStamp NextDeadline(tTimeStamp deadline, tFloat32 period, tTimeStamp now)
+{
+    deadline += static_cast<tTimeStamp>(period * 1000);
+    if(deadline <= now)
+        deadline = now + static_cast<tTimeStamp>(period * 1000);
+    return deadline;
+}
+
+/* Runs the tasks whose deadline has passed, state control before MPC as in the polling mode.
+ * Called from Cycle() and in SCHEDULE_SAMPLES from OnPinEvent(), with m_oCritSectionSchedule held.
+ */
+tResult SOP_AutonomousDriving::RunScheduledTasks(void)
+{
+    tTimeStamp now = GetTime();
+    if(now >= next_state_control_time || now >= next_mpc_time)
+        TakeVehicleState();
+
+    if(now >= next_state_control_time)
+    {
+        RunStateControl();
+        next_state_control_time = NextDeadline(next_state_control_time, state_control_sampling_rate, now);
+    }
+    if(now >= next_mpc_time)
+    {
+        RunMPC();
+        next_mpc_time = NextDeadline(next_mpc_time, MPC_sampling_rate, now);
+    }
+
+    RETURN_NOERROR;
+}
+
+static long GreatestCommonDivisor(long a, long b)
+{
+    while(b != 0)
+    {
+        long r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/* Timer of the filter: 1 ms for SCHEDULE_POLLING, otherwise the greatest common divisor of the
+ * periods in whole ms, so every deadline falls on a timer cycle. The NMPC worker and the input
+ * replay are served in Cycle() as well and take part in the period.
+ */
+tResult SOP_AutonomousDriving::ConfigureSchedule(void)
+{
+    tTimeStamp now = GetTime();
+    next_state_control_time = now;
+    next_mpc_time = now;
+    last_state_control_time = 0;
+    state_control_dt = state_control_sampling_rate / 1000.0;
+
+    if(schedule_mode == SCHEDULE_POLLING)
+    {
+        SetInterval(1000);
+        RETURN_NOERROR;
+    }
 
-    MPC_sampling_rate_counter++;
-    state_control_sampling_rate_counter++;
+    long interval = GreatestCommonDivisor(static_cast<long>(state_control_sampling_rate + 0.5), static_cast<long>(MPC_sampling_rate + 0.5));
+    if(nmpc_replay_interval > 0)
+        interval = GreatestCommonDivisor(interval, static_cast<long>(nmpc_replay_interval + 0.5));
+    if(nmpc_async_enabled == tTrue)
+        interval = GreatestCommonDivisor(interval, SCHEDULE_WORKER_POLL_INTERVAL);
+    if(interval < 1)
+        interval = 1;
+    SetInterval(interval * 1000);
 
+    LOG_INFO(adtf_util::cString::Format("Scheduling: %s, timer every %ld ms",
+                                        schedule_mode == SCHEDULE_SAMPLES ? "deadlines and samples" : "deadlines", interval));
 
     RETURN_NOERROR;
 }
@@ -1270,7 +1570,7 @@ tResult SOP_AutonomousDriving::ProcessVideo(void)
     rectangle(outputImage, Point(226,238), Point(229,248), Scalar(128,128,255), 1);  //Rear Wheel Rifht
     char text[50];
 
-    if(marker_update_counter < 100)
+    if(GetTime() - marker_update_time < MARKER_TIMEOUT)
     {
         sprintf(text, "%d" ,road_marker_ID);
         putText(outputImage, text, Point((IMAGE_HALF_WIDTH - marker_lateral - 6), ((IMAGE_HALF_HEIGHT - 8) - marker_distance - 4)), 0, 0.3, Scalar(255,128,128),1);
@@ -2035,87 +2335,129 @@ tResult SOP_AutonomousDriving::LoadConfiguration()
 }
 
 
+/* Zones of the test track, used if "Digital map" is not set */
+static const MAP_ZONE builtin_map_zones[] =
+{
+    {MAP_ZONE_T_CROSSING,  8.544, 10.644, 16.465, 14.515, 180},
+    {MAP_ZONE_T_CROSSING,  5.515,  7.465, 13.456, 11.356,  90},
+    {MAP_ZONE_T_CROSSING,  5.515,  7.465,  9.456,  7.356,  90},
+    {MAP_ZONE_T_CROSSING, -0.485,  1.465,  9.456,  7.356, -90},
+    {MAP_ZONE_T_CROSSING, -0.485,  1.465,  6.456,  4.356, -90},
+
+    {MAP_ZONE_AVOIDANCE,   5.356,  9.356,  0.985, -0.025,   0},
+    {MAP_ZONE_AVOIDANCE,  11.715, 15.715,  9.644,  4.356,   0},
+
+    {MAP_ZONE_PEDESTRIAN,  2.644,  4.356,  1.135, -0.135,   0},
+    {MAP_ZONE_PEDESTRIAN,  2.865,  4.135, 11.356,  9.644,   0},
+
+    {MAP_ZONE_CHILD,       4.356,  9.356,  0.985, -0.025,   0},
+    {MAP_ZONE_CHILD,      13.715, 14.715,  8.644,  4.356,   0},
+    {MAP_ZONE_CHILD,      -0.135,  1.135, 10.644,  2.856,   0},
+    {MAP_ZONE_CHILD,       8.644, 12.644, 16.135, 14.865,   0}
+};
+
+static const char *map_zone_names[MAP_ZONE_TYPE_COUNT] =
+{
+    "t_crossing", "avoidance", "pedestrian", "child", "stop_line"
+};
+
+#define STOP_LINE_ZONE_HALF_SIZE    0.5     // m, zone around a stop line of the configuration
+
+/* Builds the zones of the digital map: those of "Digital map" or the built-in ones, and the stop
+ * lines of LoadConfiguration(). The state control finds the zones of the car by a point query.
+ */
 tResult SOP_AutonomousDriving::ResetDigitialMap()
 {
+    digital_map.Clear();
+    if(IS_FAILED(LoadDigitalMap()))
+    {
+        for(size_t i = 0; i < sizeof(builtin_map_zones) / sizeof(builtin_map_zones[0]); i++)
+            digital_map.AddZone(builtin_map_zones[i]);
+    }
+
+    for(size_t i = 0; i < m_stopLines.size(); i++)
+    {
+        MAP_ZONE zone;
+        zone.type = MAP_ZONE_STOP_LINE;
+        zone.left  = m_stopLines[i].f32X - STOP_LINE_ZONE_HALF_SIZE;
+        zone.right = m_stopLines[i].f32X + STOP_LINE_ZONE_HALF_SIZE;
+        zone.top   = m_stopLines[i].f32Y + STOP_LINE_ZONE_HALF_SIZE;
+        zone.bom   = m_stopLines[i].f32Y - STOP_LINE_ZONE_HALF_SIZE;
+        zone.HeadingAngle = m_stopLines[i].f32Direction;
+        digital_map.AddZone(zone);
+    }
+    digital_map.Build();
+
+    LOG_INFO(adtf_util::cString::Format("Digital map: %d T crossings, %d avoidance, %d pedestrian and %d child zones, %d stop lines",
+                                        digital_map.GetZoneCount(MAP_ZONE_T_CROSSING), digital_map.GetZoneCount(MAP_ZONE_AVOIDANCE),
+                                        digital_map.GetZoneCount(MAP_ZONE_PEDESTRIAN), digital_map.GetZoneCount(MAP_ZONE_CHILD),
+                                        digital_map.GetZoneCount(MAP_ZONE_STOP_LINE)));
+
+    RETURN_NOERROR;
+}
+
+/* Reads the zones of "Digital map":
+ * <map><zone type="t_crossing" left="8.544" right="10.644" top="16.465" bottom="14.515" heading="180"/>...</map>
+ * type is one of map_zone_names except stop_line, the edges are in m, the heading in degree. A map
+ * without a valid zone fails, the built-in zones are used then.
+ */
+tResult SOP_AutonomousDriving::LoadDigitalMap()
+{
+    cFilename fileMap = GetPropertyStr("Digital map");
+    if(fileMap.IsEmpty())
+        RETURN_ERROR(ERR_NOT_FOUND);
 
-    T_section_boundary[0].left  = 8.544;
-    T_section_boundary[0].right = 10.644;
-    T_section_boundary[0].top   = 16.465;
-    T_section_boundary[0].bom   = 14.515;
-    T_section_boundary[0].HeadingAngle = 180;
-
-    T_section_boundary[1].left  = 5.515;
-    T_section_boundary[1].right = 7.465;
-    T_section_boundary[1].top   = 13.456;
-    T_section_boundary[1].bom   = 11.356;
-    T_section_boundary[1].HeadingAngle = 90;
-
-    T_section_boundary[2].left  = 5.515;
-    T_section_boundary[2].right = 7.465;
-    T_section_boundary[2].top   = 9.456;
-    T_section_boundary[2].bom   = 7.356;
-    T_section_boundary[2].HeadingAngle = 90;
-
-    T_section_boundary[3].left  = -0.485;
-    T_section_boundary[3].right = 1.465;
-    T_section_boundary[3].top   = 9.456;
-    T_section_boundary[3].bom   = 7.356;
-    T_section_boundary[3].HeadingAngle = -90;
-
-    T_section_boundary[4].left  = -0.485;
-    T_section_boundary[4].right = 1.465;
-    T_section_boundary[4].top   = 6.456;
-    T_section_boundary[4].bom   = 4.356;
-    T_section_boundary[4].HeadingAngle = -90;
-    T_crossing_nummer = 5;
-
-
-    avoidance_section_boundary[0].left  = 5.356;
-    avoidance_section_boundary[0].right = 9.356;
-    avoidance_section_boundary[0].top   = 0.985;
-    avoidance_section_boundary[0].bom   = -0.025;
-
-    avoidance_section_boundary[1].left  = 11.715;
-    avoidance_section_boundary[1].right = 15.715;
-    avoidance_section_boundary[1].top   = 9.644;
-    avoidance_section_boundary[1].bom   = 4.356;
-    avoidance_nummer = 2;
-
-    pedestrian_section_boundary[0].left  = 2.644;
-    pedestrian_section_boundary[0].right = 4.356;
-    pedestrian_section_boundary[0].top   = 1.135;
-    pedestrian_section_boundary[0].bom   = -0.135;
-
-    pedestrian_section_boundary[1].left  = 2.865;
-    pedestrian_section_boundary[1].right = 4.135;
-    pedestrian_section_boundary[1].top   = 11.356;
-    pedestrian_section_boundary[1].bom   = 9.644;
-    pedestrian_nummer = 2;
-
-
-    child_section_boundary[0].left  = 4.356;
-    child_section_boundary[0].right = 9.356;
-    child_section_boundary[0].top   = 0.985;
-    child_section_boundary[0].bom   = -0.025;
-
-    child_section_boundary[1].left  = 13.715;
-    child_section_boundary[1].right = 14.715;
-    child_section_boundary[1].top   = 8.644;
-    child_section_boundary[1].bom   = 4.356;
-
-    child_section_boundary[2].left  = -0.135;
-    child_section_boundary[2].right = 1.135;
-    child_section_boundary[2].top   = 10.644;
-    child_section_boundary[2].bom   = 2.856;
-
-    child_section_boundary[3].left  = 8.644;
-    child_section_boundary[3].right = 12.644;
-    child_section_boundary[3].top   = 16.135;
-    child_section_boundary[3].bom   = 14.865;
-
-
-
-    child_nummer = 4;
+    ADTF_GET_CONFIG_FILENAME(fileMap);
+    fileMap = fileMap.CreateAbsolutePath(".");
+    if(!cFileSystem::Exists(fileMap))
+    {
+        LOG_WARNING(adtf_util::cString::Format("Digital map %s does not exist, the built-in zones are used", fileMap.GetPtr()));
+        RETURN_ERROR(ERR_INVALID_FILE);
+    }
+
+    cDOM oDOM;
+    oDOM.Load(fileMap);
+    cDOMElementRefList oElems;
+    if(IS_FAILED(oDOM.FindNodes("map/zone", oElems)))
+    {
+        LOG_WARNING(adtf_util::cString::Format("Digital map %s has no zones, the built-in zones are used", fileMap.GetPtr()));
+        RETURN_ERROR(ERR_INVALID_FILE);
+    }
+
+    int added = 0;
+    for(cDOMElementRefList::iterator itElem = oElems.begin(); itElem != oElems.end(); ++itElem)
+    {
+        cString name = (*itElem)->GetAttribute("type", "");
+        int type = 0;
+        while(type < MAP_ZONE_STOP_LINE && name != map_zone_names[type])
+            type++;
+        if(type == MAP_ZONE_STOP_LINE)
+        {
+            LOG_ERROR(adtf_util::cString::Format("Digital map: unknown zone type %s", name.GetPtr()));
+            continue;
+        }
+
+        MAP_ZONE zone;
+        zone.type = type;
+        zone.left  = tFloat32((*itElem)->GetAttribute("left", "0").AsFloat64());
+        zone.right = tFloat32((*itElem)->GetAttribute("right", "0").AsFloat64());
+        zone.top   = tFloat32((*itElem)->GetAttribute("top", "0").AsFloat64());
+        zone.bom   = tFloat32((*itElem)->GetAttribute("bottom", "0").AsFloat64());
+        zone.HeadingAngle = tFloat32((*itElem)->GetAttribute("heading", "0").AsFloat64());
+        if(!(zone.right > zone.left && zone.top > zone.bom))
+        {
+            LOG_ERROR(adtf_util::cString::Format("Digital map: %s zone without area", name.GetPtr()));
+            continue;
+        }
+        digital_map.AddZone(zone);
+        added++;
+    }
+
+    if(added == 0)
+    {
+        LOG_WARNING(adtf_util::cString::Format("Digital map %s has no valid zones, the built-in zones are used", fileMap.GetPtr()));
+        RETURN_ERROR(ERR_INVALID_FILE);
+    }
 
     RETURN_NOERROR;
 }
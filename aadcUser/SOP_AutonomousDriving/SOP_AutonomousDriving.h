@@ -6,6 +6,11 @@
 //#include "audi_q2_nlp.h"
 //#include "IpIpoptApplication.hpp"
 #include "Nmpc/parameter_settings.h"
+#include "NMPC_Solver.h"
+#include "Digital_Map.h"
+#include "Sequence_Lock.h"
+#include "Ultrasonic_Tracker.h"
+#include "Occupancy_Grid.h"
 #include <time.h>
 
 
@@ -45,6 +50,22 @@ enum CROSSING {CROSSING_FLAG_OFF, CROSSING_FLAG_STOP_LINE, CROSSING_FLAG_TRAFFIC
 enum PEDESTRIAN_STATE {NO_PESDESTRIAN, PEDESTRIAN_GOING, PEDESTRIAN_LEAVING, PEDESTRIAN_CHILDREN};
 enum CROSSING_VEHICLE_STATE {NO_VEHICLES, VEHICLES_RIGHT, VEHICLES_LEFT, VEHICLES_FRONT, VEHICLES_THERE};
 enum STOP_DECISION_STATE {STOP_DECISION, NOSTOP_DECISION};
+enum SCHEDULE_MODE {SCHEDULE_POLLING, SCHEDULE_DEADLINE, SCHEDULE_SAMPLES};
+enum NMPC_BACKEND {NMPC_BACKEND_IPOPT, NMPC_BACKEND_RTI, NMPC_BACKEND_TABLE, NMPC_BACKEND_COUNT};
+enum MANEUVER_REFERENCE {MANEUVER_REFERENCE_TURN_LEFT, MANEUVER_REFERENCE_TURN_RIGHT, MANEUVER_REFERENCE_STRAIGHT,
+                         MANEUVER_REFERENCE_PULL_OUT_LEFT, MANEUVER_REFERENCE_PULL_OUT_RIGHT,
+                         MANEUVER_REFERENCE_AVOIDANCE_OUT, MANEUVER_REFERENCE_AVOIDANCE_BACK,
+                         MANEUVER_REFERENCE_PARKING_FORWARD, MANEUVER_REFERENCE_PARKING_BACKWARD, MANEUVER_REFERENCE_COUNT};
+enum NMPC_PROFILE {NMPC_PROFILE_DEFAULT, NMPC_PROFILE_AVOIDANCE, NMPC_PROFILE_TURN_LEFT, NMPC_PROFILE_TURN_RIGHT,
+                   NMPC_PROFILE_STRAIGHT, NMPC_PROFILE_PULL_OUT_LEFT, NMPC_PROFILE_PULL_OUT_RIGHT, NMPC_PROFILE_PARKING,
+                   NMPC_PROFILE_COUNT};
+enum NMPC_PROFILE_AXIS {NMPC_PROFILE_AXIS_X, NMPC_PROFILE_AXIS_Y, NMPC_PROFILE_AXIS_COUNT};  // road along the X or the Y axis
+
+class NMPC_IpoptSolver;
+class NMPC_LookupTableSolver;
+class NMPC_ManeuverSpeculation;
+class NMPC_AsyncWorker;
+class NMPC_BenchmarkWorker;
 
 enum LIGHT {HEAD, BRAKE, REVERSE, HAZARD, LEFT, RIGHT};
 enum parkingSlot{slot1, slot2, slot3, slot4};
@@ -57,6 +78,12 @@ enum juryActions{action_STOP = -1, action_GETREADY = 0, action_START = 1};
 
 
 
+#define MARKER_TIMEOUT                  100000  // us, a road sign without a new sample is gone
+#define EMERGENCY_BREAK_HOLD            1500000 // us the car stands after the emergency break sensors are clear
+#define SCHEDULE_WORKER_POLL_INTERVAL   5       // ms, Cycle() looks for a result of the NMPC worker
+#define NMPC_PATH_CURVE_MIN_X           5       // cm, points of the path curve closer to the car are left out
+#define NMPC_OVERRUN_LOG_INTERVAL       1000000 // us, the overruns since the last warning are summed up in one
+
 #define PARKING_READY_FLAG_OFF 0
 #define PARKING_READY_FLAG_ON 1
 
@@ -107,9 +134,19 @@ typedef struct _TURN_AROUND_REFERENCE_COORDINATE
 {
     float X[100];
     float Y[100];
+    float S[100];   // arc length from the start of the maneuver to the point
 
 }TURN_AROUND_REFERENCE_COORDINATE;
 
+/*! One entry of the maneuver library: the reference in the frame of the car at the start of the
+ *  maneuver, turned to each road heading 0, PI/2, PI and -PI/2 (see RoadQuadrant) */
+typedef struct _MANEUVER_LIBRARY_ENTRY
+{
+    int size;
+    TURN_AROUND_REFERENCE_COORDINATE quadrant[4];
+
+}MANEUVER_LIBRARY_ENTRY;
+
 typedef struct _CAR_POSITION_STRUCT
 {
     tFloat32 X_Position;
@@ -119,6 +156,37 @@ typedef struct _CAR_POSITION_STRUCT
 
 }CAR_POSITION_STRUCT;
 
+typedef struct _ULTRASONIC_INPUT
+{
+    tFloat32 value[20];
+
+}ULTRASONIC_INPUT;
+
+typedef struct _LANE_INPUT
+{
+    tFloat32 value[11];
+
+}LANE_INPUT;
+
+/*! inputs as the tasks of one Cycle() see them, each with the time it was published, 0 if never */
+typedef struct _VEHICLE_STATE
+{
+    tTimeStamp time;
+    tTimeStamp ultrasonic_time;
+    ULTRASONIC_INPUT ultrasonic;
+    tTimeStamp lane_time;
+    LANE_INPUT lane;
+    tTimeStamp position_time;
+    CAR_POSITION_STRUCT position;
+    tTimeStamp speed_time;
+    tFloat32 speed;
+    tTimeStamp distance_time;
+    tFloat32 distance_overall;
+    tTimeStamp tracks_time;
+    ULTRASONIC_TRACK_LIST tracks;
+
+}VEHICLE_STATE;
+
 
 typedef struct _OBSTACLE
 {
@@ -161,21 +229,45 @@ typedef struct _MANEUVER_LIST
 
 }MANEUVER_LIST;
 
-typedef struct _T_CROSSING_SECTION
+/*! One NMPC problem as CalculateMPC hands it to a backend */
+typedef struct _NMPC_PROBLEM
 {
-    tFloat32 X_Position;
-    tFloat32 Y_Position;
-    tFloat32 HeadingAngle;
-}T_CROSSING_SECTION;
-
-typedef struct _SECTION_BOUNDARY
+    int backend;                        // NMPC_BACKEND
+    int car_state_flag;
+    long start_time;                    // us, when the problem was built
+    COORDINATE_STRUCT reference;
+    double speed_reference;
+    int horizon;                        // stages, N or less
+    NMPC_OBSTACLE obstacles[NMPC_MAX_OBSTACLES];
+    int obstacle_count;
+    NMPC_WEIGHTS weights;
+    double lower[NXU];
+    double upper[NXU];
+    double initial_state[NX];
+    double speed;                       // input applied when the problem was built
+    double steering;
+    tFloat32 lane_coefficients[3];
+    double seed[N*NXU + NX];            // trajectory of the speculative maneuver solve
+    tBool seed_valid;
+}NMPC_PROBLEM;
+
+/*! Solution of an NMPC_PROBLEM */
+typedef struct _NMPC_RESULT
 {
-    tFloat32 left;
-    tFloat32 right;
-    tFloat32 top;
-    tFloat32 bom;
-    tFloat32 HeadingAngle;
-}SECTION_BOUNDARY;
+    int backend;
+    int car_state_flag;
+    long start_time;                    // us, of the problem
+    double shift_steps;                 // time since the problem before in multiples of DT
+    double solve_time;                  // s
+    tBool solve_ok;
+    tBool warm_started;
+    int iterations;
+    double solution[N*NXU + NX];
+    COORDINATE_STRUCT reference;        // of the problem, for the fallback
+    double lower[NXU];
+    double upper[NXU];
+    double initial_state[NX];
+}NMPC_RESULT;
 
 /*! struct for a maneuver */
 struct tAADC_Maneuver
@@ -223,6 +315,8 @@ typedef struct _stopLine
 
 class SOP_AutonomousDriving : public cTimeTriggeredFilter
 {
+    /*! solves NMPC problems of CalculateMPC outside of Cycle() */
+    friend class NMPC_AsyncWorker;
 
     /*! This macro does all the plugin setup stuff */
     ADTF_FILTER_VERSION(OID_ADTF_FILTER_DEF, ADTF_FILTER_DESC, adtf::OBJCAT_Auxiliary, ADTF_FILTER_VERSION_SUB_NAME, ADTF_FILTER_VERSION_Major, ADTF_FILTER_VERSION_Minor,ADTF_FILTER_VERSION_Build, ADTF_FILTER_VERSION_LABEL);
@@ -235,6 +329,19 @@ public:
     /*! default destructor */
     virtual ~SOP_AutonomousDriving();
 
+    /*! reference of TURN_LEFT, TURN_RIGHT or STRAIGHT before it is placed at the car, also used by
+     *  the speculative solve of NMPC_ManeuverSpeculation
+     *  \return number of points, 0 for other maneuvers */
+    static int ManeuverLocalReference(int maneuver, TURN_AROUND_REFERENCE_COORDINATE *reference);
+
+    /*! reference of a MANEUVER_REFERENCE before it is placed at the car
+     *  \return number of points */
+    static int ManeuverLibraryReference(int entry, TURN_AROUND_REFERENCE_COORDINATE *reference);
+
+    /*! hands a problem to a backend, also used by NMPC_BenchmarkWorker for its own backends
+     *  \param table  the lookup table among the backends of the caller */
+    static void SetNMPCProblem(NMPC_Solver *solver, NMPC_LookupTableSolver *table, const NMPC_PROBLEM& problem);
+
 protected:
 
     //Input Signals
@@ -351,13 +458,13 @@ protected:
     //Parameter
     tFloat32 reference_value[11];
     tFloat32 rear_camera_ref_value[7];
-    tFloat32 position_value[5];
     tFloat32 output_steering;
     tFloat32 last_speed;
     tFloat32 last_steering;
     tFloat32 car_speed;
     tFloat32 distance_overall;
     tFloat32 last_distance_overall;
+    tFloat32 maneuver_start_distance;   // distance_overall when the reference was placed
     tFloat32 last_distance_overall_for_crossing;
     tFloat32 last_distance_overall_for_parking;
     tFloat32 car_curve_a;
@@ -413,12 +520,21 @@ protected:
     double crossing_right_distance;
     double crossing_middle_distance;
     double obstacle_detect_distance;
+    double ultrasonic_max_range;
+    double ultrasonic_tracker_alpha;
+    double ultrasonic_tracker_beta;
+    double ultrasonic_tracker_gate;
+    int ultrasonic_tracker_confirm_hits;
+    int ultrasonic_tracker_max_misses;
     double avoidance_initial_distance;
     double avoidance_laneChange_speed;
     double carFollowing_detect_distance;
     double carFollowing_preVeh_minSpeed;
     double avoidance_side_distance;
     double avoidance_comeBack_counter;
+    tBool nmpc_obstacle_constraints;
+    double nmpc_obstacle_clearance;
+    double nmpc_obstacle_weight;
 
     float slot0_distance;
     float slot1_distance;
@@ -437,15 +553,8 @@ protected:
     tBool KI_child;
     tBool KI_adult;
 
-    int T_crossing_nummer;
-    T_CROSSING_SECTION T_crossing_section[30];
-    int avoidance_nummer;
-    SECTION_BOUNDARY avoidance_section_boundary[30];
-    int pedestrian_nummer;
-    SECTION_BOUNDARY pedestrian_section_boundary[30];
-    SECTION_BOUNDARY T_section_boundary[30];
-    int child_nummer;
-    SECTION_BOUNDARY child_section_boundary[30];
+    // crossing, avoidance, pedestrian and child zones and the stop lines, built in ResetDigitialMap()
+    DigitalMap digital_map;
 
 
     double lane_follow_speed;
@@ -470,17 +579,6 @@ protected:
     int pull_out_light_counter;
 
 
-    //bezier curve points
-    float pt1[2];
-    float pt2[2];
-    float pt3[2];
-    float pt4[2];
-    float pt5[2];
-    float pt6[2];
-    float pt7[2];
-    float pt8[2];
-
-
     MANEUVER_LIST ManeuverList;
 
 
@@ -494,35 +592,125 @@ protected:
     Mat m_Rvec; /*! rotation vector */
     short marker_distance;    //Camera to Marker in cm
     short marker_lateral;     //Camer to Marker center in cm
-    short marker_update_counter;
+    tTimeStamp marker_update_time;  // us, last road sign sample
 
     // ********* variables for calculate TTC ********* //
-    short relative_distance[8];
     short last_relative_distance;
     double relative_speed;
     double pre_veh_speed;
     int average_speed_counter;
     short average_distance;
-    short last_average_distance;
     tBool car_following_flag;
     // ******************//
 
     tFloat32 MPC_sampling_rate;
     tFloat32 state_control_sampling_rate;
+    tBool nmpc_warm_start;
+    int nmpc_backend_lane_follow;
+    int nmpc_backend_maneuver;
+    tBool nmpc_benchmark_backends;
+    double nmpc_solve_budget;
+    int nmpc_max_iterations;
+    double nmpc_pure_pursuit_look_ahead;
+    double nmpc_replay_interval;
+    int nmpc_horizon_min;
+    double nmpc_horizon_nominal_speed;
+    long nmpc_last_problem_time;
+    long nmpc_last_replay_time;
+
+    tBool ekf_arc_prediction;
+    int nmpc_overrun_counter;
+    int nmpc_overrun_logged_counter;    // nmpc_overrun_counter at the last warning
+    long nmpc_last_overrun_log_time;
+    int nmpc_fallback_replay_counter;
+    int nmpc_fallback_pursuit_counter;
+
+    // NMPC solver backends, indexed by NMPC_BACKEND, and the problem handed to them
+    NMPC_Solver *nmpc_solver[NMPC_BACKEND_COUNT];
+    NMPC_IpoptSolver *nmpc_ipopt_solver;
+    NMPC_LookupTableSolver *nmpc_table_solver;
+    double nmpc_backend_time_sum[NMPC_BACKEND_COUNT];
+    int nmpc_backend_solve_counter[NMPC_BACKEND_COUNT];
+    COORDINATE_STRUCT mpc_reference;
+    NMPC_WEIGHTS mpc_weights;
+    double mpc_speed_reference;
+    double mpc_bounds_speed;            // speed of mpc_lower/mpc_upper
+    int mpc_horizon;
+    NMPC_OBSTACLE mpc_obstacles[NMPC_MAX_OBSTACLES];
+    int mpc_obstacle_count;
+    // weights of every maneuver except lane following, built and checked once in Start()
+    NMPC_WEIGHTS nmpc_weight_profile[NMPC_PROFILE_COUNT][NMPC_PROFILE_AXIS_COUNT];
+    double mpc_initial_state[NX];
+    double mpc_lower[NXU];
+    double mpc_upper[NXU];
+    double mpc_solution[N*NXU + NX];
+    int mpc_car_state_flag;
+    long last_mpc_start_time;
+
+    // last accepted input sequence {v, delta}, replayed when a solve misses its deadline
+    double mpc_input_sequence[N][2];
+    long mpc_input_sequence_time;
+    int mpc_input_sequence_flag;
+    tBool mpc_input_sequence_valid;
+
+    // car_curve_a/b of the last result while the MPC drives the car, see FitNMPCPathCurve()
+    tFloat32 nmpc_path_curve[2];
+    int nmpc_path_curve_flag;
+    tBool nmpc_path_curve_valid;
+
+    // maneuver after a crossing solved in the background during the approach
+    tBool nmpc_speculation_enabled;
+    NMPC_ManeuverSpeculation *nmpc_speculation;
+    double nmpc_seed[N*NXU + NX];
+    int nmpc_seed_flag;
+    tBool nmpc_seed_valid;
+
+    // NMPC solved by a worker thread, Cycle() only posts problems and publishes results
+    tBool nmpc_async_enabled;
+    tBool nmpc_prewarm;
+    NMPC_AsyncWorker *nmpc_async;
+    // the other backends timed on problems of the driving one, see "NMPC::Benchmark backends"
+    NMPC_BenchmarkWorker *nmpc_benchmark;
     tFloat32 MPC_sampling_rate_counter;
     tFloat32 state_control_sampling_rate_counter;
 
+    // absolute deadlines of SCHEDULE_DEADLINE and SCHEDULE_SAMPLES, see RunScheduledTasks()
+    int schedule_mode;
+    tTimeStamp next_state_control_time;
+    tTimeStamp next_mpc_time;
+    tTimeStamp last_state_control_time;
+    double state_control_dt;            // s since the state control before
+    tBool schedule_running;             // between Start() and Stop(), PropertyChanged() reconfigures
+
+    // latest sample of every input, written by OnPinEvent() without a lock, see TakeVehicleState()
+    SequenceLock<ULTRASONIC_INPUT> ultrasonic_sample;
+    SequenceLock<LANE_INPUT> lane_sample;
+    SequenceLock<CAR_POSITION_STRUCT> position_sample;
+    SequenceLock<tFloat32> wheel_speed_sample;
+    SequenceLock<tFloat32> distance_sample;
+    SequenceLock<ULTRASONIC_TRACK_LIST> ultrasonic_track_sample;
+    // updated by every ultrasonic sample in OnPinEvent(), read through ultrasonic_track_sample only
+    UltrasonicTracker ultrasonic_tracker;
+    // rays of every ultrasonic sample in the odometry frame, m_critSecUltrasonicData
+    tBool occupancy_grid_enabled;
+    OccupancyGrid occupancy_grid;
+    tBool odometry_started;
+    tFloat32 odometry_distance;         // distance_overall of the last ultrasonic sample
+    double odometry_x;                  // cm
+    double odometry_y;
+    VEHICLE_STATE vehicle_state;
+
     int turn_around_reference_counter;
 
     int input_state_flag;
 
     bool pedestrian_flag;
-    int ultra_read_counter;
 
 
 
     tBool car_position_first_flag;
     COORDINATE_STRUCT ref_lane_world_coord;
+    tFloat32 ref_lane_coefficients[3];     // lane polynomial ref_lane_world_coord was sampled from
     COORDINATE_STRUCT ref_lane_coord_in_image;
     COORDINATE_STRUCT rear_ref_lane_coord_in_image;
     COORDINATE_STRUCT ref_coord_in_MCP;
@@ -538,6 +726,8 @@ protected:
     TURN_AROUND_REFERENCE_COORDINATE avoidance_ref_coord;
     TURN_AROUND_REFERENCE_COORDINATE parking_ref_coord;
 
+    MANEUVER_LIBRARY_ENTRY maneuver_library[MANEUVER_REFERENCE_COUNT];   // built once in Start()
+
     tResult Init(tInitStage eStage, ucom::IException** __exception_ptr);
 
     tResult Shutdown(tInitStage eStage, ucom::IException** __exception_ptr = NULL);
@@ -626,7 +816,12 @@ private: // private methods
     tResult ReadPinArrayValue(IMediaSample* input_pMediaSample, sop_pin_struct *input_pin, cString *PIN_ID_name, int number_of_array, tFloat32 *output_value);
     tResult ProcessUssStructValue(IMediaSample* pMediaSample , tFloat32 *output_value);
     tResult ProcessRoadSignStructExt(IMediaSample* pMediaSampleIn);
-    tResult CalculateUltrasonicWorldCoordinate(tFloat32 *ult_value);
+    tResult CalculateUltrasonicWorldCoordinate(const tFloat32 *ult_value, tFloat32 world_coord[][2]);
+    tResult TrackUltrasonicObstacles(const ULTRASONIC_INPUT& sample, tTimeStamp time);
+    const ULTRASONIC_TRACK* FrontTrack(float max_distance) const;
+    tResult UpdateOccupancyGrid(const ULTRASONIC_INPUT& sample);
+    tFloat32 UltrasonicFreeDistance(int sensor);
+    tBool IsSideOccupied(float x_min, float x_max, float y_min, float y_max);
     int DrivingModeDecision(int driving_mode_flag);
     int DrivingModeDecision_TestModel(void);
     tResult WriteReferencePoint(sop_pin_struct *pin, int number_of_array);
@@ -635,12 +830,28 @@ private: // private methods
 
     tResult WriteSignalValue(sop_pin_struct *pin, tFloat32 value, tUInt32 timestamp);
     tResult ResetDigitialMap();
+    tResult ConfigureSchedule(void);
+    tResult RunScheduledTasks(void);
+    tResult RunStateControl(void);
+    tResult RunMPC(void);
+    tResult TakeVehicleState(void);
+    tResult LoadDigitalMap();
     tResult LoadConfiguration();
     tTimeStamp GetTime();
 
     //Data_Processing.cpp
     tResult CalculateTrackingPoint(void);
     tResult CalculateTurnAroundReferencePoint(char left_or_right, int goal_coord_index);
+    void PlaceManeuverReference(int maneuver, TURN_AROUND_REFERENCE_COORDINATE *reference);
+    void WriteManeuverWindow(const TURN_AROUND_REFERENCE_COORDINATE *reference, int size, int first);
+    void BuildManeuverLibrary(void);
+    int PlaceLibraryReference(int entry, TURN_AROUND_REFERENCE_COORDINATE *reference, int first);
+    static int ReferencePointsPassed(const TURN_AROUND_REFERENCE_COORDINATE *reference, int size, float travelled);
+    int NextReferenceWindow(const TURN_AROUND_REFERENCE_COORDINATE *reference, int limit);
+    static int RoadQuadrant(double heading);
+    static void RotateToQuadrant(int quadrant, double x, double y, double *x_out, double *y_out);
+    static double RoadQuadrantHeading(double heading);
+    static double RoadQuadrantOffset(double heading);
     float GetDistanceBetweenCoordinates(float x2, float y2, float x1, float y1);
 
 
@@ -662,6 +873,23 @@ private: // private methods
     tResult SetIpopt(void);
     tResult CalculateMPC(int input_car_state_flag, float direction);
     tResult ResetIpopt(void);
+    tResult SetNMPCSolvers(void);
+    void SetNMPCMoveBlocking(void);
+    tResult PrewarmNMPCSolvers(void);
+    void BuildNMPCProblem(int backend, NMPC_PROBLEM *problem);
+    void SolveNMPCProblem(const NMPC_PROBLEM& problem, NMPC_RESULT *result);
+    tResult PublishNMPCResult(const NMPC_RESULT& result);
+    tResult PollNMPCWorker(void);
+    tResult ReplayNMPCInputs(void);
+    tResult BuildNMPCWeightProfiles(void);
+    tResult LoadNMPCWeightProfiles(NMPC_WEIGHTS *road_frame);
+    static int NMPCProfile(int car_state_flag);
+    int NMPCHorizon(int backend, int car_state_flag, double speed);
+    void SetNMPCObstacles(void);
+    tResult RequestManeuverSpeculation(void);
+    tResult CalculateFallbackControl(const NMPC_RESULT& result, long current_time);
+    void FitNMPCPathCurve(const NMPC_RESULT& result, tBool used);
+    tResult WriteSteeringAndSpeed(double speed, double steering);
     tResult CloseIpopt(void);
     tResult ExtendedKF(void);
     tResult curvefitting(void);
@@ -679,6 +907,7 @@ private: // private methods
     /*! bitmap format of output pin */
     tBitmapFormat m_sOutputFormat;
     cCriticalSection m_oCritSectionInputData;
+    cCriticalSection m_oCritSectionSchedule;    // the tasks of Cycle() against those started by samples
     cCriticalSection m_critSecTransmitControl;
     cCriticalSection m_critSecGetData;
     cCriticalSection m_critSecGetSpeed;
@@ -689,7 +918,7 @@ private: // private methods
     void initialize_bounds();
 //    void collocation_matrix();
 //    void collocation_matrix_2();
-    void CalculateCoefficient(double *answer, double *x, double *y, int size_of_arrays, int degree_of_polynomial);
+    tBool CalculateCoefficient(double *answer, double *x, double *y, int size_of_arrays, int degree_of_polynomial);
 
     //double dotX1(double *sVars, double *uu, double h);
     //double dotX2(double *sVars, double *uu, double h);
@@ -0,0 +1,63 @@
+#ifndef _SEQUENCE_LOCK_H_
+#define _SEQUENCE_LOCK_H_
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+#define SEQUENCE_LOCK_BARRIER() MemoryBarrier()
+#else
+#define SEQUENCE_LOCK_BARRIER() __sync_synchronize()
+#endif
+
+/*! Value with a time stamp, written by one thread and read by any number of threads, without a lock.
+ *
+ *  The sequence number is odd while the writer copies the value. A reader copies the value and
+ *  takes the copy if the sequence number was even and has not changed meanwhile, otherwise it
+ *  tries again. The writer never waits for a reader, a reader waits for one copy of T at most.
+ *  T must be copyable with memcpy. Two writers of one instance need a lock of their own.
+ */
+template <typename T>
+class SequenceLock
+{
+public:
+    SequenceLock()
+        : m_nSequence(0),
+          m_nTime(0)
+    {
+        memset(const_cast<T*>(&m_value), 0, sizeof(T));
+    }
+
+    void Write(const T& value, long long time)
+    {
+        m_nSequence++;
+        SEQUENCE_LOCK_BARRIER();
+        memcpy(const_cast<T*>(&m_value), &value, sizeof(T));
+        m_nTime = time;
+        SEQUENCE_LOCK_BARRIER();
+        m_nSequence++;
+    }
+
+    /*! \return time of the value, 0 if it has never been written */
+    long long Read(T *value) const
+    {
+        for (;;)
+        {
+            unsigned int sequence = m_nSequence;
+            SEQUENCE_LOCK_BARRIER();
+            if (sequence & 1)
+                continue;
+            memcpy(value, const_cast<const T*>(&m_value), sizeof(T));
+            long long time = m_nTime;
+            SEQUENCE_LOCK_BARRIER();
+            if (m_nSequence == sequence)
+                return time;
+        }
+    }
+
+private:
+    volatile unsigned int m_nSequence;
+    volatile T m_value;
+    volatile long long m_nTime;
+};
+
+#endif // _SEQUENCE_LOCK_H_
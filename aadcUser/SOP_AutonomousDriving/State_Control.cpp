@@ -21,7 +21,7 @@ int stopLine_check_flag = 0;
 
 tInt16 temp_marker_ID;
 
-int break_counter = 0;
+tTimeStamp break_time_left = 0;  // us, counts down while the car stands
 int temp_mode_flag = NO_BREAK_INDEX_FLAG;
 //short break_index_flag[8] = {0};
 int car_stop_counter = 0;
@@ -46,7 +46,7 @@ int SOP_AutonomousDriving::DrivingModeDecision(int driving_mode_flag)
 {
 
 
-    if(marker_update_counter > 99)
+    if(GetTime() - marker_update_time >= MARKER_TIMEOUT)
     {
         road_marker_ID = NO_TRAFFIC_SIGN;
         marker_distance = 0;
@@ -84,7 +84,9 @@ int SOP_AutonomousDriving::DrivingModeDecision(int driving_mode_flag)
 
     //     LOG_INFO(adtf_util::cString::Format("AVOIDANCE comeback_flag %d wait flag %d driving_mode_flag %d", avoidance.comeback_flag , avoidance.comeback_wait_counter,  driving_mode_flag));
 
-    if((driving_mode_flag == LANE_FOLLOW || driving_mode_flag == AVOIDANCE) && driving_mode_flag != PARKING)
+    // with the obstacle in the NMPC (real-time iteration only, see SetNMPCSolvers()) the car stays in its lane following and steers around it there
+    if((driving_mode_flag == LANE_FOLLOW || driving_mode_flag == AVOIDANCE) && driving_mode_flag != PARKING
+            && nmpc_obstacle_constraints == tFalse)
         driving_mode_flag = AvoidanceProcess(driving_mode_flag);
 
 
@@ -100,18 +102,13 @@ int SOP_AutonomousDriving::AvoidanceProcess(int driving_mode_flag)
      *
      *
     */
-    for(int index = 0; index < avoidance_nummer;index++)
+    if (digital_map.Find(MAP_ZONE_AVOIDANCE, car_est_position.X_Position, car_est_position.Y_Position) != NULL)
     {
-        if (car_est_position.X_Position < avoidance_section_boundary[index].right && car_est_position.X_Position > avoidance_section_boundary[index].left &&
-            car_est_position.Y_Position < avoidance_section_boundary[index].top && car_est_position.Y_Position > avoidance_section_boundary[index].bom)
-        {
-            avoidance_permit_flag = 1;
-            LOG_INFO(adtf_util::cString::Format("Avoidance permit "));
-            break;
-        }
-        else
-            avoidance_permit_flag = 0;
+        avoidance_permit_flag = 1;
+        LOG_INFO(adtf_util::cString::Format("Avoidance permit "));
     }
+    else
+        avoidance_permit_flag = 0;
 
     if (avoidance_permit_flag == 1)
     {
@@ -134,12 +131,19 @@ int SOP_AutonomousDriving::AvoidanceProcess(int driving_mode_flag)
 
     if(avoidance.flag == tTrue)
     {
+        // the grid keeps the obstacle along the whole right side after the side sensor has passed it
+        tBool side_occupied;
+        if(occupancy_grid_enabled == tTrue)
+            side_occupied = IsSideOccupied(-30, 15, 15, avoidance_side_distance + (15));
+        else
+            side_occupied = (ult_world_coord[S_RIGHT][Y] < (avoidance_side_distance + (15))) ? tTrue : tFalse;
+
         //        lane_follow_speed = 0.5;
-        if(ult_world_coord[S_RIGHT][Y] < (avoidance_side_distance + (15))  && avoidance.comeback_flag == 1)
+        if(side_occupied == tTrue  && avoidance.comeback_flag == 1)
         {
             avoidance.comeback_wait_counter = avoidance_comeBack_counter;
         }
-        else if(ult_world_coord[S_RIGHT][Y] > (avoidance_side_distance + (15)) && avoidance.comeback_flag == 1 && driving_mode_flag == LANE_FOLLOW)
+        else if(side_occupied == tFalse && avoidance.comeback_flag == 1 && driving_mode_flag == LANE_FOLLOW)
         {
             if(avoidance.comeback_wait_counter > 0)
                 avoidance.comeback_wait_counter--;
@@ -192,7 +196,7 @@ tResult SOP_AutonomousDriving::ObstacleDetection(void)
                 temp_Ultrasonic[index][X] = ult_world_coord[index][X];
                 temp_Ultrasonic[index][Y] = ult_world_coord[index][Y];
                 obstacle_from_Ultrasonic.find_flag = tTrue;
-                LOG_INFO(adtf_util::cString::Format("Obstacle find"));
+//                LOG_INFO(adtf_util::cString::Format("Obstacle find"));
 
             }
 
@@ -277,31 +281,28 @@ tResult SOP_AutonomousDriving::ObstacleDetection(void)
         }
 
 
-        if(ultra_read_counter < 3)
+        // distance and closing speed of the tracked obstacle, until its track is confirmed there is no car to follow
+        const ULTRASONIC_TRACK *track = FrontTrack(obstacle_detect_distance + (29));
+        if(track != NULL)
         {
-            relative_distance[ultra_read_counter] = obstacle_from_Ultrasonic.distance;
-            ultra_read_counter ++;
-        }
-        else
-        {
-            last_average_distance = (relative_distance[0] + relative_distance[1] + relative_distance[2])/3;
-            relative_distance[0] = relative_distance[1];
-            relative_distance[1] = relative_distance[2];
-            relative_distance[2] = obstacle_from_Ultrasonic.distance;
-            average_distance = (relative_distance[0] + relative_distance[1] + relative_distance[2])/3;
-            relative_speed = (last_average_distance/100.0 - average_distance/100.0) / (state_control_sampling_rate/1000);
-            //LOG_INFO(adtf_util::cString::Format("*********************"));
+            average_distance = static_cast<short>(track->x + (29));
+            relative_speed = -track->vx / 100.0;
             //            LOG_INFO(adtf_util::cString::Format("Average speed %g",relative_speed));
             //            LOG_INFO(adtf_util::cString::Format("Real speed %g",car_speed));
             //LOG_INFO(adtf_util::cString::Format("Average distance %d",average_distance));
             pre_veh_speed = lane_follow_speed - relative_speed;
-            LOG_INFO(adtf_util::cString::Format("Preceding vehicle speed %g",pre_veh_speed));
+//            LOG_INFO(adtf_util::cString::Format("Preceding vehicle speed %g",pre_veh_speed));
+        }
+        else
+        {
+            average_distance = 400;
+            relative_speed = 0;
+            pre_veh_speed = 2;
         }
     }
     else
     {
         obstacle_from_Ultrasonic.counter = 0;
-        ultra_read_counter = 0;
         average_distance = 400;
         relative_speed = 0;
         pre_veh_speed = 2;
@@ -347,7 +348,6 @@ tResult SOP_AutonomousDriving::SpeedDecision(void)
 
 tResult SOP_AutonomousDriving::ChildDetection()
 {
-    int index = 0;
     tBool  detection_flag = tFalse;
 
     float temp_HeadingAngle = car_est_position.HeadingAngle;
@@ -360,21 +360,12 @@ tResult SOP_AutonomousDriving::ChildDetection()
     else
         temp_HeadingAngle = 180;
 
-    for(index = 0; index < child_nummer; index++)
+    tFloat32 Tx = (car_est_position.X_Position+cos(temp_HeadingAngle*DEGREES_TO_RADIAN)*0.5);
+    tFloat32 Ty = (car_est_position.Y_Position+sin(temp_HeadingAngle*DEGREES_TO_RADIAN)*0.5);
+    if (digital_map.Find(MAP_ZONE_CHILD, Tx, Ty) != NULL)
     {
-        tFloat32 Tx = (car_est_position.X_Position+cos(temp_HeadingAngle*DEGREES_TO_RADIAN)*0.5);
-        tFloat32 Ty = (car_est_position.Y_Position+sin(temp_HeadingAngle*DEGREES_TO_RADIAN)*0.5);
-        if (Tx < child_section_boundary[index].right && Tx > child_section_boundary[index].left &&
-            Ty < child_section_boundary[index].top && Ty > child_section_boundary[index].bom)
-        {
-            detection_flag = tTrue;
-            //bLOG_INFO(adtf_util::cString::Format("Child Detection On"));
-            break;
-        }
-        else
-        {
-            detection_flag = tFalse;
-        }
+        detection_flag = tTrue;
+        //bLOG_INFO(adtf_util::cString::Format("Child Detection On"));
     }
 
 
@@ -531,8 +522,13 @@ int SOP_AutonomousDriving::UltrasensorEmergencyBreak(int driving_mode_flag)
     //  LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) Driving Flag Input %d",driving_mode_flag));
     if(car_speed > 0.0)
     {
+        // an obstacle which comes closer faster than the car drives needs the longer distance
+        double closing_speed = car_speed;
+        const ULTRASONIC_TRACK *track = FrontTrack(obstacle_detect_distance + (29));
+        if(track != NULL && -track->vx / 100.0 > closing_speed)
+            closing_speed = -track->vx / 100.0;
 
-        front_min_break_distance = (car_speed * front_min_break_time) * 100;  //cm
+        front_min_break_distance = (closing_speed * front_min_break_time) * 100;  //cm
         if(front_min_break_distance < min_break_distance)
             front_min_break_distance = min_break_distance;
     }
@@ -561,15 +557,15 @@ int SOP_AutonomousDriving::UltrasensorEmergencyBreak(int driving_mode_flag)
                 {
                     if(temp_mode_flag == NO_BREAK_INDEX_FLAG)
                         temp_mode_flag = driving_mode_flag;
-                    break_counter = 30;
-                    //   LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) *************Sensor counter %d",break_counter));
+                    break_time_left = EMERGENCY_BREAK_HOLD;
+                    //   LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) *************Sensor counter %d",break_time_left));
                 }
             }
         }
 
     }
 
-    else if(break_counter != 0)
+    else if(break_time_left > 0)
     {
         //LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) *************Car Stop"));
         float car_collision_y_range = 0;
@@ -578,18 +574,18 @@ int SOP_AutonomousDriving::UltrasensorEmergencyBreak(int driving_mode_flag)
         {
             if(ult_world_coord[index][X] < (front_min_break_distance + 30) && fabs(ult_world_coord[index][Y] - car_collision_y_range) < (35/2))
             {
-                break_counter = 30;
+                break_time_left = EMERGENCY_BREAK_HOLD;
                 //   LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) *************driving Flag Input %d last flag %d",driving_mode_flag, temp_mode_flag));
                 //                    break_index_flag = NO_BREAK_INDEX_FLAG;
                 //                    driving_mode_flag = temp_mode_flag;
             }
         }
-        break_counter--;
+        break_time_left -= static_cast<tTimeStamp>(state_control_dt * 1000000);
     }
 
 
 
-    if(break_counter != 0 && break_counter > 0)
+    if(break_time_left > 0)
     {
         driving_mode_flag = EMERGENCY_BREAK;
 
@@ -597,9 +593,9 @@ int SOP_AutonomousDriving::UltrasensorEmergencyBreak(int driving_mode_flag)
             ToggleLights(BRAKE, tTrue);
 
         image_processing_function_switch &= ~LANE_DETECTION;
-        LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) Sensor Flag Input %d",break_counter));
+        LOG_INFO(adtf_util::cString::Format("(EmergencyBreak) Sensor Flag Input %d ms",static_cast<int>(break_time_left / 1000)));
     }
-    else if(break_counter <= 0)
+    else if(break_time_left <= 0)
     {
         if(temp_mode_flag != NO_BREAK_INDEX_FLAG)
         {
@@ -644,6 +640,10 @@ int SOP_AutonomousDriving::CrossingDecision(int driving_mode_flag)
     int index = 0;
     int T_crossing_direction = -1;
 
+    // free distance of the front sensors in cm, from the occupancy grid or the last sample
+    tFloat32 free_distance[5];
+    for(index = 0; index < 5; index++)
+        free_distance[index] = UltrasonicFreeDistance(index);
 
     //open crossing flag distance in Cm
     if((road_marker_ID == UNMARKED_INTERSECTION || road_marker_ID == STOP_GIVE_WAY || road_marker_ID == HAVEWAY || road_marker_ID == GIVE_WAY ) && marker_distance < crossing_marker_distance)
@@ -695,6 +695,9 @@ int SOP_AutonomousDriving::CrossingDecision(int driving_mode_flag)
 
     else if(crossing_flag == CROSSING_FLAG_TRAFFIC_SIGNS)
     {
+        // the maneuver behind the crossing is solved in the background meanwhile
+        RequestManeuverSpeculation();
+
         //        lane_follow_speed = 0.5;
         temp_crossing_stop_distance -= ((distance_overall - last_distance_overall_for_crossing) * 100);
         last_distance_overall_for_crossing = distance_overall;
@@ -780,48 +783,46 @@ int SOP_AutonomousDriving::CrossingDecision(int driving_mode_flag)
         tFloat32 Ty = static_cast<tFloat32>(car_est_position.Y_Position+sin(temp_HeadingAngle*DEGREES_TO_RADIAN)*0.7);
         LOG_INFO(cString::Format("Position x %g Position y %g", Tx, Ty));
 
-        for(index = 0; index < T_crossing_nummer; index++)
+        // every T crossing zone which contains the point, in the order of the map
+        const MAP_ZONE *T_zones[MAP_QUERY_MAX_ZONES];
+        int T_zone_count = digital_map.Query(Tx, Ty, MAP_ZONE_MASK(MAP_ZONE_T_CROSSING), T_zones, MAP_QUERY_MAX_ZONES);
+        for(index = 0; index < T_zone_count; index++)
         {
-            if (Tx < T_section_boundary[index].right && Tx > T_section_boundary[index].left &&
-                Ty < T_section_boundary[index].top && Ty > T_section_boundary[index].bom)
+            if(temp_HeadingAngle == T_zones[index]->HeadingAngle)
+                T_crossing_direction = 0;
+            else if(fabs(temp_HeadingAngle - T_zones[index]->HeadingAngle) == 180)
+                T_crossing_direction = 1;
+            else if(fabs(temp_HeadingAngle - T_zones[index]->HeadingAngle) == 90||fabs(temp_HeadingAngle - T_zones[index]->HeadingAngle) == 270)
+                T_crossing_direction = 2;
+
+            if (T_crossing_direction!=-1)
             {
-                if(temp_HeadingAngle == T_section_boundary[index].HeadingAngle)
-                    T_crossing_direction = 0;
-                else if(fabs(temp_HeadingAngle - T_section_boundary[index].HeadingAngle) == 180)
-                    T_crossing_direction = 1;
-                else if(fabs(temp_HeadingAngle - T_section_boundary[index].HeadingAngle) == 90||fabs(temp_HeadingAngle - T_section_boundary[index].HeadingAngle) == 270)
-                    T_crossing_direction = 2;
-
-                if (T_crossing_direction!=-1)
-                {
-                    LOG_INFO(cString::Format("T crossing section id %d Direction %d heading %g", index, T_crossing_section[index].HeadingAngle));
-                    break;
-                }
-
+                LOG_INFO(cString::Format("T crossing section %d Direction %d heading %g", index, T_crossing_direction, T_zones[index]->HeadingAngle));
+                break;
             }
         }
 
 
         // from left to right: 90 140 100 Middle 80
-        if ((T_crossing_direction == -1 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) && (ultrasonic_value[0] > crossing_left_distance || abs(temp_ultrasonic_value_0 - ultrasonic_value[0]) > 10) && ultrasonic_value[2] > crossing_front_distance &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance) ||
-                (T_crossing_direction == -1 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && ultrasonic_value[2] > crossing_front_distance &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance ) ||
-                (T_crossing_direction == -1 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == STRAIGHT &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance ) ||
-                (T_crossing_direction == -1 && temp_marker_ID == HAVEWAY && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && ultrasonic_value[2] > crossing_front_distance  && ultrasonic_value[4] > crossing_middle_distance ) ||
+        if ((T_crossing_direction == -1 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) && (free_distance[F_LEFT] > crossing_left_distance || abs(temp_ultrasonic_value_0 - free_distance[F_LEFT]) > 10) && free_distance[F_CENTER_LEFT] > crossing_front_distance &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance) ||
+                (T_crossing_direction == -1 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && free_distance[F_CENTER_LEFT] > crossing_front_distance &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance ) ||
+                (T_crossing_direction == -1 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == STRAIGHT &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance ) ||
+                (T_crossing_direction == -1 && temp_marker_ID == HAVEWAY && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && free_distance[F_CENTER_LEFT] > crossing_front_distance  && free_distance[F_CENTER] > crossing_middle_distance ) ||
 
-                (T_crossing_direction == 0 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) && (ultrasonic_value[0] > crossing_left_distance || abs(temp_ultrasonic_value_0 - ultrasonic_value[0]) > 10) && ultrasonic_value[2] > crossing_front_distance  && ultrasonic_value[4] > crossing_middle_distance) ||
-                (T_crossing_direction == 0 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && ultrasonic_value[2] > crossing_front_distance  && ultrasonic_value[4] > crossing_middle_distance) ||
-                (T_crossing_direction == 0 && temp_marker_ID == HAVEWAY && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && ultrasonic_value[2] > crossing_front_distance  && ultrasonic_value[4] > crossing_middle_distance) ||
+                (T_crossing_direction == 0 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) && (free_distance[F_LEFT] > crossing_left_distance || abs(temp_ultrasonic_value_0 - free_distance[F_LEFT]) > 10) && free_distance[F_CENTER_LEFT] > crossing_front_distance  && free_distance[F_CENTER] > crossing_middle_distance) ||
+                (T_crossing_direction == 0 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && free_distance[F_CENTER_LEFT] > crossing_front_distance  && free_distance[F_CENTER] > crossing_middle_distance) ||
+                (T_crossing_direction == 0 && temp_marker_ID == HAVEWAY && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && free_distance[F_CENTER_LEFT] > crossing_front_distance  && free_distance[F_CENTER] > crossing_middle_distance) ||
 
-                (T_crossing_direction == 1 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) /*&& ultrasonic_value[2] > 140 */&&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance) ||
-                (T_crossing_direction == 1 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == STRAIGHT &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance ) ||
+                (T_crossing_direction == 1 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) /*&& free_distance[F_CENTER_LEFT] > 140 */&&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance) ||
+                (T_crossing_direction == 1 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == STRAIGHT &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance ) ||
 
-                (T_crossing_direction == 2 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) && (ultrasonic_value[0] > crossing_left_distance || abs(temp_ultrasonic_value_0 - ultrasonic_value[0]) > 10) &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance) ||
-                (T_crossing_direction == 2 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance ) ||
-                (T_crossing_direction == 2 && temp_marker_ID == HAVEWAY && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT  && ultrasonic_value[4] > crossing_middle_distance ) ||
+                (T_crossing_direction == 2 && (temp_marker_ID == GIVE_WAY || temp_marker_ID == STOP_GIVE_WAY) && (free_distance[F_LEFT] > crossing_left_distance || abs(temp_ultrasonic_value_0 - free_distance[F_LEFT]) > 10) &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance) ||
+                (T_crossing_direction == 2 && temp_marker_ID == UNMARKED_INTERSECTION && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance ) ||
+                (T_crossing_direction == 2 && temp_marker_ID == HAVEWAY && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT  && free_distance[F_CENTER] > crossing_middle_distance ) ||
 
-                (crossing_flag == CROSSING_FLAG_STOP_LINE && T_crossing_direction == -1 && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && ultrasonic_value[2] > crossing_front_distance &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance ) ||
-                (crossing_flag == CROSSING_FLAG_STOP_LINE && T_crossing_direction == -1 && ManeuverList.action[ManeuverList.id][0] == STRAIGHT &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance ) ||
-                (crossing_flag == CROSSING_FLAG_STOP_LINE && T_crossing_direction == 2 && (ultrasonic_value[0] > crossing_left_distance || abs(temp_ultrasonic_value_0 - ultrasonic_value[0]) > 10) &&  ultrasonic_value[6] > crossing_right_distance && ultrasonic_value[4] > crossing_middle_distance)
+                (crossing_flag == CROSSING_FLAG_STOP_LINE && T_crossing_direction == -1 && ManeuverList.action[ManeuverList.id][0] == TURN_LEFT && free_distance[F_CENTER_LEFT] > crossing_front_distance &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance ) ||
+                (crossing_flag == CROSSING_FLAG_STOP_LINE && T_crossing_direction == -1 && ManeuverList.action[ManeuverList.id][0] == STRAIGHT &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance ) ||
+                (crossing_flag == CROSSING_FLAG_STOP_LINE && T_crossing_direction == 2 && (free_distance[F_LEFT] > crossing_left_distance || abs(temp_ultrasonic_value_0 - free_distance[F_LEFT]) > 10) &&  free_distance[F_CENTER_RIGHT] > crossing_right_distance && free_distance[F_CENTER] > crossing_middle_distance)
                 )
         {
             if (crossing_stop_wait_counter <= 0)
@@ -851,7 +852,7 @@ int SOP_AutonomousDriving::CrossingDecision(int driving_mode_flag)
 
     }
 
-    temp_ultrasonic_value_0 = ultrasonic_value[0];
+    temp_ultrasonic_value_0 = free_distance[F_LEFT];
 
     return driving_mode_flag;
 }
@@ -901,7 +902,7 @@ int SOP_AutonomousDriving::DrivingModeDecision_TestModel(void)
         return CAR_STOP;
 
 
-    if(marker_update_counter > 99)
+    if(GetTime() - marker_update_time >= MARKER_TIMEOUT)
     {
         road_marker_ID = 99;
         marker_distance = 0;
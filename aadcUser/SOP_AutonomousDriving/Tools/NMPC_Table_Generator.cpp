@@ -0,0 +1,196 @@
+/* Offline generator of the lane following lookup table, see NMPC_Lookup_Table.h
+ *
+ * Every grid point {a, b, c, speed} is solved to convergence by repeating real-time iterations
+ * of NMPC_RTISolver (a full Gauss-Newton SQP). The previous steering angle of the input change
+ * penalty is the solution itself, i.e. the table holds the steady state of the closed loop.
+ *
+ * usage: NMPC_Table_Generator <table file> [options]
+ *   --a <lower> <upper> <points>        lane polynomial, quadratic coefficient in 1/cm
+ *   --b <lower> <upper> <points>        linear coefficient
+ *   --c <lower> <upper> <points>        lateral offset in cm
+ *   --speed <lower> <upper> <points>    speed in m/s
+ *   --speed-range <minimum> <maximum>   Lane Following::minimum/maximum speed of the filter
+ *   --qy <high speed> <low speed>       Lane Following::NMPC Weighting factor::High/Low speed y
+ *   --start-x <cm>                      first reference point, CAMERA_DISTANCE of the filter
+ */
+#include "NMPC_RTI_Solver.h"
+#include "NMPC_Lookup_Table.h"
+#include "Lane_Reference.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#define MAX_SQP_ITERATIONS  100
+#define SQP_TOLERANCE       1e-8
+
+static bool ParseAxis(int argc, char *argv[], int &i, NMPC_TABLE_HEADER *header, int axis)
+{
+    if (i + 3 >= argc)
+        return false;
+    header->lower[axis] = atof(argv[++i]);
+    header->upper[axis] = atof(argv[++i]);
+    header->size[axis] = atoi(argv[++i]);
+    return header->size[axis] >= 2 && header->upper[axis] > header->lower[axis];
+}
+
+static double GridPoint(const NMPC_TABLE_HEADER& header, int axis, int i)
+{
+    return header.lower[axis] + i * (header.upper[axis] - header.lower[axis]) / (header.size[axis] - 1);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <table file> [--a|--b|--c|--speed lower upper points] "
+                        "[--speed-range min max] [--qy high low] [--start-x cm]\n", argv[0]);
+        return 1;
+    }
+
+    NMPC_TABLE_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.magic = NMPC_TABLE_MAGIC;
+    header.version = NMPC_TABLE_VERSION;
+    header.horizon = N;
+    header.lower[TABLE_A] = -0.006;    header.upper[TABLE_A] = 0.006;    header.size[TABLE_A] = 13;
+    header.lower[TABLE_B] = -0.6;      header.upper[TABLE_B] = 0.6;      header.size[TABLE_B] = 13;
+    header.lower[TABLE_C] = -30;       header.upper[TABLE_C] = 30;       header.size[TABLE_C] = 13;
+    header.lower[TABLE_SPEED] = 0.3;   header.upper[TABLE_SPEED] = 1.0;  header.size[TABLE_SPEED] = 15;
+    header.start_x = 18;
+
+    double min_speed = 0.5;
+    double max_speed = 0.8;
+    double qy_high_speed = 4;
+    double qy_low_speed = 8;
+
+    for (int i = 2; i < argc; i++)
+    {
+        bool ok = true;
+        if (strcmp(argv[i], "--a") == 0)
+            ok = ParseAxis(argc, argv, i, &header, TABLE_A);
+        else if (strcmp(argv[i], "--b") == 0)
+            ok = ParseAxis(argc, argv, i, &header, TABLE_B);
+        else if (strcmp(argv[i], "--c") == 0)
+            ok = ParseAxis(argc, argv, i, &header, TABLE_C);
+        else if (strcmp(argv[i], "--speed") == 0)
+            ok = ParseAxis(argc, argv, i, &header, TABLE_SPEED);
+        else if (strcmp(argv[i], "--speed-range") == 0 && i + 2 < argc)
+        {
+            min_speed = atof(argv[++i]);
+            max_speed = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--qy") == 0 && i + 2 < argc)
+        {
+            qy_high_speed = atof(argv[++i]);
+            qy_low_speed = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--start-x") == 0 && i + 1 < argc)
+            header.start_x = atof(argv[++i]);
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            fprintf(stderr, "invalid argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    double lower[NXU];
+    double upper[NXU];
+    NMPCBounds(0, lower, upper);
+    header.steering_lower = lower[4];
+    header.steering_upper = upper[4];
+
+    const int n_speed = header.size[TABLE_SPEED];
+    std::vector<NMPC_WEIGHTS> weights(n_speed);
+    for (int iv = 0; iv < n_speed; iv++)
+        LaneFollowWeights(GridPoint(header, TABLE_SPEED, iv), min_speed, max_speed, qy_high_speed, qy_low_speed, &weights[iv]);
+
+    const long entries = (long)header.size[TABLE_A] * header.size[TABLE_B] * header.size[TABLE_C] * n_speed;
+    std::vector<float> steering(entries);
+
+    NMPC_RTISolver *solver = new NMPC_RTISolver();
+    solver->Setup();
+    solver->SetLimits(0, 0);
+
+    const double x0[NX] = {0, 0, 0};
+    double xx[N * NXU + NX];
+    double xx_last[N * NXU + NX];
+    long entry = 0;
+    long not_converged = 0;
+    memset(xx, 0, sizeof(xx));
+
+    for (int ia = 0; ia < header.size[TABLE_A]; ia++)
+    {
+        for (int ib = 0; ib < header.size[TABLE_B]; ib++)
+        {
+            for (int ic = 0; ic < header.size[TABLE_C]; ic++)
+            {
+                float coefficients[3] = {(float)GridPoint(header, TABLE_A, ia), (float)GridPoint(header, TABLE_B, ib),
+                                         (float)GridPoint(header, TABLE_C, ic)};
+                COORDINATE_STRUCT image_coord;
+                COORDINATE_STRUCT reference;
+                SampleLaneReference(coefficients, header.start_x, &image_coord, &reference);
+
+                for (int iv = 0; iv < n_speed; iv++, entry++)
+                {
+                    const double speed = GridPoint(header, TABLE_SPEED, iv);
+                    NMPCBounds(speed, lower, upper);
+                    solver->SetWeights(weights[iv]);
+                    solver->SetBounds(lower, upper);
+                    solver->SetReference(reference, speed);
+
+                    // the neighbouring grid point is the starting point
+                    double previous_steering = xx[4];
+                    bool converged = false;
+                    for (int it = 0; it < MAX_SQP_ITERATIONS && !converged; it++)
+                    {
+                        solver->SetInitialState(x0, speed, previous_steering);
+                        solver->Solve(LANE_FOLLOW, 0);
+                        solver->GetSolution(xx);
+
+                        double change = fabs(xx[4] - previous_steering);
+                        if (it > 0)
+                        {
+                            for (int k = 0; k < N; k++)
+                                change = std::max(change, fabs(xx[k * NXU + 4] - xx_last[k * NXU + 4]));
+                        }
+                        converged = it > 0 && change < SQP_TOLERANCE;
+                        memcpy(xx_last, xx, sizeof(xx));
+                        previous_steering = xx[4];
+                    }
+                    if (!converged)
+                        not_converged++;
+                    steering[entry] = (float)xx[4];
+                }
+            }
+            fprintf(stderr, "\r%ld / %ld", entry, entries);
+        }
+    }
+    fprintf(stderr, "\n");
+    delete solver;
+
+    FILE *file = fopen(argv[1], "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "can not write %s\n", argv[1]);
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(&weights[0], sizeof(NMPC_WEIGHTS), n_speed, file) == (size_t)n_speed
+            && fwrite(&steering[0], sizeof(float), entries, file) == (size_t)entries;
+    fclose(file);
+    if (!ok)
+    {
+        fprintf(stderr, "can not write %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%ld grid points, %ld not converged after %d iterations\n", entries, not_converged, MAX_SQP_ITERATIONS);
+    return 0;
+}
@@ -0,0 +1,468 @@
+/* Offline tuning of the NMPC weights of the real-time iteration
+ *
+ * Only NMPC_RTISolver is tuned. The filter drives with Ipopt by default ("NMPC::Backend"), whose
+ * collocation NLP may rank the weights differently.
+ *
+ * Every combination of the weight grid drives the closed loop of NMPC_RTISolver and the
+ * kinematic bicycle model (Bicycle_Model.h) along each recorded path: one real-time iteration
+ * per sampling interval DT as on the car, the first input is applied to the model for DT. The
+ * weight sets are distributed over worker threads, each with its own solver, and ranked by the
+ * RMS distance to the paths over all runs.
+ *
+ * A path file holds one point "x y" in m per line, lines starting with # are skipped: the lane
+ * center of a recorded drive or a maneuver trajectory.
+ *
+ * usage: NMPC_Weight_Sweep <path file>... [options]
+ *   --Qx|--QxN|--Qy|--QyN|--Qpsi|--Rv|--Rd|--CHGsa|--CHGss <v1,v2,...>
+ *                                 values of one weight, the others keep the lane following
+ *                                 weights of Lane_Reference.cpp at the speed
+ *   --min-speed|--max-speed <m/s> speed range of the lane following weights, the "Lane Following"
+ *                                 properties of the filter (0.5, 0.8)
+ *   --qy-high|--qy-low <v>        y weight above and below the middle of the range (4, 8)
+ *   --speed <m/s>                 reference speed, negative drives backwards (0.5)
+ *   --offset <m>                  lateral offset of the start to the path (0.1)
+ *   --horizon <stages>            horizon of the real-time iteration, up to NMPC_MAX_HORIZON (N)
+ *   --threads <count>             worker threads (all cores)
+ *   --rank error|time|max         sorted by RMS error, mean solve time or largest error (error)
+ *   --top <count>                 printed weight sets (20)
+ *   --csv <file>                  writes all weight sets
+ */
+#include "NMPC_RTI_Solver.h"
+#include "Lane_Reference.h"
+#include "Bicycle_Model.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#define MAX_STEPS_PER_METER     200     // a run which does not reach the end of the path stops
+#define END_DISTANCE            0.05    // m before the end of the path a run is finished
+
+static const char *weight_names[] = {"Qx", "QxN", "Qy", "QyN", "Qpsi", "Rv", "Rd", "CHGsa", "CHGss"};
+static double NMPC_WEIGHTS::* const weight_fields[] =
+{
+    &NMPC_WEIGHTS::Qx, &NMPC_WEIGHTS::QxN, &NMPC_WEIGHTS::Qy, &NMPC_WEIGHTS::QyN, &NMPC_WEIGHTS::Qpsi,
+    &NMPC_WEIGHTS::Rv, &NMPC_WEIGHTS::Rd, &NMPC_WEIGHTS::CHGsa, &NMPC_WEIGHTS::CHGss
+};
+#define WEIGHT_COUNT    (int(sizeof(weight_names) / sizeof(weight_names[0])))
+
+/* polyline with its arc length */
+typedef struct _SWEEP_PATH
+{
+    std::string name;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> s;
+} SWEEP_PATH;
+
+typedef struct _SWEEP_RESULT
+{
+    NMPC_WEIGHTS weights;
+    double rms_error;       // m, over all steps of all paths
+    double max_error;       // m
+    double mean_time;       // ms per solve
+    double max_time;        // ms
+    int unfinished;         // runs which did not reach the end of their path
+} SWEEP_RESULT;
+
+/* shared by the workers, the next weight set is taken under the lock */
+typedef struct _SWEEP_JOB
+{
+    const std::vector<SWEEP_PATH> *paths;
+    std::vector<SWEEP_RESULT> *results;
+    double speed;
+    double offset;
+    int horizon;
+    int next;
+    int done;
+    pthread_mutex_t lock;
+} SWEEP_JOB;
+
+static bool LoadPath(const char *file_name, SWEEP_PATH *path)
+{
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+        return false;
+
+    path->name = file_name;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        double x, y;
+        if (line[0] == '#' || sscanf(line, "%lf %lf", &x, &y) != 2)
+            continue;
+        // repeated points have no direction
+        if (!path->x.empty() && hypot(x - path->x.back(), y - path->y.back()) < 1e-6)
+            continue;
+        path->s.push_back(path->x.empty() ? 0 : path->s.back() + hypot(x - path->x.back(), y - path->y.back()));
+        path->x.push_back(x);
+        path->y.push_back(y);
+    }
+    fclose(file);
+    return path->x.size() >= 2;
+}
+
+/* point of the path at arc length s, held at the ends */
+static void PathPoint(const SWEEP_PATH& path, double s, double *x, double *y)
+{
+    const int last = (int)path.s.size() - 1;
+    if (s <= 0)
+    {
+        *x = path.x[0];
+        *y = path.y[0];
+        return;
+    }
+    if (s >= path.s[last])
+    {
+        *x = path.x[last];
+        *y = path.y[last];
+        return;
+    }
+    int i = (int)(std::upper_bound(path.s.begin(), path.s.end(), s) - path.s.begin()) - 1;
+    double t = (s - path.s[i]) / (path.s[i + 1] - path.s[i]);
+    *x = path.x[i] + t * (path.x[i + 1] - path.x[i]);
+    *y = path.y[i] + t * (path.y[i + 1] - path.y[i]);
+}
+
+/* projection of (x, y) on the path, searched from segment *segment on
+ * \return distance to the path, *s the arc length of the projection */
+static double ProjectOnPath(const SWEEP_PATH& path, double x, double y, int *segment, double *s)
+{
+    double best = 1e19;
+    const int segments = (int)path.s.size() - 1;
+    for (int i = *segment; i < segments; i++)
+    {
+        double sx = path.x[i + 1] - path.x[i];
+        double sy = path.y[i + 1] - path.y[i];
+        double length = path.s[i + 1] - path.s[i];
+        double t = ((x - path.x[i]) * sx + (y - path.y[i]) * sy) / (length * length);
+        t = std::max(0.0, std::min(1.0, t));
+        double d = hypot(x - path.x[i] - t * sx, y - path.y[i] - t * sy);
+        if (d < best)
+        {
+            best = d;
+            *s = path.s[i] + t * length;
+            *segment = i;
+        }
+        // the path goes away from the car, the nearest segment is behind
+        else if (d > best + length)
+            break;
+    }
+    return best;
+}
+
+static void RunWeights(const SWEEP_JOB& job, NMPC_RTISolver *solver, SWEEP_RESULT *result)
+{
+    const double speed = job.speed;
+    double lower[NXU];
+    double upper[NXU];
+    NMPCBounds(speed, lower, upper);
+
+    double squared_error = 0;
+    double time_sum = 0;
+    long steps = 0;
+    result->max_error = 0;
+    result->max_time = 0;
+    result->unfinished = 0;
+
+    for (size_t p = 0; p < job.paths->size(); p++)
+    {
+        const SWEEP_PATH& path = (*job.paths)[p];
+        const double length = path.s.back();
+        const double heading = atan2(path.y[1] - path.y[0], path.x[1] - path.x[0]) + (speed < 0 ? M_PI : 0);
+
+        solver->Reset();
+        solver->SetHorizon(job.horizon);
+        solver->SetWeights(result->weights);
+        solver->SetBounds(lower, upper);
+
+        BicycleState x(path.x[0] - job.offset * sin(heading), path.y[0] + job.offset * cos(heading), heading);
+        double steering = 0;
+        int segment = 0;
+        double s = 0;
+        const long max_steps = (long)(MAX_STEPS_PER_METER * length) + 1;
+        long step = 0;
+        for (; step < max_steps; step++)
+        {
+            double error = ProjectOnPath(path, x(0), x(1), &segment, &s);
+            if (s >= length - END_DISTANCE)
+                break;
+            squared_error += error * error;
+            result->max_error = std::max(result->max_error, error);
+
+            // reference points DT apart at the reference speed, from the projection on
+            COORDINATE_STRUCT reference;
+            for (int k = 0; k <= NMPC_MAX_HORIZON; k++)
+            {
+                double rx, ry;
+                PathPoint(path, s + k * fabs(speed) * DT, &rx, &ry);
+                reference.X[k] = rx;
+                reference.Y[k] = ry;
+            }
+            const double x0[NX] = {x(0), x(1), x(2)};
+            solver->SetReference(reference, speed);
+            solver->SetInitialState(x0, speed, steering);
+
+            timeval start, end;
+            gettimeofday(&start, 0);
+            solver->Solve(LANE_FOLLOW, 1.0);
+            gettimeofday(&end, 0);
+            double time = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+            time_sum += time;
+            result->max_time = std::max(result->max_time, time);
+            steps++;
+
+            double v;
+            solver->GetInputs(&v, &steering);
+            BicycleState x_next;
+            BicycleIntegrate(x, BicycleInput(v, steering), DT, x_next);
+            x = x_next;
+        }
+        if (step == max_steps)
+            result->unfinished++;
+    }
+
+    result->rms_error = (steps > 0) ? sqrt(squared_error / steps) : 0;
+    result->mean_time = (steps > 0) ? time_sum / steps : 0;
+}
+
+static void *SweepWorker(void *argument)
+{
+    SWEEP_JOB *job = static_cast<SWEEP_JOB*>(argument);
+    NMPC_RTISolver *solver = new NMPC_RTISolver();
+    solver->Setup();
+    solver->SetLimits(0, 0);
+
+    const int count = (int)job->results->size();
+    for (;;)
+    {
+        pthread_mutex_lock(&job->lock);
+        int index = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (index >= count)
+            break;
+
+        RunWeights(*job, solver, &(*job->results)[index]);
+
+        pthread_mutex_lock(&job->lock);
+        job->done++;
+        fprintf(stderr, "\r%d / %d", job->done, count);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    delete solver;
+    return NULL;
+}
+
+static bool ParseValues(const char *text, std::vector<double> *values)
+{
+    values->clear();
+    while (*text != '\0')
+    {
+        char *end;
+        double value = strtod(text, &end);
+        if (end == text)
+            return false;
+        values->push_back(value);
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return !values->empty();
+}
+
+static int rank_by = 0;     // 0 RMS error, 1 mean solve time, 2 largest error
+
+static bool BetterResult(const SWEEP_RESULT& a, const SWEEP_RESULT& b)
+{
+    if (a.unfinished != b.unfinished)
+        return a.unfinished < b.unfinished;
+    if (rank_by == 1 && a.mean_time != b.mean_time)
+        return a.mean_time < b.mean_time;
+    if (rank_by == 2 && a.max_error != b.max_error)
+        return a.max_error < b.max_error;
+    return a.rms_error < b.rms_error;
+}
+
+static void PrintResult(FILE *file, const SWEEP_RESULT& result, const char *separator)
+{
+    for (int w = 0; w < WEIGHT_COUNT; w++)
+        fprintf(file, "%g%s", result.weights.*weight_fields[w], separator);
+    fprintf(file, "%.2f%s%.2f%s%.3f%s%.3f%s%d\n", result.rms_error * 100, separator, result.max_error * 100, separator,
+            result.mean_time, separator, result.max_time, separator, result.unfinished);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<SWEEP_PATH> paths;
+    std::vector<double> values[WEIGHT_COUNT];
+    double speed = 0.5;
+    double offset = 0.1;
+    int horizon = N;
+    double min_speed = LANE_FOLLOW_MIN_SPEED;
+    double max_speed = LANE_FOLLOW_MAX_SPEED;
+    double qy_high_speed = LANE_FOLLOW_QY_HIGH_SPEED;
+    double qy_low_speed = LANE_FOLLOW_QY_LOW_SPEED;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int top = 20;
+    const char *csv_name = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = true;
+        int weight = -1;
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            for (int w = 0; w < WEIGHT_COUNT; w++)
+            {
+                if (strcmp(argv[i] + 2, weight_names[w]) == 0)
+                    weight = w;
+            }
+        }
+
+        if (weight >= 0 && i + 1 < argc)
+            ok = ParseValues(argv[++i], &values[weight]);
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+            speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc)
+            offset = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-speed") == 0 && i + 1 < argc)
+            min_speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--max-speed") == 0 && i + 1 < argc)
+            max_speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--qy-high") == 0 && i + 1 < argc)
+            qy_high_speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--qy-low") == 0 && i + 1 < argc)
+            qy_low_speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--horizon") == 0 && i + 1 < argc)
+            horizon = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rank") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "error") == 0)
+                rank_by = 0;
+            else if (strcmp(argv[i], "time") == 0)
+                rank_by = 1;
+            else if (strcmp(argv[i], "max") == 0)
+                rank_by = 2;
+            else
+                ok = false;
+        }
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+            top = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            csv_name = argv[++i];
+        else if (strncmp(argv[i], "--", 2) != 0)
+        {
+            SWEEP_PATH path;
+            ok = LoadPath(argv[i], &path);
+            if (ok)
+                paths.push_back(path);
+        }
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            fprintf(stderr, "invalid argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (paths.empty() || speed == 0)
+    {
+        fprintf(stderr, "usage: %s <path file>... [--Qx|--QxN|--Qy|--QyN|--Qpsi|--Rv|--Rd|--CHGsa|--CHGss v1,v2,...] "
+                        "[--speed m/s] [--min-speed m/s] [--max-speed m/s] [--qy-high v] [--qy-low v] [--offset m] "
+                        "[--horizon stages] [--threads count] [--rank error|time|max] [--top count] [--csv file]\n"
+                        "tunes the weights of the real-time iteration only, the filter drives with Ipopt by default\n", argv[0]);
+        return 1;
+    }
+
+    // the weights which are not swept are those of lane following at the speed
+    NMPC_WEIGHTS base;
+    LaneFollowWeights(fabs(speed), min_speed, max_speed, qy_high_speed, qy_low_speed, &base);
+    for (int w = 0; w < WEIGHT_COUNT; w++)
+    {
+        if (values[w].empty())
+            values[w].push_back(base.*weight_fields[w]);
+    }
+
+    // cartesian product, the first weight changes fastest
+    long combinations = 1;
+    for (int w = 0; w < WEIGHT_COUNT; w++)
+        combinations *= (long)values[w].size();
+    std::vector<SWEEP_RESULT> results(combinations);
+    for (long c = 0; c < combinations; c++)
+    {
+        long rest = c;
+        for (int w = 0; w < WEIGHT_COUNT; w++)
+        {
+            results[c].weights.*weight_fields[w] = values[w][rest % values[w].size()];
+            rest /= (long)values[w].size();
+        }
+    }
+
+    SWEEP_JOB job;
+    job.paths = &paths;
+    job.results = &results;
+    job.speed = speed;
+    job.offset = offset;
+    job.horizon = horizon;
+    job.next = 0;
+    job.done = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    threads = std::max(1, std::min(threads, (int)combinations));
+    std::vector<pthread_t> workers(threads);
+    for (int t = 0; t < threads; t++)
+    {
+        if (pthread_create(&workers[t], NULL, SweepWorker, &job) != 0)
+        {
+            fprintf(stderr, "can not start worker thread %d\n", t);
+            threads = t;
+            break;
+        }
+    }
+    if (threads == 0)
+        SweepWorker(&job);
+    for (int t = 0; t < threads; t++)
+        pthread_join(workers[t], NULL);
+    pthread_mutex_destroy(&job.lock);
+    fprintf(stderr, "\n");
+
+    std::stable_sort(results.begin(), results.end(), BetterResult);
+
+    if (csv_name != NULL)
+    {
+        FILE *csv = fopen(csv_name, "w");
+        if (csv == NULL)
+        {
+            fprintf(stderr, "can not write %s\n", csv_name);
+            return 1;
+        }
+        for (int w = 0; w < WEIGHT_COUNT; w++)
+            fprintf(csv, "%s,", weight_names[w]);
+        fprintf(csv, "rms_error_cm,max_error_cm,mean_solve_ms,max_solve_ms,unfinished\n");
+        for (long c = 0; c < combinations; c++)
+            PrintResult(csv, results[c], ",");
+        fclose(csv);
+    }
+
+    printf("%ld weight sets, %d paths, %d threads, speed %g m/s\n", combinations, (int)paths.size(), threads, speed);
+    printf("ranked on the real-time iteration, the filter drives with Ipopt unless \"NMPC::Backend\" selects it\n");
+    for (int w = 0; w < WEIGHT_COUNT; w++)
+        printf("%s\t", weight_names[w]);
+    printf("rms cm\tmax cm\tmean ms\tmax ms\tunfinished\n");
+    for (long c = 0; c < combinations && c < top; c++)
+        PrintResult(stdout, results[c], "\t");
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "Ultrasonic_Tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+UltrasonicTracker::UltrasonicTracker()
+    : m_fAlpha(0.5f),
+      m_fBeta(0.2f),
+      m_fGate(25),
+      m_nConfirmHits(3),
+      m_nMaxMisses(3)
+{
+    Reset();
+}
+
+void UltrasonicTracker::SetParameters(float alpha, float beta, float gate, int confirm_hits, int max_misses)
+{
+    m_fAlpha = alpha;
+    m_fBeta = beta;
+    m_fGate = gate;
+    m_nConfirmHits = confirm_hits;
+    m_nMaxMisses = max_misses;
+}
+
+void UltrasonicTracker::Reset()
+{
+    m_tracks.count = 0;
+    m_nNextId = 0;
+    m_dLastTime = 0;
+}
+
+void UltrasonicTracker::Update(const float returns[][2], const bool *valid, int count, double time)
+{
+    count = std::min(count, ULTRASONIC_MAX_RETURNS);
+
+    double dt = (m_dLastTime > 0) ? time - m_dLastTime : 0;
+    if (dt < 0)
+        dt = 0;
+    else if (dt > ULTRASONIC_TRACK_MAX_DT)
+        dt = ULTRASONIC_TRACK_MAX_DT;
+    m_dLastTime = time;
+
+    for (int t = 0; t < m_tracks.count; t++)
+    {
+        ULTRASONIC_TRACK& track = m_tracks.track[t];
+        track.x += static_cast<float>(track.vx * dt);
+        track.y += static_cast<float>(track.vy * dt);
+    }
+
+    // the pairs within the gate, each is taken if neither the track nor the return is assigned yet
+    float pair_distance[ULTRASONIC_MAX_TRACKS * ULTRASONIC_MAX_RETURNS];
+    int pair_order[ULTRASONIC_MAX_TRACKS * ULTRASONIC_MAX_RETURNS];
+    int pairs = 0;
+    for (int t = 0; t < m_tracks.count; t++)
+    {
+        for (int r = 0; r < count; r++)
+        {
+            if (!valid[r])
+                continue;
+            float dx = returns[r][0] - m_tracks.track[t].x;
+            float dy = returns[r][1] - m_tracks.track[t].y;
+            float distance = sqrt(dx * dx + dy * dy);
+            if (distance >= m_fGate)
+                continue;
+            // insertion by distance, there are 100 pairs at most
+            int k = pairs++;
+            while (k > 0 && pair_distance[k - 1] > distance)
+            {
+                pair_distance[k] = pair_distance[k - 1];
+                pair_order[k] = pair_order[k - 1];
+                k--;
+            }
+            pair_distance[k] = distance;
+            pair_order[k] = t * ULTRASONIC_MAX_RETURNS + r;
+        }
+    }
+
+    int track_return[ULTRASONIC_MAX_TRACKS];
+    bool return_used[ULTRASONIC_MAX_RETURNS];
+    std::fill(track_return, track_return + ULTRASONIC_MAX_TRACKS, -1);
+    std::fill(return_used, return_used + ULTRASONIC_MAX_RETURNS, false);
+    for (int k = 0; k < pairs; k++)
+    {
+        int t = pair_order[k] / ULTRASONIC_MAX_RETURNS;
+        int r = pair_order[k] % ULTRASONIC_MAX_RETURNS;
+        if (track_return[t] >= 0 || return_used[r])
+            continue;
+        track_return[t] = r;
+        return_used[r] = true;
+    }
+
+    int kept = 0;
+    for (int t = 0; t < m_tracks.count; t++)
+    {
+        ULTRASONIC_TRACK track = m_tracks.track[t];
+        int r = track_return[t];
+        if (r >= 0)
+        {
+            float residual_x = returns[r][0] - track.x;
+            float residual_y = returns[r][1] - track.y;
+            track.x += m_fAlpha * residual_x;
+            track.y += m_fAlpha * residual_y;
+            if (dt > 0)
+            {
+                track.vx += static_cast<float>(m_fBeta / dt * residual_x);
+                track.vy += static_cast<float>(m_fBeta / dt * residual_y);
+            }
+            track.sensor = r;
+            track.hits++;
+            track.misses = 0;
+            if (track.hits >= m_nConfirmHits)
+                track.confirmed = true;
+        }
+        else if (++track.misses > m_nMaxMisses)
+            continue;
+
+        m_tracks.track[kept++] = track;
+    }
+    m_tracks.count = kept;
+
+    for (int r = 0; r < count && m_tracks.count < ULTRASONIC_MAX_TRACKS; r++)
+    {
+        if (!valid[r] || return_used[r])
+            continue;
+        ULTRASONIC_TRACK& track = m_tracks.track[m_tracks.count++];
+        track.id = m_nNextId++;
+        track.x = returns[r][0];
+        track.y = returns[r][1];
+        track.vx = 0;
+        track.vy = 0;
+        track.sensor = r;
+        track.hits = 1;
+        track.misses = 0;
+        track.confirmed = (m_nConfirmHits <= 1);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef _ULTRASONIC_TRACKER_H_
+#define _ULTRASONIC_TRACKER_H_
+
+#define ULTRASONIC_MAX_RETURNS      10      // sensors of the ring, one return each
+#define ULTRASONIC_MAX_TRACKS       10
+#define ULTRASONIC_TRACK_MAX_DT     0.5     // s, longer gaps between samples are predicted over this time only
+
+/*! Obstacle followed over the samples of the ultrasonic ring, in the car frame of ult_world_coord */
+typedef struct _ULTRASONIC_TRACK
+{
+    int id;
+    float x;                // cm, forward
+    float y;                // cm, to the right
+    float vx;               // cm/s, relative to the car, < 0 while the obstacle comes closer in front
+    float vy;               // cm/s
+    int sensor;             // return of the last update, ULTRASONIC
+    int hits;               // updates since the track was started
+    int misses;             // samples without a return since the last update
+    bool confirmed;         // hits reached the confirmation count once
+
+} ULTRASONIC_TRACK;
+
+typedef struct _ULTRASONIC_TRACK_LIST
+{
+    int count;
+    ULTRASONIC_TRACK track[ULTRASONIC_MAX_TRACKS];
+
+} ULTRASONIC_TRACK_LIST;
+
+/*! Alpha-beta tracker over the returns of the ultrasonic ring.
+ *
+ *  Every sample predicts the tracks to its time, assigns each return to the nearest track within
+ *  the gate (closest pairs first), corrects position and velocity of the assigned tracks and starts
+ *  a track for every return which is left. A track is dropped after more than max_misses samples
+ *  without a return. The capacity is fixed, Update() does not allocate.
+ */
+class UltrasonicTracker
+{
+public:
+    UltrasonicTracker();
+
+    /*! \param alpha         position gain, 0..1
+     *  \param beta          velocity gain, 0..2
+     *  \param gate          cm, largest distance between a return and the predicted track
+     *  \param confirm_hits  updates until a track is confirmed
+     *  \param max_misses    samples without a return a track survives */
+    void SetParameters(float alpha, float beta, float gate, int confirm_hits, int max_misses);
+    void Reset();
+
+    /*! \param returns  cm, car frame, one row per sensor
+     *  \param valid    false for the sensors without an echo
+     *  \param time     s, of the sample */
+    void Update(const float returns[][2], const bool *valid, int count, double time);
+
+    const ULTRASONIC_TRACK_LIST& GetTracks() const { return m_tracks; }
+
+private:
+    float m_fAlpha;
+    float m_fBeta;
+    float m_fGate;
+    int m_nConfirmHits;
+    int m_nMaxMisses;
+
+    ULTRASONIC_TRACK_LIST m_tracks;
+    int m_nNextId;
+    double m_dLastTime;     // s, 0 before the first sample
+};
+
+#endif // _ULTRASONIC_TRACKER_H_